@@ -0,0 +1,65 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Synthetic HDL-32 data packets shared by the tests.  Each test that sends
+// them over the network uses a port of its own, so that they can run in
+// parallel.
+
+#ifndef __SyntheticPackets_h
+#define __SyntheticPackets_h
+
+#include <cstring>
+#include <vector>
+
+namespace SyntheticPackets
+{
+
+enum
+{
+  PACKETS_PER_REVOLUTION = 150,
+  // raw return distance, 10 m in 2 mm units
+  DISTANCE = 5000,
+  INTENSITY = 100,
+  // microseconds between packets
+  PACKET_INTERVAL = 553
+};
+
+// Packet index of a revolution that starts at azimuth 0: 12 firings of all
+// 32 lasers, 0.2 degrees apart.
+inline void MakePacket(int index, std::vector<unsigned char>& packet)
+{
+  packet.assign(1206, 0);
+  for (int firing = 0; firing < 12; ++firing)
+    {
+    unsigned char* block = &packet[firing * 100];
+    const int azimuth = ((index * 12 + firing) * 20) % 36000;
+    block[0] = 0xff;
+    block[1] = 0xee;
+    block[2] = azimuth & 0xff;
+    block[3] = azimuth >> 8;
+    for (int laser = 0; laser < 32; ++laser)
+      {
+      block[4 + laser * 3] = DISTANCE & 0xff;
+      block[5 + laser * 3] = DISTANCE >> 8;
+      block[6 + laser * 3] = INTENSITY;
+      }
+    }
+
+  const unsigned int timestamp = index * PACKET_INTERVAL;
+  memcpy(&packet[1200], &timestamp, 4);
+}
+
+}
+
+#endif
@@ -22,6 +22,61 @@
 #include <string>
 #include <cstdio>
 
+namespace
+{
+struct FrameComparison
+{
+  vtkVelodyneHDLReader* Reader;
+  int Frames;
+  int Mismatches;
+};
+
+// Whether two frames hold the same points and point arrays.
+bool SameFrame(vtkPolyData* a, vtkPolyData* b)
+{
+  if (!a || !b || a->GetNumberOfPoints() != b->GetNumberOfPoints())
+    {
+    return false;
+    }
+
+  const char* names[] = {"intensity", "laser_id", "azimuth", "distance_m", "timestamp", 0};
+  for (vtkIdType i = 0; i < a->GetNumberOfPoints(); ++i)
+    {
+    double pointA[3], pointB[3];
+    a->GetPoint(i, pointA);
+    b->GetPoint(i, pointB);
+    if (pointA[0] != pointB[0] || pointA[1] != pointB[1] || pointA[2] != pointB[2])
+      {
+      return false;
+      }
+    for (int j = 0; names[j]; ++j)
+      {
+      if (a->GetPointData()->GetArray(names[j])->GetTuple1(i) != b->GetPointData()->GetArray(names[j])->GetTuple1(i))
+        {
+        return false;
+        }
+      }
+    }
+  return true;
+}
+
+// Compares a frame visited by ForEachFrame to the same frame read alone.
+void CompareFrame(vtkPolyData* frame, const vtkVelodyneHDLReader::FrameInfo& info, void* clientData)
+{
+  FrameComparison* comparison = static_cast<FrameComparison*>(clientData);
+  ++comparison->Frames;
+  vtkSmartPointer<vtkPolyData> expected = comparison->Reader->GetFrame(info.FrameNumber);
+  if (!SameFrame(frame, expected) || expected->GetNumberOfPoints() != info.NumberOfPoints)
+    {
+    printf("  frame %d differs from GetFrame: %lld points, %lld read alone, %lld indexed\n", info.FrameNumber,
+      static_cast<long long>(frame ? frame->GetNumberOfPoints() : 0),
+      static_cast<long long>(expected ? expected->GetNumberOfPoints() : 0),
+      static_cast<long long>(info.NumberOfPoints));
+    ++comparison->Mismatches;
+    }
+}
+}
+
 
 int main(int argc, char* argv[])
 {
@@ -73,5 +128,19 @@ int main(int argc, char* argv[])
 
   reader->Close();
 
-  return 0;
+  // every 10th frame, read in one pass and decoded on 4 threads, must
+  // match the frames read one at a time
+  vtkVelodyneHDLReader::FrameSelection selection;
+  selection.Stride = 10;
+  const int nSelected = static_cast<int>(reader->SelectFrames(selection).size());
+  reader->SetNumberOfDecodeThreads(4);
+  FrameComparison comparison = {reader.GetPointer(), 0, 0};
+  reader->Open();
+  startTime = vtkTimerLog::GetUniversalTime();
+  const int nVisited = reader->ForEachFrame(selection, &CompareFrame, &comparison);
+  elapsed = vtkTimerLog::GetUniversalTime() - startTime;
+  reader->Close();
+  printf("elapsed time: %f for %d frames, %d differ\n", elapsed, nVisited, comparison.Mismatches);
+
+  return (nVisited == nSelected && comparison.Frames == nSelected && comparison.Mismatches == 0) ? 0 : 1;
 }
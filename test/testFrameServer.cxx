@@ -0,0 +1,403 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Subscribes to a vtkFrameSocketServer the way a client process would
+// (see vtkVelodyneHDLSource::SetFrameServerPath).  A published frame must
+// arrive as a shared memory buffer holding the same columns, and
+// subscribers that do not read must be treated as their policy says:
+// DROP_OLDEST keeps the newest frames, DROP_NEWEST the oldest ones, and
+// DISCONNECT closes the connection.
+
+#include <vtkFrameSocketServer.h>
+#include <vtkPolyData.h>
+#include <vtkPoints.h>
+#include <vtkPointData.h>
+#include <vtkFloatArray.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkUnsignedShortArray.h>
+#include <vtkUnsignedIntArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+
+typedef vtkFrameSocketServer Server;
+
+// The frame sent to the slow subscribers is published this many times.
+const int NumberOfSlowFrames = 5000;
+
+struct Message
+{
+  Server::MessageHeader Header;
+  std::string Payload;
+  int FileDescriptor;
+};
+
+vtkSmartPointer<vtkPolyData> MakeFrame(int numberOfPoints)
+{
+  vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+  vtkNew<vtkPoints> points;
+  points->SetDataTypeToFloat();
+  vtkNew<vtkUnsignedCharArray> intensity;
+  intensity->SetName("intensity");
+  vtkNew<vtkUnsignedCharArray> laserId;
+  laserId->SetName("laser_id");
+  vtkNew<vtkUnsignedShortArray> azimuth;
+  azimuth->SetName("azimuth");
+  vtkNew<vtkDoubleArray> distance;
+  distance->SetName("distance_m");
+  vtkNew<vtkUnsignedIntArray> timestamp;
+  timestamp->SetName("timestamp");
+
+  for (int i = 0; i < numberOfPoints; ++i)
+    {
+    points->InsertNextPoint(i, -i, 0.5 * i);
+    intensity->InsertNextValue(static_cast<unsigned char>(i % 256));
+    laserId->InsertNextValue(static_cast<unsigned char>(i % 32));
+    azimuth->InsertNextValue(static_cast<unsigned short>((i * 36) % 36000));
+    distance->InsertNextValue(0.01 * i);
+    timestamp->InsertNextValue(1000 + i);
+    }
+
+  polyData->SetPoints(points.GetPointer());
+  polyData->GetPointData()->AddArray(intensity.GetPointer());
+  polyData->GetPointData()->AddArray(laserId.GetPointer());
+  polyData->GetPointData()->AddArray(azimuth.GetPointer());
+  polyData->GetPointData()->AddArray(distance.GetPointer());
+  polyData->GetPointData()->AddArray(timestamp.GetPointer());
+  return polyData;
+}
+
+int Connect(const std::string& path, unsigned int topics, unsigned int policy, unsigned int maxQueuedMessages)
+{
+  int socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  if (connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+    close(socket);
+    return -1;
+    }
+
+  // a read that gets nothing for a second means the server sent it all
+  timeval timeout;
+  timeout.tv_sec = 1;
+  timeout.tv_usec = 0;
+  setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  Server::SubscribeRequest request;
+  memset(&request, 0, sizeof(request));
+  request.Magic = Server::MAGIC;
+  request.Version = Server::PROTOCOL_VERSION;
+  request.Topics = topics;
+  request.Policy = policy;
+  request.MaxQueuedMessages = maxQueuedMessages;
+  send(socket, &request, sizeof(request), 0);
+  return socket;
+}
+
+// Returns 1 for a message, 0 if the server closed the connection and -1
+// if nothing arrived.
+int ReceiveAll(int socket, char* data, size_t length)
+{
+  while (length)
+    {
+    ssize_t received = recv(socket, data, length, 0);
+    if (received <= 0)
+      {
+      return received == 0 ? 0 : -1;
+      }
+    data += received;
+    length -= received;
+    }
+  return 1;
+}
+
+// Receives one message and the descriptor that may come with it, same
+// return values as ReceiveAll.
+int ReceiveMessage(int socket, Message& message)
+{
+  message.FileDescriptor = -1;
+
+  iovec iov;
+  iov.iov_base = &message.Header;
+  iov.iov_len = sizeof(message.Header);
+
+  union
+    {
+    cmsghdr Header;
+    char Data[CMSG_SPACE(sizeof(int))];
+    } control;
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.Data;
+  msg.msg_controllen = sizeof(control.Data);
+
+  ssize_t received = recvmsg(socket, &msg, 0);
+  if (received <= 0)
+    {
+    return received == 0 ? 0 : -1;
+    }
+
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      {
+      memcpy(&message.FileDescriptor, CMSG_DATA(cmsg), sizeof(int));
+      }
+    }
+
+  int result = ReceiveAll(socket, reinterpret_cast<char*>(&message.Header) + received,
+    sizeof(message.Header) - received);
+  message.Payload.assign(message.Header.PayloadSize, '\0');
+  if (result == 1 && message.Header.PayloadSize)
+    {
+    result = ReceiveAll(socket, &message.Payload[0], message.Payload.size());
+    }
+  return result;
+}
+
+// Reads messages until none arrive, returns true if the server closed the
+// connection.
+bool ReceiveMessages(int socket, std::vector<Message>& messages)
+{
+  Message message;
+  int result = 0;
+  while ((result = ReceiveMessage(socket, message)) == 1)
+    {
+    if (message.FileDescriptor >= 0)
+      {
+      close(message.FileDescriptor);
+      message.FileDescriptor = -1;
+      }
+    messages.push_back(message);
+    }
+  return result == 0;
+}
+
+template <typename T>
+bool CheckColumn(const char* memory, const Server::MessageHeader& header, int column, const T* expected,
+  size_t count, const char* name)
+{
+  const T* values = reinterpret_cast<const T*>(memory + header.ColumnOffsets[column]);
+  if (memcmp(values, expected, count * sizeof(T)) != 0)
+    {
+    printf("column %s differs from the published frame\n", name);
+    return false;
+    }
+  return true;
+}
+
+bool CheckFrame(const Message& message, vtkPolyData* polyData)
+{
+  const vtkIdType numberOfPoints = polyData->GetNumberOfPoints();
+  if (message.Header.NumberOfPoints != numberOfPoints || message.FileDescriptor < 0 ||
+      !message.Header.BufferSize)
+    {
+    printf("frame message without the frame: %u points, descriptor %d\n",
+      message.Header.NumberOfPoints, message.FileDescriptor);
+    return false;
+    }
+
+  void* memory = mmap(0, message.Header.BufferSize, PROT_READ, MAP_SHARED, message.FileDescriptor, 0);
+  if (memory == MAP_FAILED)
+    {
+    printf("failed to map the frame buffer\n");
+    return false;
+    }
+
+  const char* data = static_cast<const char*>(memory);
+  vtkPointData* pointData = polyData->GetPointData();
+  const bool ok =
+    CheckColumn(data, message.Header, Server::COLUMN_XYZ,
+      vtkFloatArray::SafeDownCast(polyData->GetPoints()->GetData())->GetPointer(0), 3 * numberOfPoints, "xyz") &&
+    CheckColumn(data, message.Header, Server::COLUMN_INTENSITY,
+      vtkUnsignedCharArray::SafeDownCast(pointData->GetArray("intensity"))->GetPointer(0), numberOfPoints,
+      "intensity") &&
+    CheckColumn(data, message.Header, Server::COLUMN_LASER_ID,
+      vtkUnsignedCharArray::SafeDownCast(pointData->GetArray("laser_id"))->GetPointer(0), numberOfPoints,
+      "laser_id") &&
+    CheckColumn(data, message.Header, Server::COLUMN_AZIMUTH,
+      vtkUnsignedShortArray::SafeDownCast(pointData->GetArray("azimuth"))->GetPointer(0), numberOfPoints,
+      "azimuth") &&
+    CheckColumn(data, message.Header, Server::COLUMN_DISTANCE,
+      vtkDoubleArray::SafeDownCast(pointData->GetArray("distance_m"))->GetPointer(0), numberOfPoints,
+      "distance_m") &&
+    CheckColumn(data, message.Header, Server::COLUMN_TIMESTAMP,
+      vtkUnsignedIntArray::SafeDownCast(pointData->GetArray("timestamp"))->GetPointer(0), numberOfPoints,
+      "timestamp");
+  munmap(memory, message.Header.BufferSize);
+  return ok;
+}
+
+bool CheckStatistics(const Message& message, int numberOfPoints)
+{
+  const Server::Statistics* statistics = reinterpret_cast<const Server::Statistics*>(message.Payload.data());
+  const bool ok = (message.Payload.size() == sizeof(Server::Statistics) &&
+    statistics->NumberOfPoints == static_cast<uint32_t>(numberOfPoints) &&
+    statistics->FirstTimestamp == 1000 && statistics->LastTimestamp == 1000u + numberOfPoints - 1 &&
+    statistics->MinDistance == 0 && std::fabs(statistics->MaxDistance - 0.01 * (numberOfPoints - 1)) < 1e-4);
+  if (!ok)
+    {
+    printf("statistics do not match the published frame\n");
+    }
+  return ok;
+}
+
+// Frame ids of the slow frames a subscriber received, from 0, and how many
+// it was told were dropped.
+void SlowFrames(const std::vector<Message>& messages, uint64_t firstId, std::vector<uint64_t>& ids, uint32_t& dropped)
+{
+  dropped = 0;
+  for (size_t i = 0; i < messages.size(); ++i)
+    {
+    ids.push_back(messages[i].Header.FrameId - firstId);
+    dropped = std::max(dropped, messages[i].Header.DroppedMessages);
+    }
+}
+
+bool Increasing(const std::vector<uint64_t>& ids)
+{
+  for (size_t i = 1; i < ids.size(); ++i)
+    {
+    if (ids[i] <= ids[i - 1])
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+}
+
+int main(int, char*[])
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/testFrameServer-%d.sock", static_cast<int>(getpid()));
+
+  Server server;
+  if (!server.Start(path))
+    {
+    printf("failed to start the server: %s\n", server.GetLastError().c_str());
+    return 1;
+    }
+
+  // round trip of one frame
+  const int numberOfPoints = 1000;
+  vtkSmartPointer<vtkPolyData> frame = MakeFrame(numberOfPoints);
+  int client = Connect(path, Server::TOPIC_FRAME | Server::TOPIC_STATISTICS, Server::DROP_OLDEST, 16);
+  if (client < 0)
+    {
+    printf("failed to connect to %s\n", path);
+    return 1;
+    }
+  boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+  server.PublishFrame(frame, 12.5);
+
+  bool ok = true;
+  int frameMessages = 0;
+  int statisticsMessages = 0;
+  Message message;
+  while ((frameMessages == 0 || statisticsMessages == 0) && ReceiveMessage(client, message) == 1)
+    {
+    if (message.Header.Topic == Server::TOPIC_FRAME)
+      {
+      ok = ok && message.Header.FrameTime == 12.5 && CheckFrame(message, frame);
+      ++frameMessages;
+      }
+    else if (message.Header.Topic == Server::TOPIC_STATISTICS)
+      {
+      ok = ok && CheckStatistics(message, numberOfPoints);
+      ++statisticsMessages;
+      }
+    if (message.FileDescriptor >= 0)
+      {
+      close(message.FileDescriptor);
+      }
+    }
+  close(client);
+  printf("frame messages %d, statistics messages %d\n", frameMessages, statisticsMessages);
+  ok = ok && frameMessages == 1 && statisticsMessages == 1;
+
+  // subscribers that do not read while the frames are published, the
+  // socket fills up and then their queue of at most 4 messages
+  const unsigned int topics = Server::TOPIC_STATISTICS;
+  int dropOldest = Connect(path, topics, Server::DROP_OLDEST, 4);
+  int dropNewest = Connect(path, topics, Server::DROP_NEWEST, 4);
+  int disconnect = Connect(path, topics, Server::DISCONNECT, 4);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+
+  vtkSmartPointer<vtkPolyData> smallFrame = MakeFrame(4);
+  for (int i = 0; i < NumberOfSlowFrames; ++i)
+    {
+    server.PublishFrame(smallFrame, i);
+    }
+  boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+
+  std::vector<Message> oldestMessages, newestMessages, disconnectMessages;
+  const bool oldestClosed = ReceiveMessages(dropOldest, oldestMessages);
+  const bool newestClosed = ReceiveMessages(dropNewest, newestMessages);
+  const bool disconnectClosed = ReceiveMessages(disconnect, disconnectMessages);
+  close(dropOldest);
+  close(dropNewest);
+  close(disconnect);
+  server.Stop();
+
+  // the round trip frame had id 0
+  const uint64_t count = NumberOfSlowFrames;
+  std::vector<uint64_t> oldestIds, newestIds, disconnectIds;
+  uint32_t oldestDropped = 0, newestDropped = 0, disconnectDropped = 0;
+  SlowFrames(oldestMessages, 1, oldestIds, oldestDropped);
+  SlowFrames(newestMessages, 1, newestIds, newestDropped);
+  SlowFrames(disconnectMessages, 1, disconnectIds, disconnectDropped);
+
+  printf("drop oldest: %d received, %u dropped, last frame %d\n", static_cast<int>(oldestIds.size()),
+    oldestDropped, oldestIds.empty() ? -1 : static_cast<int>(oldestIds.back()));
+  printf("drop newest: %d received, %u dropped, last frame %d\n", static_cast<int>(newestIds.size()),
+    newestDropped, newestIds.empty() ? -1 : static_cast<int>(newestIds.back()));
+  printf("disconnect: %d received, closed %d\n", static_cast<int>(disconnectIds.size()), disconnectClosed);
+
+  // every frame is either received or counted as dropped, DROP_OLDEST
+  // ends with the last frame and DROP_NEWEST with a gapless prefix
+  ok = ok && !oldestClosed && !oldestIds.empty() && oldestDropped > 0 && Increasing(oldestIds) &&
+    oldestIds.size() + oldestDropped == count && oldestIds.back() == count - 1;
+  ok = ok && !newestClosed && !newestIds.empty() && newestDropped > 0 && Increasing(newestIds) &&
+    newestIds.size() + newestDropped == count && newestIds.back() == newestIds.size() - 1;
+  ok = ok && disconnectClosed && disconnectIds.size() < count && Increasing(disconnectIds) &&
+    disconnectDropped == 0;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Writes synthetic packets to a packet file and a calibration unlike the
+// default HDL-32 one to a corrections file, then reads the frames with
+// ForEachFrame on several threads and with GetFrame afterwards.  Every
+// point must be placed by the loaded calibration: neither the decode
+// workers nor any other reader may replace it.
+
+#include <vtkPacketFileWriter.h>
+#include <vtkVelodyneHDLReader.h>
+#include <vtkPolyData.h>
+#include <vtkPoints.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "SyntheticPackets.h"
+
+namespace
+{
+
+const int NumberOfRevolutions = 4;
+
+struct Calibration
+{
+  // degrees
+  double Azimuth;
+  double Vertical;
+  // centimeters, as in the file
+  double Distance;
+  double VerticalOffset;
+  double HorizontalOffset;
+};
+
+Calibration GetCalibration(int laser)
+{
+  Calibration calibration;
+  calibration.Azimuth = (laser % 4) * 0.5;
+  calibration.Vertical = -25 + 1.5 * laser;
+  calibration.Distance = 20;
+  calibration.VerticalOffset = 15 + laser;
+  calibration.HorizontalOffset = (laser % 2) ? 2.6 : -2.6;
+  return calibration;
+}
+
+bool WriteCorrectionsFile(const std::string& filename)
+{
+  std::ofstream file(filename.c_str());
+  file << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\" ?>\n"
+       << "<boost_serialization>\n<DB>\n<points_>\n";
+  for (int laser = 0; laser < 32; ++laser)
+    {
+    const Calibration calibration = GetCalibration(laser);
+    file << "<item><px>"
+         << "<id_>" << laser << "</id_>"
+         << "<rotCorrection_>" << calibration.Azimuth << "</rotCorrection_>"
+         << "<vertCorrection_>" << calibration.Vertical << "</vertCorrection_>"
+         << "<distCorrection_>" << calibration.Distance << "</distCorrection_>"
+         << "<vertOffsetCorrection_>" << calibration.VerticalOffset << "</vertOffsetCorrection_>"
+         << "<horizOffsetCorrection_>" << calibration.HorizontalOffset << "</horizOffsetCorrection_>"
+         << "</px></item>\n";
+    }
+  file << "</points_>\n</DB>\n</boost_serialization>\n";
+  return file.good();
+}
+
+bool WritePacketFile(const std::string& filename)
+{
+  vtkPacketFileWriter writer;
+  if (!writer.Open(filename))
+    {
+    return false;
+    }
+
+  std::vector<unsigned char> packet;
+  for (int i = 0; i < SyntheticPackets::PACKETS_PER_REVOLUTION * NumberOfRevolutions; ++i)
+    {
+    SyntheticPackets::MakePacket(i, packet);
+    struct timeval time;
+    time.tv_sec = 1000 + i / 1000;
+    time.tv_usec = (i % 1000) * 1000;
+    writer.WritePacket(&packet[0], static_cast<unsigned int>(packet.size()), time);
+    }
+  writer.Close();
+  return true;
+}
+
+double ToRadians(double degrees)
+{
+  return degrees * 3.14159265358979323846 / 180.0;
+}
+
+// Where the calibration places a return of a laser at an azimuth, in
+// hundredths of a degree.
+void ExpectedPoint(int laser, int azimuth, double point[3])
+{
+  const Calibration calibration = GetCalibration(laser);
+  const double azimuthRadians = ToRadians(azimuth / 100.0 - calibration.Azimuth);
+  const double vertical = ToRadians(calibration.Vertical);
+  const double distance = SyntheticPackets::DISTANCE * 0.002 + calibration.Distance / 100.0;
+  const double verticalOffset = calibration.VerticalOffset / 100.0;
+  const double horizontalOffset = calibration.HorizontalOffset / 100.0;
+
+  const double xyDistance = distance * std::cos(vertical) - verticalOffset * std::sin(vertical);
+  point[0] = xyDistance * std::sin(azimuthRadians) - horizontalOffset * std::cos(azimuthRadians);
+  point[1] = xyDistance * std::cos(azimuthRadians) + horizontalOffset * std::sin(azimuthRadians);
+  point[2] = distance * std::sin(vertical) + verticalOffset * std::cos(vertical);
+}
+
+struct CheckResult
+{
+  int Frames;
+  vtkIdType Points;
+  vtkIdType BadPoints;
+};
+
+void CheckFrame(vtkPolyData* frame, CheckResult& result)
+{
+  ++result.Frames;
+  if (!frame || !frame->GetNumberOfPoints())
+    {
+    return;
+    }
+
+  vtkDataArray* laserId = frame->GetPointData()->GetArray("laser_id");
+  vtkDataArray* azimuth = frame->GetPointData()->GetArray("azimuth");
+  for (vtkIdType i = 0; i < frame->GetNumberOfPoints(); ++i)
+    {
+    double point[3];
+    double expected[3];
+    frame->GetPoint(i, point);
+    ExpectedPoint(static_cast<int>(laserId->GetTuple1(i)), static_cast<int>(azimuth->GetTuple1(i)), expected);
+    const double error = std::fabs(point[0] - expected[0]) + std::fabs(point[1] - expected[1]) +
+      std::fabs(point[2] - expected[2]);
+    if (error > 1e-3)
+      {
+      if (!result.BadPoints)
+        {
+        printf("laser %d at %d: %f %f %f, expected %f %f %f\n", static_cast<int>(laserId->GetTuple1(i)),
+          static_cast<int>(azimuth->GetTuple1(i)), point[0], point[1], point[2],
+          expected[0], expected[1], expected[2]);
+        }
+      ++result.BadPoints;
+      }
+    }
+  result.Points += frame->GetNumberOfPoints();
+}
+
+void CheckVisitedFrame(vtkPolyData* frame, const vtkVelodyneHDLReader::FrameInfo&, void* clientData)
+{
+  CheckFrame(frame, *static_cast<CheckResult*>(clientData));
+}
+
+}
+
+int main(int, char*[])
+{
+  char prefix[64];
+  snprintf(prefix, sizeof(prefix), "/tmp/testReaderCorrections-%d", static_cast<int>(getpid()));
+  const std::string packetFile = std::string(prefix) + ".pcap";
+  const std::string correctionsFile = std::string(prefix) + ".xml";
+  if (!WritePacketFile(packetFile) || !WriteCorrectionsFile(correctionsFile))
+    {
+    printf("failed to write the test files\n");
+    return 1;
+    }
+
+  vtkNew<vtkVelodyneHDLReader> reader;
+  reader->SetFileName(packetFile);
+  reader->SetCorrectionsFile(correctionsFile);
+  reader->ReadFrameInformation();
+  reader->SetNumberOfDecodeThreads(2);
+
+  CheckResult visited = {0, 0, 0};
+  vtkVelodyneHDLReader::FrameSelection selection;
+  const int nVisited = reader->ForEachFrame(selection, &CheckVisitedFrame, &visited);
+
+  // a reader created later must not change the calibration of this one
+  vtkNew<vtkVelodyneHDLReader> otherReader;
+
+  CheckResult read = {0, 0, 0};
+  reader->Open();
+  for (int i = 0; i < reader->GetNumberOfFrames(); ++i)
+    {
+    CheckFrame(reader->GetFrame(i), read);
+    }
+  reader->Close();
+
+  unlink(packetFile.c_str());
+  unlink(correctionsFile.c_str());
+
+  printf("ForEachFrame: %d frames, %lld points, %lld misplaced\n", nVisited,
+    static_cast<long long>(visited.Points), static_cast<long long>(visited.BadPoints));
+  printf("GetFrame: %d frames, %lld points, %lld misplaced\n", read.Frames,
+    static_cast<long long>(read.Points), static_cast<long long>(read.BadPoints));
+
+  const bool ok = (nVisited > 1 && nVisited == reader->GetNumberOfFrames() && visited.Points > 0 &&
+    visited.BadPoints == 0 && read.Points == visited.Points && read.BadPoints == 0);
+  return ok ? 0 : 1;
+}
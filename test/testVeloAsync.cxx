@@ -0,0 +1,87 @@
+#include <vtkVelodyneHDLSource.h>
+#include <vtkVelodyneHDLAsyncFrame.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkNew.h>
+
+#include <boost/asio.hpp>
+
+#include <iostream>
+
+// Prints the number of points of every frame received from the sensor,
+// driven by an asio event loop instead of a polling thread.  First checks
+// that a cancelled wait gets a NULL frame and releases the event loop.
+
+void OnCancelled(vtkSmartPointer<vtkPolyData> frame, double, int* nCancelled)
+{
+  if (!frame)
+    {
+    ++*nCancelled;
+    }
+}
+
+class FramePrinter
+{
+public:
+
+  FramePrinter(vtkVelodyneHDLSource* source, boost::asio::io_service& ioService)
+    : Source(source), IOService(ioService)
+  {
+  }
+
+  void Wait()
+  {
+    AsyncNextFrame(this->Source, this->IOService,
+      boost::bind(&FramePrinter::OnFrame, this, _1, _2));
+  }
+
+  void OnFrame(vtkSmartPointer<vtkPolyData> frame, double timestep)
+  {
+    if (!frame)
+      {
+      // the source was stopped
+      return;
+      }
+
+    std::cout << timestep << " " << frame->GetNumberOfPoints() << std::endl;
+    this->Wait();
+  }
+
+private:
+
+  vtkVelodyneHDLSource* Source;
+  boost::asio::io_service& IOService;
+};
+
+int main(int argc, char* argv[])
+{
+  vtkNew<vtkVelodyneHDLSource> source;
+  if (argc > 1)
+    {
+    source->SetPacketFile(argv[1]);
+    }
+
+    {
+    // the source is not started, run() only returns once the wait is gone
+    int nCancelled = 0;
+    boost::asio::io_service cancelService;
+    vtkVelodyneHDLAsyncFrameWait wait = AsyncNextFrame(source.GetPointer(), cancelService,
+      boost::bind(&OnCancelled, _1, _2, &nCancelled));
+    const bool cancelled = wait.Cancel();
+    const bool cancelledTwice = wait.Cancel();
+    cancelService.run();
+    if (!cancelled || cancelledTwice || nCancelled != 1)
+      {
+      std::cerr << "cancelling the wait failed" << std::endl;
+      return 1;
+      }
+    }
+
+  boost::asio::io_service ioService;
+  FramePrinter printer(source.GetPointer(), ioService);
+  printer.Wait();
+
+  source->Start();
+  ioService.run();
+  return 0;
+}
@@ -0,0 +1,129 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Sends synthetic sensor packets that start and stop in the middle of a
+// revolution.  The torn first frame must be dropped for its coverage, the
+// full revolutions published complete, and the last half revolution
+// published incomplete once the frame timeout expires.  Publishing on
+// coverage, the full revolutions must be published as soon as they reach
+// the minimum coverage instead.
+
+#include <vtkVelodyneHDLSource.h>
+#include <vtkPolyData.h>
+#include <vtkFieldData.h>
+#include <vtkDataArray.h>
+#include <vtkNew.h>
+
+#include <boost/asio.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "SyntheticPackets.h"
+
+namespace
+{
+
+using SyntheticPackets::MakePacket;
+
+const unsigned short Port = 22370;
+
+struct FrameLog
+{
+  vtkVelodyneHDLSource* Source;
+  boost::mutex Mutex;
+  std::vector<double> Coverage;
+  std::vector<int> Complete;
+};
+
+double GetFieldValue(vtkPolyData* frame, const char* name)
+{
+  vtkDataArray* array = frame->GetFieldData()->GetArray(name);
+  return (array && array->GetNumberOfTuples()) ? array->GetComponent(0, 0) : -1;
+}
+
+void LogFrame(vtkPolyData* frame, double, void* clientData)
+{
+  FrameLog* log = static_cast<FrameLog*>(clientData);
+  if (frame)
+    {
+    boost::lock_guard<boost::mutex> lock(log->Mutex);
+    log->Coverage.push_back(GetFieldValue(frame, "azimuth_coverage"));
+    log->Complete.push_back(static_cast<int>(GetFieldValue(frame, "frame_complete")));
+    log->Source->NotifyNextFrame(&LogFrame, log);
+    }
+}
+
+bool Run(int publishMode, const char* name, double fullCoverage, int fullComplete)
+{
+  vtkNew<vtkVelodyneHDLSource> source;
+  source->SetSensorPort(Port);
+  source->SetPositionPort(0);
+  source->SetFramePublishMode(publishMode);
+  source->SetMinimumFrameCoverage(0.9);
+  source->SetFrameTimeout(0.2);
+  source->Start();
+
+  FrameLog log;
+  log.Source = source.GetPointer();
+  source->NotifyNextFrame(&LogFrame, &log);
+
+  boost::asio::io_service ioService;
+  boost::asio::ip::udp::socket socket(ioService);
+  socket.open(boost::asio::ip::udp::v4());
+  boost::asio::ip::udp::endpoint destination(boost::asio::ip::address_v4::loopback(), Port);
+
+  // half a revolution, two full ones and another half
+  std::vector<unsigned char> packet;
+  for (int i = 75; i < 525; ++i)
+    {
+    MakePacket(i, packet);
+    socket.send_to(boost::asio::buffer(packet), destination);
+    if (i % 50 == 0)
+      {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+      }
+    }
+  boost::this_thread::sleep(boost::posix_time::milliseconds(1000));
+
+  const vtkIdType dropped = source->GetNumberOfDroppedFrames();
+  source->Stop();
+
+  boost::lock_guard<boost::mutex> lock(log.Mutex);
+  for (size_t i = 0; i < log.Coverage.size(); ++i)
+    {
+    printf("%s frame %d: coverage %.3f, complete %d\n", name, static_cast<int>(i), log.Coverage[i],
+      log.Complete[i]);
+    }
+  printf("%s dropped frames %lld\n", name, static_cast<long long>(dropped));
+
+  return (dropped == 1 && log.Coverage.size() == 3 &&
+    std::fabs(log.Coverage[0] - fullCoverage) < 0.01 && log.Complete[0] == fullComplete &&
+    std::fabs(log.Coverage[1] - fullCoverage) < 0.01 && log.Complete[1] == fullComplete &&
+    log.Complete[2] == 0 && log.Coverage[2] > 0.4 && log.Coverage[2] < 0.6);
+}
+
+}
+
+int main(int, char*[])
+{
+  bool ok = Run(vtkVelodyneHDLSource::PUBLISH_ON_WRAP, "wrap", 1.0, 1);
+  ok = Run(vtkVelodyneHDLSource::PUBLISH_ON_COVERAGE, "coverage", 0.9, 0) && ok;
+  return ok ? 0 : 1;
+}
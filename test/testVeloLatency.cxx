@@ -0,0 +1,111 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Sends synthetic sensor packets over loopback at the rate of a sensor and
+// prints the receive to decoded latency of every receive mode of
+// vtkVelodyneHDLSource.  Fails if a mode measures too few packets or
+// latencies out of order or out of bounds.
+
+#include <vtkVelodyneHDLSource.h>
+#include <vtkNew.h>
+
+#include <boost/asio.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "SyntheticPackets.h"
+
+namespace
+{
+
+using SyntheticPackets::MakePacket;
+
+const unsigned short Port = 22369;
+
+// Loopback may drop a few datagrams under load, not half of them.
+const double MinimumReceivedFraction = 0.5;
+
+// Decoding a packet takes microseconds; half of them waiting this long
+// means the packets are not decoded as they arrive.
+const double MaximumMedianLatency = 10000;
+
+// Even a preempted thread is rescheduled well within this.
+const double MaximumLatency = 1000000;
+
+bool Measure(int mode, const char* name, int nRevolutions)
+{
+  vtkNew<vtkVelodyneHDLSource> source;
+  source->SetSensorPort(Port);
+  source->SetPositionPort(0);
+  source->SetReceiveMode(mode);
+  source->Start();
+
+  boost::asio::io_service ioService;
+  boost::asio::ip::udp::socket socket(ioService);
+  socket.open(boost::asio::ip::udp::v4());
+  boost::asio::ip::udp::endpoint destination(boost::asio::ip::address::from_string("127.0.0.1"), Port);
+
+  // a sensor sends a packet every 553 us
+  std::vector<unsigned char> packet;
+  const int nPackets = SyntheticPackets::PACKETS_PER_REVOLUTION * nRevolutions;
+  for (int i = 0; i < nPackets; ++i)
+    {
+    MakePacket(i, packet);
+    socket.send_to(boost::asio::buffer(packet), destination);
+    boost::this_thread::sleep(boost::posix_time::microseconds(static_cast<int>(SyntheticPackets::PACKET_INTERVAL)));
+    }
+  boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+  source->Stop();
+
+  const vtkIdType nSamples = source->GetNumberOfLatencySamples();
+  const double mean = source->GetMeanReceiveLatency();
+  const double p50 = source->GetReceiveLatencyPercentile(50);
+  const double p99 = source->GetReceiveLatencyPercentile(99);
+  const double max = source->GetMaxReceiveLatency();
+  printf("%-10s packets %7lld  mean %7.1f us  p50 %5.0f us  p99 %5.0f us  max %7.0f us\n", name,
+    static_cast<long long>(nSamples), mean, p50, p99, max);
+
+  bool ok = true;
+  if (nSamples < MinimumReceivedFraction * nPackets || nSamples > nPackets)
+    {
+    printf("%s: %lld latency samples for %d packets sent\n", name, static_cast<long long>(nSamples), nPackets);
+    ok = false;
+    }
+  if (!(0 <= p50 && p50 <= p99 && p99 <= max && 0 <= mean && mean <= max))
+    {
+    printf("%s: latencies out of order\n", name);
+    ok = false;
+    }
+  if (p50 > MaximumMedianLatency || max > MaximumLatency)
+    {
+    printf("%s: latencies above %.0f us median or %.0f us max\n", name, MaximumMedianLatency, MaximumLatency);
+    ok = false;
+    }
+  return ok;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  const int nRevolutions = argc > 1 ? atoi(argv[1]) : 20;
+  bool ok = Measure(vtkVelodyneHDLSource::RECEIVE_QUEUED, "queued", nRevolutions);
+  ok = Measure(vtkVelodyneHDLSource::RECEIVE_INLINE, "inline", nRevolutions) && ok;
+  ok = Measure(vtkVelodyneHDLSource::RECEIVE_BUSY_POLL, "busy poll", nRevolutions) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Multicasts synthetic sensor packets over the loopback interface to a
+// vtkVelodyneHDLSource that joined the group, and checks that it decodes
+// them into frames.  Packets sent to another group on the same port must
+// not reach it.
+
+#include <vtkVelodyneHDLSource.h>
+#include <vtkPolyData.h>
+#include <vtkNew.h>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "SyntheticPackets.h"
+
+namespace
+{
+
+using SyntheticPackets::MakePacket;
+
+const char* Interface = "127.0.0.1";
+const char* Group = "239.255.76.67";
+const char* OtherGroup = "239.255.76.68";
+const unsigned short Port = 22368;
+
+void SendRevolutions(boost::asio::ip::udp::socket& socket, const char* group, int nRevolutions)
+{
+  boost::asio::ip::udp::endpoint destination(boost::asio::ip::address::from_string(group), Port);
+  std::vector<unsigned char> packet;
+  for (int i = 0; i < 150 * nRevolutions; ++i)
+    {
+    MakePacket(i, packet);
+    socket.send_to(boost::asio::buffer(packet), destination);
+    if (i % 50 == 0)
+      {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+      }
+    }
+  boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+}
+
+struct FrameCounter
+{
+  vtkVelodyneHDLSource* Source;
+  boost::atomic<int> Frames;
+};
+
+void CountFrame(vtkPolyData* frame, double, void* clientData)
+{
+  FrameCounter* counter = static_cast<FrameCounter*>(clientData);
+  if (frame)
+    {
+    ++counter->Frames;
+    counter->Source->NotifyNextFrame(&CountFrame, counter);
+    }
+}
+
+}
+
+int main(int, char*[])
+{
+  vtkNew<vtkVelodyneHDLSource> source;
+  source->SetSensorPort(Port);
+  source->SetPositionPort(0);
+  source->SetMulticastGroup(Group);
+  source->SetMulticastInterface(Interface);
+  source->Start();
+
+  FrameCounter counter;
+  counter.Source = source.GetPointer();
+  counter.Frames = 0;
+  source->NotifyNextFrame(&CountFrame, &counter);
+
+  boost::asio::io_service ioService;
+  boost::asio::ip::udp::socket socket(ioService);
+  socket.open(boost::asio::ip::udp::v4());
+  socket.set_option(boost::asio::ip::multicast::outbound_interface(
+    boost::asio::ip::address_v4::from_string(Interface)));
+  socket.set_option(boost::asio::ip::multicast::enable_loopback(true));
+
+  SendRevolutions(socket, OtherGroup, 2);
+  const vtkIdType leaked = source->GetNumberOfAcceptedPackets();
+
+  SendRevolutions(socket, Group, 4);
+  const vtkIdType accepted = source->GetNumberOfAcceptedPackets() - leaked;
+  source->Stop();
+
+  const int frames = counter.Frames.load();
+  printf("frames %d, packets %lld, packets of the other group %lld\n",
+    frames, static_cast<long long>(accepted), static_cast<long long>(leaked));
+  return (frames >= 3 && accepted > 0 && leaked == 0) ? 0 : 1;
+}
@@ -0,0 +1,653 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkArrowFrameWriter.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkArrowFrameWriter -
+// .SECTION Description
+// Writes decoded frames as Apache Arrow record batches, using either the
+// IPC stream format or the IPC file format.  Every frame becomes one record
+// batch with the columns xyz (fixed size list of 3 float), intensity,
+// laser_id, azimuth, distance_m and timestamp.  The batch body is written
+// straight from the point arrays of the frame, so no column is copied or
+// converted.  The flatbuffer metadata is generated here, there is no
+// dependency on the Arrow libraries.
+
+#ifndef __vtkArrowFrameWriter_h
+#define __vtkArrowFrameWriter_h
+
+#include <vtkPolyData.h>
+#include <vtkPoints.h>
+#include <vtkPointData.h>
+#include <vtkFloatArray.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkUnsignedShortArray.h>
+#include <vtkUnsignedIntArray.h>
+#include <vtkDoubleArray.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef _MSC_VER
+typedef __int16 int16_t;
+typedef __int32 int32_t;
+typedef unsigned __int32 uint32_t;
+typedef __int64 int64_t;
+typedef unsigned __int64 uint64_t;
+#else
+# include <stdint.h>
+#endif
+
+class vtkArrowFrameWriter
+{
+public:
+
+  enum FormatType
+  {
+    STREAM_FORMAT = 0,
+    FILE_FORMAT = 1
+  };
+
+  vtkArrowFrameWriter()
+  {
+    this->File = 0;
+    this->Format = STREAM_FORMAT;
+    this->Position = 0;
+  }
+
+  ~vtkArrowFrameWriter()
+  {
+    this->Close();
+  }
+
+  // Description:
+  // Open a file and write the schema.  A filename of "-" writes the stream
+  // format to stdout so that frames can be piped into another process.
+  bool Open(const std::string& filename, int format = STREAM_FORMAT)
+  {
+    this->Close();
+
+    FILE* file = (filename == "-") ? stdout : fopen(filename.c_str(), "wb");
+    if (!file)
+      {
+      this->LastError = "Failed to open file for writing: " + filename;
+      return false;
+      }
+
+    this->File = file;
+    this->FileName = filename;
+    this->Format = (filename == "-") ? STREAM_FORMAT : format;
+    this->Position = 0;
+    this->RecordBatchBlocks.clear();
+
+    if (this->Format == FILE_FORMAT)
+      {
+      this->WriteBytes("ARROW1\0\0", 8);
+      }
+
+    FlatBuffer schema;
+    this->BuildSchemaMessage(schema);
+    this->WriteMessage(schema);
+    return true;
+  }
+
+  // Description:
+  // Filenames ending in .arrows, and "-" for stdout, use the stream format.
+  static int GetFormatForFileName(const std::string& filename)
+  {
+    const std::string streamExtension = ".arrows";
+    if (filename == "-" || (filename.length() >= streamExtension.length() &&
+        filename.compare(filename.length() - streamExtension.length(), streamExtension.length(), streamExtension) == 0))
+      {
+      return STREAM_FORMAT;
+      }
+    return FILE_FORMAT;
+  }
+
+  bool IsOpen()
+  {
+    return (this->File != 0);
+  }
+
+  void Close()
+  {
+    if (!this->File)
+      {
+      return;
+      }
+
+    // end-of-stream marker
+    const uint32_t endOfStream[2] = {0xffffffff, 0};
+    this->WriteBytes(endOfStream, sizeof(endOfStream));
+
+    if (this->Format == FILE_FORMAT)
+      {
+      FlatBuffer footer;
+      this->BuildFooter(footer);
+      this->WriteBytes(&footer.Data[0], footer.Data.size());
+      int32_t footerSize = static_cast<int32_t>(footer.Data.size());
+      this->WriteBytes(&footerSize, sizeof(footerSize));
+      this->WriteBytes("ARROW1", 6);
+      }
+
+    if (this->File != stdout)
+      {
+      fclose(this->File);
+      }
+    else
+      {
+      fflush(this->File);
+      }
+    this->File = 0;
+    this->FileName.clear();
+  }
+
+  const std::string& GetLastError()
+  {
+    return this->LastError;
+  }
+
+  const std::string& GetFileName()
+  {
+    return this->FileName;
+  }
+
+  // Description:
+  // Write one frame produced by vtkVelodyneHDLReader as a record batch.
+  bool WriteFrame(vtkPolyData* polyData)
+  {
+    if (!this->File || !polyData || !polyData->GetPoints())
+      {
+      return false;
+      }
+
+    vtkPointData* pointData = polyData->GetPointData();
+    vtkFloatArray* points = vtkFloatArray::SafeDownCast(polyData->GetPoints()->GetData());
+    vtkUnsignedCharArray* intensity = vtkUnsignedCharArray::SafeDownCast(pointData->GetArray("intensity"));
+    vtkUnsignedCharArray* laserId = vtkUnsignedCharArray::SafeDownCast(pointData->GetArray("laser_id"));
+    vtkUnsignedShortArray* azimuth = vtkUnsignedShortArray::SafeDownCast(pointData->GetArray("azimuth"));
+    vtkDoubleArray* distance = vtkDoubleArray::SafeDownCast(pointData->GetArray("distance_m"));
+    vtkUnsignedIntArray* timestamp = vtkUnsignedIntArray::SafeDownCast(pointData->GetArray("timestamp"));
+
+    if (!points || !intensity || !laserId || !azimuth || !distance || !timestamp)
+      {
+      this->LastError = "Frame does not have the point arrays of a Velodyne HDL frame.";
+      return false;
+      }
+
+    const vtkIdType numberOfPoints = polyData->GetNumberOfPoints();
+    return this->WriteRecordBatch(numberOfPoints,
+      numberOfPoints ? points->GetPointer(0) : 0,
+      numberOfPoints ? intensity->GetPointer(0) : 0,
+      numberOfPoints ? laserId->GetPointer(0) : 0,
+      numberOfPoints ? azimuth->GetPointer(0) : 0,
+      numberOfPoints ? distance->GetPointer(0) : 0,
+      numberOfPoints ? timestamp->GetPointer(0) : 0);
+  }
+
+  // Description:
+  // Write a record batch from the column buffers.  xyz holds 3 floats per
+  // point, the other columns hold one value per point.
+  bool WriteRecordBatch(int64_t numberOfPoints, const float* xyz,
+    const unsigned char* intensity, const unsigned char* laserId,
+    const unsigned short* azimuth, const double* distance,
+    const unsigned int* timestamp)
+  {
+    if (!this->File)
+      {
+      return false;
+      }
+
+    const void* columns[NumberOfBodyBuffers] = {
+      0, 0, xyz, 0, intensity, 0, laserId, 0, azimuth, 0, distance, 0, timestamp};
+    const int64_t sizes[NumberOfBodyBuffers] = {
+      0, 0, numberOfPoints * static_cast<int64_t>(3 * sizeof(float)),
+      0, numberOfPoints * static_cast<int64_t>(sizeof(unsigned char)),
+      0, numberOfPoints * static_cast<int64_t>(sizeof(unsigned char)),
+      0, numberOfPoints * static_cast<int64_t>(sizeof(unsigned short)),
+      0, numberOfPoints * static_cast<int64_t>(sizeof(double)),
+      0, numberOfPoints * static_cast<int64_t>(sizeof(unsigned int))};
+
+    int64_t offsets[NumberOfBodyBuffers];
+    int64_t bodyLength = 0;
+    for (int i = 0; i < NumberOfBodyBuffers; ++i)
+      {
+      offsets[i] = bodyLength;
+      bodyLength += PaddedLength(sizes[i]);
+      }
+
+    FlatBuffer message;
+    this->BuildRecordBatchMessage(message, numberOfPoints, offsets, sizes, bodyLength);
+
+    Block block;
+    block.Offset = this->Position;
+    block.MetaDataLength = static_cast<int32_t>(8 + message.Data.size());
+    block.BodyLength = bodyLength;
+
+    this->WriteMessage(message);
+    for (int i = 0; i < NumberOfBodyBuffers; ++i)
+      {
+      this->WriteBytes(columns[i], static_cast<size_t>(sizes[i]));
+      this->WritePadding(sizes[i]);
+      }
+
+    this->RecordBatchBlocks.push_back(block);
+    return !ferror(this->File);
+  }
+
+protected:
+
+  enum
+  {
+    NumberOfBodyBuffers = 13,
+    NumberOfFieldNodes = 7
+  };
+
+  // Values from the Arrow flatbuffer schema (Schema.fbs, Message.fbs)
+  enum
+  {
+    MetadataVersionV5 = 4,
+    MessageHeaderSchema = 1,
+    MessageHeaderRecordBatch = 3,
+    TypeInt = 2,
+    TypeFloatingPoint = 3,
+    TypeFixedSizeList = 16,
+    PrecisionSingle = 1,
+    PrecisionDouble = 2
+  };
+
+  struct Block
+  {
+    int64_t Offset;
+    int32_t MetaDataLength;
+    int64_t BodyLength;
+  };
+
+  struct FieldSpec
+  {
+    const char* Name;
+    unsigned char Type;
+    int Parameter;   // bit width, precision or list size
+    const FieldSpec* Child;
+  };
+
+  // Description:
+  // Minimal flatbuffer builder.  Tables are written parent first, each
+  // offset is a placeholder that is linked once its target is written.
+  class FlatBuffer
+  {
+  public:
+
+    FlatBuffer()
+    {
+      // root offset
+      this->Put<uint32_t>(0);
+    }
+
+    void Align(size_t alignment)
+    {
+      while (this->Data.size() % alignment)
+        {
+        this->Data.push_back(0);
+        }
+    }
+
+    template <typename T>
+    size_t Put(T value)
+    {
+      size_t position = this->Data.size();
+      this->Data.resize(position + sizeof(T));
+      memcpy(&this->Data[position], &value, sizeof(T));
+      return position;
+    }
+
+    template <typename T>
+    void PutAt(size_t position, T value)
+    {
+      memcpy(&this->Data[position], &value, sizeof(T));
+    }
+
+    void Link(size_t slot, size_t target)
+    {
+      this->PutAt<uint32_t>(slot, static_cast<uint32_t>(target - slot));
+    }
+
+    size_t String(const char* value)
+    {
+      const uint32_t length = static_cast<uint32_t>(strlen(value));
+      this->Align(4);
+      size_t position = this->Put<uint32_t>(length);
+      this->Data.insert(this->Data.end(), value, value + length + 1);
+      return position;
+    }
+
+    // Description:
+    // Write a vector of offsets and return its position, the element slots
+    // follow the length field.
+    size_t OffsetVector(uint32_t count)
+    {
+      this->Align(4);
+      size_t position = this->Put<uint32_t>(count);
+      for (uint32_t i = 0; i < count; ++i)
+        {
+        this->Put<uint32_t>(0);
+        }
+      return position;
+    }
+
+    // Description:
+    // Start a vector of 8 byte aligned structs.
+    size_t StructVector(uint32_t count)
+    {
+      this->Align(4);
+      if (this->Data.size() % 8 == 0)
+        {
+        this->Put<uint32_t>(0);
+        }
+      return this->Put<uint32_t>(count);
+    }
+
+    void Finish()
+    {
+      this->Align(8);
+    }
+
+    std::vector<unsigned char> Data;
+  };
+
+  class Table
+  {
+  public:
+
+    void AddScalar(int slot, int size, int64_t value)
+    {
+      Field field = {slot, size, value, false};
+      this->Fields.push_back(field);
+    }
+
+    void AddOffset(int slot)
+    {
+      Field field = {slot, 4, 0, true};
+      this->Fields.push_back(field);
+    }
+
+    // Description:
+    // Write the vtable and the table.  Returns the table position; the
+    // positions of the offset placeholders are stored in OffsetSlots in the
+    // order they were added.
+    size_t Finish(FlatBuffer& buffer)
+    {
+      std::vector<uint16_t> fieldOffsets;
+      uint16_t tableSize = 4;
+      for (size_t i = 0; i < this->Fields.size(); ++i)
+        {
+        const Field& field = this->Fields[i];
+        while (tableSize % field.Size)
+          {
+          ++tableSize;
+          }
+        if (field.Slot >= static_cast<int>(fieldOffsets.size()))
+          {
+          fieldOffsets.resize(field.Slot + 1, 0);
+          }
+        fieldOffsets[field.Slot] = tableSize;
+        tableSize += field.Size;
+        }
+      while (tableSize % 4)
+        {
+        ++tableSize;
+        }
+
+      buffer.Align(2);
+      const size_t vtable = buffer.Put<uint16_t>(static_cast<uint16_t>(4 + 2 * fieldOffsets.size()));
+      buffer.Put<uint16_t>(tableSize);
+      for (size_t i = 0; i < fieldOffsets.size(); ++i)
+        {
+        buffer.Put<uint16_t>(fieldOffsets[i]);
+        }
+
+      buffer.Align(8);
+      const size_t table = buffer.Data.size();
+      buffer.Put<int32_t>(static_cast<int32_t>(table - vtable));
+      buffer.Data.resize(table + tableSize, 0);
+
+      this->OffsetSlots.clear();
+      for (size_t i = 0; i < this->Fields.size(); ++i)
+        {
+        const Field& field = this->Fields[i];
+        const size_t position = table + fieldOffsets[field.Slot];
+        if (field.IsOffset)
+          {
+          this->OffsetSlots.push_back(position);
+          }
+        else
+          {
+          memcpy(&buffer.Data[position], &field.Value, field.Size);
+          }
+        }
+      return table;
+    }
+
+    std::vector<size_t> OffsetSlots;
+
+  private:
+
+    struct Field
+    {
+      int Slot;
+      int Size;
+      int64_t Value;
+      bool IsOffset;
+    };
+
+    std::vector<Field> Fields;
+  };
+
+  static int64_t PaddedLength(int64_t length)
+  {
+    return (length + 7) & ~static_cast<int64_t>(7);
+  }
+
+  static const FieldSpec* GetFieldSpecs()
+  {
+    static const FieldSpec xyzItem = {"item", TypeFloatingPoint, PrecisionSingle, 0};
+    static const FieldSpec fields[] = {
+      {"xyz", TypeFixedSizeList, 3, &xyzItem},
+      {"intensity", TypeInt, 8, 0},
+      {"laser_id", TypeInt, 8, 0},
+      {"azimuth", TypeInt, 16, 0},
+      {"distance_m", TypeFloatingPoint, PrecisionDouble, 0},
+      {"timestamp", TypeInt, 32, 0},
+      {0, 0, 0, 0}};
+    return fields;
+  }
+
+  static size_t BuildField(FlatBuffer& buffer, const FieldSpec& spec)
+  {
+    Table field;
+    field.AddOffset(0);                 // name
+    field.AddScalar(1, 1, 0);           // nullable
+    field.AddScalar(2, 1, spec.Type);   // type_type
+    field.AddOffset(3);                 // type
+    field.AddOffset(5);                 // children
+    const size_t position = field.Finish(buffer);
+    const std::vector<size_t> slots = field.OffsetSlots;
+
+    buffer.Link(slots[0], buffer.String(spec.Name));
+
+    Table type;
+    switch (spec.Type)
+      {
+      case TypeInt:
+        type.AddScalar(0, 4, spec.Parameter);   // bitWidth
+        type.AddScalar(1, 1, 0);                // is_signed
+        break;
+      case TypeFloatingPoint:
+        type.AddScalar(0, 2, spec.Parameter);   // precision
+        break;
+      case TypeFixedSizeList:
+        type.AddScalar(0, 4, spec.Parameter);   // listSize
+        break;
+      }
+    buffer.Link(slots[1], type.Finish(buffer));
+
+    const size_t children = buffer.OffsetVector(spec.Child ? 1 : 0);
+    buffer.Link(slots[2], children);
+    if (spec.Child)
+      {
+      buffer.Link(children + 4, BuildField(buffer, *spec.Child));
+      }
+    return position;
+  }
+
+  static size_t BuildSchema(FlatBuffer& buffer)
+  {
+    Table schema;
+    schema.AddScalar(0, 2, 0);   // endianness: little
+    schema.AddOffset(1);         // fields
+    const size_t position = schema.Finish(buffer);
+    const size_t fieldsSlot = schema.OffsetSlots[0];
+
+    const FieldSpec* specs = GetFieldSpecs();
+    uint32_t numberOfFields = 0;
+    while (specs[numberOfFields].Name)
+      {
+      ++numberOfFields;
+      }
+
+    const size_t fields = buffer.OffsetVector(numberOfFields);
+    buffer.Link(fieldsSlot, fields);
+    for (uint32_t i = 0; i < numberOfFields; ++i)
+      {
+      buffer.Link(fields + 4 * (i + 1), BuildField(buffer, specs[i]));
+      }
+    return position;
+  }
+
+  static size_t BuildMessage(FlatBuffer& buffer, int headerType, int64_t bodyLength)
+  {
+    Table message;
+    message.AddScalar(0, 2, MetadataVersionV5);   // version
+    message.AddScalar(1, 1, headerType);          // header_type
+    message.AddOffset(2);                         // header
+    message.AddScalar(3, 8, bodyLength);          // bodyLength
+    const size_t position = message.Finish(buffer);
+    buffer.Link(0, position);
+    return message.OffsetSlots[0];
+  }
+
+  void BuildSchemaMessage(FlatBuffer& buffer)
+  {
+    const size_t headerSlot = BuildMessage(buffer, MessageHeaderSchema, 0);
+    buffer.Link(headerSlot, BuildSchema(buffer));
+    buffer.Finish();
+  }
+
+  void BuildRecordBatchMessage(FlatBuffer& buffer, int64_t numberOfPoints,
+    const int64_t* offsets, const int64_t* sizes, int64_t bodyLength)
+  {
+    const size_t headerSlot = BuildMessage(buffer, MessageHeaderRecordBatch, bodyLength);
+
+    Table recordBatch;
+    recordBatch.AddScalar(0, 8, numberOfPoints);   // length
+    recordBatch.AddOffset(1);                      // nodes
+    recordBatch.AddOffset(2);                      // buffers
+    buffer.Link(headerSlot, recordBatch.Finish(buffer));
+    const std::vector<size_t> slots = recordBatch.OffsetSlots;
+
+    // field nodes in depth first order: xyz, xyz.item, then the scalars
+    buffer.Link(slots[0], buffer.StructVector(NumberOfFieldNodes));
+    for (int i = 0; i < NumberOfFieldNodes; ++i)
+      {
+      buffer.Put<int64_t>(i == 1 ? 3 * numberOfPoints : numberOfPoints);
+      buffer.Put<int64_t>(0);
+      }
+
+    buffer.Link(slots[1], buffer.StructVector(NumberOfBodyBuffers));
+    for (int i = 0; i < NumberOfBodyBuffers; ++i)
+      {
+      buffer.Put<int64_t>(offsets[i]);
+      buffer.Put<int64_t>(sizes[i]);
+      }
+    buffer.Finish();
+  }
+
+  void BuildFooter(FlatBuffer& buffer)
+  {
+    Table footer;
+    footer.AddScalar(0, 2, MetadataVersionV5);   // version
+    footer.AddOffset(1);                         // schema
+    footer.AddOffset(3);                         // recordBatches
+    buffer.Link(0, footer.Finish(buffer));
+    const std::vector<size_t> slots = footer.OffsetSlots;
+
+    buffer.Link(slots[0], BuildSchema(buffer));
+
+    const uint32_t numberOfBlocks = static_cast<uint32_t>(this->RecordBatchBlocks.size());
+    buffer.Link(slots[1], buffer.StructVector(numberOfBlocks));
+    for (uint32_t i = 0; i < numberOfBlocks; ++i)
+      {
+      const Block& block = this->RecordBatchBlocks[i];
+      buffer.Put<int64_t>(block.Offset);
+      buffer.Put<int32_t>(block.MetaDataLength);
+      buffer.Put<int32_t>(0);
+      buffer.Put<int64_t>(block.BodyLength);
+      }
+    buffer.Finish();
+  }
+
+  void WriteMessage(const FlatBuffer& buffer)
+  {
+    const uint32_t prefix[2] = {0xffffffff, static_cast<uint32_t>(buffer.Data.size())};
+    this->WriteBytes(prefix, sizeof(prefix));
+    this->WriteBytes(&buffer.Data[0], buffer.Data.size());
+  }
+
+  void WriteBytes(const void* data, size_t length)
+  {
+    if (length)
+      {
+      fwrite(data, 1, length, this->File);
+      this->Position += length;
+      }
+  }
+
+  void WritePadding(int64_t length)
+  {
+    static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    this->WriteBytes(zeros, static_cast<size_t>(PaddedLength(length) - length));
+  }
+
+  FILE* File;
+  int Format;
+  int64_t Position;
+  std::vector<Block> RecordBatchBlocks;
+
+  std::string FileName;
+  std::string LastError;
+};
+
+#endif
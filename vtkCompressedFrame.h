@@ -0,0 +1,346 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkCompressedFrame.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkCompressedFrame -
+// .SECTION Description
+// Compact copy of a decoded frame, used by the live cache of
+// vtkVelodyneHDLSource for frames it keeps but is unlikely to hand out
+// again soon.  The points, the point data and the field data arrays are
+// each zlib compressed; the vertex cells are not stored since every frame
+// has exactly one vertex per point.  Decompress() rebuilds an equivalent
+// vtkPolyData.
+//
+// With a quantization step, the floating point arrays (the points and
+// distance_m) are stored lossy: every value is rounded to a multiple of the
+// step, delta coded against the previous tuple and the bytes of the deltas
+// are grouped by significance before entropy coding, which shrinks a frame
+// several times more than plain zlib.
+
+#ifndef __vtkCompressedFrame_h
+#define __vtkCompressedFrame_h
+
+#include <vtkPolyData.h>
+#include <vtkPoints.h>
+#include <vtkPointData.h>
+#include <vtkFieldData.h>
+#include <vtkDataArray.h>
+#include <vtkCellArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkSmartPointer.h>
+#include <vtkZLibDataCompressor.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+#ifdef _MSC_VER
+typedef __int32 int32_t;
+typedef unsigned __int32 uint32_t;
+#else
+# include <stdint.h>
+#endif
+
+class vtkCompressedFrame
+{
+public:
+
+  vtkCompressedFrame()
+  {
+    this->NumberOfPoints = 0;
+  }
+
+  // Description:
+  // Replaces the content with a compressed copy of the frame.  A positive
+  // quantizationStep, in meters, selects the lossy encoding of the floating
+  // point arrays.
+  void Compress(vtkPolyData* frame, double quantizationStep = 0)
+  {
+    this->Points = CompressedArray();
+    this->PointArrays.clear();
+    this->FieldArrays.clear();
+    this->NumberOfPoints = frame->GetNumberOfPoints();
+
+    vtkSmartPointer<vtkZLibDataCompressor> compressor = vtkSmartPointer<vtkZLibDataCompressor>::New();
+
+    if (frame->GetPoints())
+      {
+      this->Points.Compress(frame->GetPoints()->GetData(), compressor, quantizationStep);
+      }
+
+    vtkPointData* pointData = frame->GetPointData();
+    for (int i = 0; i < pointData->GetNumberOfArrays(); ++i)
+      {
+      if (vtkDataArray* array = pointData->GetArray(i))
+        {
+        this->PointArrays.push_back(CompressedArray());
+        this->PointArrays.back().Compress(array, compressor, quantizationStep);
+        }
+      }
+
+    vtkFieldData* fieldData = frame->GetFieldData();
+    for (int i = 0; i < fieldData->GetNumberOfArrays(); ++i)
+      {
+      if (vtkDataArray* array = fieldData->GetArray(i))
+        {
+        this->FieldArrays.push_back(CompressedArray());
+        this->FieldArrays.back().Compress(array, compressor, 0);
+        }
+      }
+  }
+
+  vtkSmartPointer<vtkPolyData> Decompress() const
+  {
+    vtkSmartPointer<vtkZLibDataCompressor> compressor = vtkSmartPointer<vtkZLibDataCompressor>::New();
+    vtkSmartPointer<vtkPolyData> frame = vtkSmartPointer<vtkPolyData>::New();
+
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    vtkSmartPointer<vtkDataArray> pointArray = this->Points.Decompress(compressor);
+    if (pointArray)
+      {
+      points->SetData(pointArray);
+      }
+    frame->SetPoints(points);
+
+    for (size_t i = 0; i < this->PointArrays.size(); ++i)
+      {
+      vtkSmartPointer<vtkDataArray> array = this->PointArrays[i].Decompress(compressor);
+      if (array)
+        {
+        frame->GetPointData()->AddArray(array);
+        }
+      }
+
+    for (size_t i = 0; i < this->FieldArrays.size(); ++i)
+      {
+      vtkSmartPointer<vtkDataArray> array = this->FieldArrays[i].Decompress(compressor);
+      if (array)
+        {
+        frame->GetFieldData()->AddArray(array);
+        }
+      }
+
+    vtkSmartPointer<vtkIdTypeArray> cells = vtkSmartPointer<vtkIdTypeArray>::New();
+    cells->SetNumberOfValues(this->NumberOfPoints * 2);
+    vtkIdType* ids = cells->GetPointer(0);
+    for (vtkIdType i = 0; i < this->NumberOfPoints; ++i)
+      {
+      ids[i*2] = 1;
+      ids[i*2+1] = i;
+      }
+    vtkSmartPointer<vtkCellArray> verts = vtkSmartPointer<vtkCellArray>::New();
+    verts->SetCells(this->NumberOfPoints, cells);
+    frame->SetVerts(verts);
+
+    return frame;
+  }
+
+  // Description:
+  // Bytes held by the compressed arrays.
+  size_t GetMemorySize() const
+  {
+    size_t size = this->Points.Data.size();
+    for (size_t i = 0; i < this->PointArrays.size(); ++i)
+      {
+      size += this->PointArrays[i].Data.size();
+      }
+    for (size_t i = 0; i < this->FieldArrays.size(); ++i)
+      {
+      size += this->FieldArrays[i].Data.size();
+      }
+    return size;
+  }
+
+  vtkIdType GetNumberOfPoints() const
+  {
+    return this->NumberOfPoints;
+  }
+
+private:
+
+  struct CompressedArray
+  {
+    CompressedArray()
+    {
+      this->DataType = 0;
+      this->NumberOfComponents = 0;
+      this->NumberOfTuples = 0;
+      this->UncompressedSize = 0;
+      this->QuantizationStep = 0;
+    }
+
+    void Compress(vtkDataArray* array, vtkDataCompressor* compressor, double quantizationStep)
+    {
+      this->Name = array->GetName() ? array->GetName() : "";
+      this->DataType = array->GetDataType();
+      this->NumberOfComponents = array->GetNumberOfComponents();
+      this->NumberOfTuples = array->GetNumberOfTuples();
+      this->UncompressedSize = static_cast<size_t>(this->NumberOfTuples) *
+        this->NumberOfComponents * array->GetDataTypeSize();
+
+      this->QuantizationStep = 0;
+
+      if (!this->UncompressedSize)
+        {
+        this->Data.clear();
+        return;
+        }
+
+      const unsigned char* data = static_cast<const unsigned char*>(array->GetVoidPointer(0));
+      size_t dataSize = this->UncompressedSize;
+
+      std::vector<unsigned char> quantized;
+      if (quantizationStep > 0 && (this->DataType == VTK_FLOAT || this->DataType == VTK_DOUBLE))
+        {
+        this->QuantizationStep = quantizationStep;
+        const size_t nValues = static_cast<size_t>(this->NumberOfTuples) * this->NumberOfComponents;
+        if (this->DataType == VTK_FLOAT)
+          {
+          this->Quantize(static_cast<const float*>(array->GetVoidPointer(0)), nValues, quantized);
+          }
+        else
+          {
+          this->Quantize(static_cast<const double*>(array->GetVoidPointer(0)), nValues, quantized);
+          }
+        data = &quantized[0];
+        dataSize = quantized.size();
+        }
+
+      this->Data.resize(compressor->GetMaximumCompressionSpace(dataSize));
+      size_t compressedSize = compressor->Compress(data, dataSize, &this->Data[0], this->Data.size());
+      this->Data.resize(compressedSize);
+      std::vector<unsigned char>(this->Data).swap(this->Data);
+    }
+
+    vtkSmartPointer<vtkDataArray> Decompress(vtkDataCompressor* compressor) const
+    {
+      vtkSmartPointer<vtkDataArray> array;
+      if (!this->DataType)
+        {
+        return array;
+        }
+
+      array.TakeReference(vtkDataArray::CreateDataArray(this->DataType));
+      if (this->Name.length())
+        {
+        array->SetName(this->Name.c_str());
+        }
+      array->SetNumberOfComponents(this->NumberOfComponents);
+      array->SetNumberOfTuples(this->NumberOfTuples);
+
+      if (!this->UncompressedSize)
+        {
+        return array;
+        }
+      if (this->Data.empty())
+        {
+        return vtkSmartPointer<vtkDataArray>();
+        }
+
+      if (this->QuantizationStep > 0)
+        {
+        const size_t nValues = static_cast<size_t>(this->NumberOfTuples) * this->NumberOfComponents;
+        std::vector<unsigned char> quantized(nValues * sizeof(uint32_t));
+        if (compressor->Uncompress(&this->Data[0], this->Data.size(), &quantized[0], quantized.size()) != quantized.size())
+          {
+          return vtkSmartPointer<vtkDataArray>();
+          }
+        if (this->DataType == VTK_FLOAT)
+          {
+          this->Dequantize(quantized, static_cast<float*>(array->GetVoidPointer(0)), nValues);
+          }
+        else
+          {
+          this->Dequantize(quantized, static_cast<double*>(array->GetVoidPointer(0)), nValues);
+          }
+        return array;
+        }
+
+      if (compressor->Uncompress(&this->Data[0], this->Data.size(),
+          static_cast<unsigned char*>(array->GetVoidPointer(0)), this->UncompressedSize) != this->UncompressedSize)
+        {
+        return vtkSmartPointer<vtkDataArray>();
+        }
+      return array;
+    }
+
+    // Rounds to multiples of the step, delta codes every component against
+    // the previous tuple, zigzag maps the deltas to unsigned values and
+    // stores byte k of every value in plane k.  Neighbouring returns are
+    // close, so the upper planes are nearly all zero.
+    template<typename T>
+    void Quantize(const T* values, size_t nValues, std::vector<unsigned char>& planes) const
+    {
+      const size_t nComponents = this->NumberOfComponents;
+      planes.resize(nValues * sizeof(uint32_t));
+      std::vector<int32_t> previous(nComponents, 0);
+      for (size_t i = 0; i < nValues; ++i)
+        {
+        int32_t value = static_cast<int32_t>(std::floor(values[i] / this->QuantizationStep + 0.5));
+        int32_t delta = value - previous[i % nComponents];
+        previous[i % nComponents] = value;
+        uint32_t zigzag = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+        for (size_t k = 0; k < sizeof(uint32_t); ++k)
+          {
+          planes[k * nValues + i] = static_cast<unsigned char>(zigzag >> (8 * k));
+          }
+        }
+    }
+
+    template<typename T>
+    void Dequantize(const std::vector<unsigned char>& planes, T* values, size_t nValues) const
+    {
+      const size_t nComponents = this->NumberOfComponents;
+      std::vector<int32_t> previous(nComponents, 0);
+      for (size_t i = 0; i < nValues; ++i)
+        {
+        uint32_t zigzag = 0;
+        for (size_t k = 0; k < sizeof(uint32_t); ++k)
+          {
+          zigzag |= static_cast<uint32_t>(planes[k * nValues + i]) << (8 * k);
+          }
+        int32_t delta = static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+        int32_t value = previous[i % nComponents] + delta;
+        previous[i % nComponents] = value;
+        values[i] = static_cast<T>(value * this->QuantizationStep);
+        }
+    }
+
+    std::string Name;
+    int DataType;
+    int NumberOfComponents;
+    vtkIdType NumberOfTuples;
+    size_t UncompressedSize;
+    double QuantizationStep;
+    std::vector<unsigned char> Data;
+  };
+
+  vtkIdType NumberOfPoints;
+  CompressedArray Points;
+  std::vector<CompressedArray> PointArrays;
+  std::vector<CompressedArray> FieldArrays;
+};
+
+#endif
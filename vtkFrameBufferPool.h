@@ -0,0 +1,421 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkFrameBufferPool.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkFrameBufferPool -
+// .SECTION Description
+// Pool of page aligned buffers backing the arrays of decoded frames.  A
+// buffer is attached to a VTK array with SetArray() and returns to the
+// pool when the array is deleted, so steady state decoding reuses the
+// same memory instead of growing every frame by reallocation.
+//
+// On Linux the buffers are mapped with mmap and can be backed by
+// transparent huge pages (MADV_HUGEPAGE) or by explicit huge pages
+// (MAP_HUGETLB, falling back to transparent ones when none are reserved).
+// With NumaLocal on, a new buffer is bound to the NUMA node of the thread
+// that requests it, which is the decoding thread that writes it, and only
+// free buffers from that node are reused.  The statistics count where the
+// first page of every new buffer was placed.  Other platforms use malloc
+// and keep the pooling only.
+//
+// Buffers hold a reference to the pool, which may therefore outlive its
+// owner until the last frame using it is deleted.
+
+#ifndef __vtkFrameBufferPool_h
+#define __vtkFrameBufferPool_h
+
+#include <vtkCommand.h>
+#include <vtkDataArrayTemplate.h>
+#include <vtkObject.h>
+
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#ifdef _MSC_VER
+typedef unsigned __int64 uint64_t;
+#else
+# include <stdint.h>
+#endif
+#ifdef __linux__
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+class vtkFrameBufferPool : public boost::enable_shared_from_this<vtkFrameBufferPool>
+{
+public:
+
+  enum
+  {
+    PAGES_DEFAULT = 0,
+    PAGES_TRANSPARENT_HUGE = 1,
+    PAGES_EXPLICIT_HUGE = 2
+  };
+
+  struct Statistics
+  {
+    uint64_t Allocations;
+    uint64_t Reuses;
+    uint64_t Releases;
+    uint64_t BytesAllocated;
+    uint64_t BytesInUse;
+    uint64_t HugePageAllocations;
+    uint64_t HugePageFallbacks;
+    uint64_t LocalNodeAllocations;
+    uint64_t RemoteNodeAllocations;
+  };
+
+  vtkFrameBufferPool()
+  {
+    this->Enabled = false;
+    this->PageMode = PAGES_DEFAULT;
+    this->NumaLocal = true;
+    this->MaxFreeBytes = static_cast<uint64_t>(256) * 1024 * 1024;
+    this->FreeBytes = 0;
+    memset(&this->Stats, 0, sizeof(this->Stats));
+  }
+
+  ~vtkFrameBufferPool()
+  {
+    for (FreeList::iterator it = this->FreeBuffers.begin(); it != this->FreeBuffers.end(); ++it)
+      {
+      Unmap(it->second);
+      }
+  }
+
+  bool IsEnabled()
+  {
+    return this->Enabled;
+  }
+
+  void SetEnabled(bool enabled)
+  {
+    this->Enabled = enabled;
+  }
+
+  int GetPageMode()
+  {
+    return this->PageMode;
+  }
+
+  void SetPageMode(int mode)
+  {
+    this->PageMode = mode;
+  }
+
+  bool GetNumaLocal()
+  {
+    return this->NumaLocal;
+  }
+
+  void SetNumaLocal(bool numaLocal)
+  {
+    this->NumaLocal = numaLocal;
+  }
+
+  // Description:
+  // Most bytes kept in free buffers, beyond which released buffers are
+  // unmapped.
+  uint64_t GetMaxFreeBytes()
+  {
+    return this->MaxFreeBytes;
+  }
+
+  void SetMaxFreeBytes(uint64_t bytes)
+  {
+    this->MaxFreeBytes = bytes;
+  }
+
+  Statistics GetStatistics()
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    return this->Stats;
+  }
+
+  // Description:
+  // Backs array with a pooled buffer of numberOfValues values, which become
+  // the content of the array.  Call Reset() on the array to use the buffer
+  // as reserved capacity instead.  Returns false if no memory could be
+  // mapped, the array is left untouched then.
+  template<typename ValueType>
+  bool Attach(vtkDataArrayTemplate<ValueType>* array, vtkIdType numberOfValues)
+  {
+    Buffer buffer;
+    if (numberOfValues <= 0 || !this->Acquire(numberOfValues * sizeof(ValueType), buffer))
+      {
+      return false;
+      }
+
+    array->SetArray(static_cast<ValueType*>(buffer.Data), numberOfValues, 1);
+    ReleaseCommand* command = new ReleaseCommand(this->shared_from_this(), buffer);
+    array->AddObserver(vtkCommand::DeleteEvent, command);
+    command->Delete();
+    return true;
+  }
+
+protected:
+
+  struct Buffer
+  {
+    void* Data;
+    size_t Size;
+    int Node;
+  };
+
+  typedef std::multimap<size_t, Buffer> FreeList;
+
+  // Returns the buffer to the pool when the array using it is deleted.
+  class ReleaseCommand : public vtkCommand
+  {
+  public:
+    ReleaseCommand(boost::shared_ptr<vtkFrameBufferPool> pool, const Buffer& buffer)
+      : Pool(pool), PooledBuffer(buffer)
+    {
+    }
+
+    virtual void Execute(vtkObject*, unsigned long, void*)
+    {
+      this->Pool->Release(this->PooledBuffer);
+    }
+
+    boost::shared_ptr<vtkFrameBufferPool> Pool;
+    Buffer PooledBuffer;
+  };
+
+  // A free buffer is reused if it is at most twice as large as needed and,
+  // with NumaLocal, on the node of the calling thread.
+  bool Acquire(size_t bytes, Buffer& buffer)
+  {
+    const int node = CurrentNode();
+      {
+      boost::lock_guard<boost::mutex> lock(this->Mutex);
+      for (FreeList::iterator it = this->FreeBuffers.lower_bound(bytes);
+           it != this->FreeBuffers.end() && it->first / 2 < bytes; ++it)
+        {
+        if (!this->NumaLocal || node < 0 || it->second.Node == node)
+          {
+          buffer = it->second;
+          this->FreeBytes -= buffer.Size;
+          this->FreeBuffers.erase(it);
+          ++this->Stats.Reuses;
+          this->Stats.BytesInUse += buffer.Size;
+          return true;
+          }
+        }
+      }
+
+    // new buffers are mapped outside the lock since they are touched here
+    bool huge = false;
+    bool fallback = false;
+    if (!this->Map(bytes, node, buffer, huge, fallback))
+      {
+      return false;
+      }
+
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    ++this->Stats.Allocations;
+    this->Stats.BytesAllocated += buffer.Size;
+    this->Stats.BytesInUse += buffer.Size;
+    this->Stats.HugePageAllocations += huge ? 1 : 0;
+    this->Stats.HugePageFallbacks += fallback ? 1 : 0;
+    if (node >= 0 && buffer.Node >= 0)
+      {
+      if (buffer.Node == node)
+        {
+        ++this->Stats.LocalNodeAllocations;
+        }
+      else
+        {
+        ++this->Stats.RemoteNodeAllocations;
+        }
+      }
+    return true;
+  }
+
+  void Release(const Buffer& buffer)
+  {
+      {
+      boost::lock_guard<boost::mutex> lock(this->Mutex);
+      ++this->Stats.Releases;
+      this->Stats.BytesInUse -= buffer.Size;
+      if (this->Enabled && this->FreeBytes + buffer.Size <= this->MaxFreeBytes)
+        {
+        this->FreeBuffers.insert(std::make_pair(buffer.Size, buffer));
+        this->FreeBytes += buffer.Size;
+        return;
+        }
+      this->Stats.BytesAllocated -= buffer.Size;
+      }
+    Unmap(buffer);
+  }
+
+  bool Map(size_t bytes, int node, Buffer& buffer, bool& huge, bool& fallback)
+  {
+    buffer.Node = -1;
+#ifdef __linux__
+    const size_t hugePageSize = 2 * 1024 * 1024;
+    const size_t granularity = (this->PageMode == PAGES_DEFAULT) ?
+      static_cast<size_t>(sysconf(_SC_PAGESIZE)) : hugePageSize;
+    const size_t size = (bytes + granularity - 1) / granularity * granularity;
+
+    void* data = MAP_FAILED;
+# ifdef MAP_HUGETLB
+    if (this->PageMode == PAGES_EXPLICIT_HUGE)
+      {
+      data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      huge = (data != MAP_FAILED);
+      fallback = !huge;
+      }
+# endif
+    if (data == MAP_FAILED && this->PageMode != PAGES_DEFAULT)
+      {
+      // transparent huge pages need a 2 MB aligned range, so map one more
+      // huge page and trim both ends
+      char* mapped = static_cast<char*>(mmap(0, size + hugePageSize, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+      if (mapped != MAP_FAILED)
+        {
+        char* aligned = reinterpret_cast<char*>(
+          (reinterpret_cast<size_t>(mapped) + hugePageSize - 1) / hugePageSize * hugePageSize);
+        if (aligned != mapped)
+          {
+          munmap(mapped, aligned - mapped);
+          }
+        munmap(aligned + size, mapped + hugePageSize - aligned);
+        data = aligned;
+# ifdef MADV_HUGEPAGE
+        huge = (madvise(data, size, MADV_HUGEPAGE) == 0);
+# endif
+        }
+      }
+    else if (data == MAP_FAILED)
+      {
+      data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      }
+    if (data == MAP_FAILED)
+      {
+      return false;
+      }
+
+    if (this->NumaLocal && node >= 0)
+      {
+      BindToNode(data, size, node);
+      }
+
+    // fault the pages in on the writing thread, which also places them
+    memset(data, 0, size);
+
+    buffer.Data = data;
+    buffer.Size = size;
+    buffer.Node = PageNode(data);
+    if (buffer.Node < 0)
+      {
+      buffer.Node = node;
+      }
+    return true;
+#else
+    (void)node;
+    (void)huge;
+    (void)fallback;
+    buffer.Data = malloc(bytes);
+    buffer.Size = bytes;
+    return buffer.Data != 0;
+#endif
+  }
+
+  static void Unmap(const Buffer& buffer)
+  {
+#ifdef __linux__
+    munmap(buffer.Data, buffer.Size);
+#else
+    free(buffer.Data);
+#endif
+  }
+
+  // NUMA node of the calling thread, -1 if unknown.
+  static int CurrentNode()
+  {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned int cpu = 0;
+    unsigned int node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, 0) == 0)
+      {
+      return static_cast<int>(node);
+      }
+#endif
+    return -1;
+  }
+
+  // NUMA node holding the page at address, -1 if unknown.
+  static int PageNode(void* address)
+  {
+#if defined(__linux__) && defined(SYS_move_pages)
+    int status = -1;
+    if (syscall(SYS_move_pages, 0, 1UL, &address, 0, &status, 0) == 0 && status >= 0)
+      {
+      return status;
+      }
+#else
+    (void)address;
+#endif
+    return -1;
+  }
+
+  // Prefers node for the pages of the range, without libnuma.
+  static void BindToNode(void* data, size_t size, int node)
+  {
+#if defined(__linux__) && defined(SYS_mbind)
+    const int preferred = 1; // MPOL_PREFERRED
+    unsigned long mask = 0;
+    if (node < static_cast<int>(8 * sizeof(mask)))
+      {
+      mask = 1UL << node;
+      syscall(SYS_mbind, data, size, preferred, &mask, 8 * sizeof(mask) + 1, 0);
+      }
+#else
+    (void)data;
+    (void)size;
+    (void)node;
+#endif
+  }
+
+  bool Enabled;
+  int PageMode;
+  bool NumaLocal;
+  uint64_t MaxFreeBytes;
+  uint64_t FreeBytes;
+  FreeList FreeBuffers;
+  Statistics Stats;
+  boost::mutex Mutex;
+};
+
+#endif
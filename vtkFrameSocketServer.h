@@ -0,0 +1,801 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkFrameSocketServer.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkFrameSocketServer -
+// .SECTION Description
+// Publishes completed frames to local processes over a Unix domain socket.
+//
+// A client connects and sends a SubscribeRequest selecting topics and a
+// slow subscriber policy; it may send a new request at any time to change
+// its subscription.  The server then sends a MessageHeader per message:
+//
+//   TOPIC_FRAME       one message per frame
+//   TOPIC_SECTORS     one message per azimuth sector of a frame
+//   TOPIC_STATISTICS  one message per frame with a Statistics payload
+//
+// Frame and sector messages carry a file descriptor (SCM_RIGHTS) of a
+// sealed shared memory buffer holding the frame columns, the header gives
+// the column offsets.  The point data is never sent through the socket.
+
+#ifndef __vtkFrameSocketServer_h
+#define __vtkFrameSocketServer_h
+
+#ifndef _WIN32
+
+#include <vtkPolyData.h>
+#include <vtkPoints.h>
+#include <vtkPointData.h>
+#include <vtkFloatArray.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkUnsignedShortArray.h>
+#include <vtkUnsignedIntArray.h>
+#include <vtkDoubleArray.h>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class vtkFrameSocketServer
+{
+public:
+
+  enum
+  {
+    MAGIC = 0x53464856,   // "VHFS"
+    PROTOCOL_VERSION = 1
+  };
+
+  enum TopicType
+  {
+    TOPIC_FRAME = 1,
+    TOPIC_SECTORS = 2,
+    TOPIC_STATISTICS = 4
+  };
+
+  enum PolicyType
+  {
+    DROP_OLDEST = 0,   // drop the oldest queued message
+    DROP_NEWEST = 1,   // drop the message being published
+    DISCONNECT = 2     // close the connection
+  };
+
+  enum ColumnType
+  {
+    COLUMN_XYZ = 0,       // 3 x float32
+    COLUMN_INTENSITY,     // uint8
+    COLUMN_LASER_ID,      // uint8
+    COLUMN_AZIMUTH,       // uint16, hundredths of a degree
+    COLUMN_DISTANCE,      // float64, meters
+    COLUMN_TIMESTAMP,     // uint32, microseconds past the hour
+    NUMBER_OF_COLUMNS
+  };
+
+  struct SubscribeRequest
+  {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t Topics;
+    uint32_t Policy;
+    uint32_t MaxQueuedMessages;
+    uint32_t Reserved;
+  };
+
+  struct MessageHeader
+  {
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t Topic;
+    uint64_t FrameId;
+    double FrameTime;
+    uint32_t NumberOfPoints;    // points in the frame
+    uint32_t FirstPoint;        // first point of the sector
+    uint32_t SectorPoints;      // points in the sector
+    uint16_t SectorIndex;
+    uint16_t NumberOfSectors;
+    uint32_t DroppedMessages;   // messages dropped for this subscriber so far
+    uint32_t PayloadSize;       // inline bytes following the header
+    uint64_t BufferSize;        // size of the shared memory buffer, 0 if none
+    uint64_t ColumnOffsets[NUMBER_OF_COLUMNS];
+  };
+
+  struct Statistics
+  {
+    uint32_t NumberOfPoints;
+    uint32_t FirstTimestamp;
+    uint32_t LastTimestamp;
+    uint16_t MinAzimuth;
+    uint16_t MaxAzimuth;
+    float MinDistance;
+    float MaxDistance;
+    float MeanIntensity;
+    uint32_t Reserved;
+  };
+
+  vtkFrameSocketServer()
+  {
+    this->NumberOfSectors = 8;
+    this->NextFrameId = 0;
+    this->ActiveTopics = 0;
+    this->Running = false;
+  }
+
+  ~vtkFrameSocketServer()
+  {
+    this->Stop();
+  }
+
+  bool Start(const std::string& path)
+  {
+    if (this->Thread)
+      {
+      return true;
+      }
+
+    // remove a stale socket left by a previous run
+    ::unlink(path.c_str());
+
+    try
+      {
+      this->Acceptor.reset(new boost::asio::local::stream_protocol::acceptor(
+        this->IOService, boost::asio::local::stream_protocol::endpoint(path)));
+      }
+    catch (std::exception& e)
+      {
+      this->LastError = e.what();
+      return false;
+      }
+
+    this->Path = path;
+    this->IOService.reset();
+    this->Work.reset(new boost::asio::io_service::work(this->IOService));
+    this->StartAccept();
+    this->Thread = boost::shared_ptr<boost::thread>(
+      new boost::thread(boost::bind(&vtkFrameSocketServer::ThreadLoop, this)));
+    this->Running = true;
+    return true;
+  }
+
+  void Stop()
+  {
+    if (!this->Thread)
+      {
+      return;
+      }
+
+    this->Running = false;
+    this->IOService.post(boost::bind(&vtkFrameSocketServer::CloseAll, this));
+    this->Work.reset();
+    this->Thread->join();
+    this->Thread.reset();
+    this->IOService.stop();
+    ::unlink(this->Path.c_str());
+    this->Path.clear();
+  }
+
+  bool IsRunning()
+  {
+    return this->Running.load();
+  }
+
+  const std::string& GetPath()
+  {
+    return this->Path;
+  }
+
+  const std::string& GetLastError()
+  {
+    return this->LastError;
+  }
+
+  void SetNumberOfSectors(int sectors)
+  {
+    this->NumberOfSectors = std::max(1, std::min(sectors, 360));
+  }
+
+  int GetNumberOfSectors()
+  {
+    return this->NumberOfSectors;
+  }
+
+  // Description:
+  // Publish a completed frame.  Called from the decode thread, the work
+  // done here is skipped for topics nobody subscribed to and all socket
+  // I/O happens on the server thread.
+  void PublishFrame(vtkPolyData* polyData, double frameTime)
+  {
+    const unsigned int topics = this->ActiveTopics.load();
+    if (!this->Running.load() || !topics || !polyData || !polyData->GetPoints())
+      {
+      return;
+      }
+
+    vtkPointData* pointData = polyData->GetPointData();
+    FrameColumns columns;
+    columns.Points = vtkFloatArray::SafeDownCast(polyData->GetPoints()->GetData());
+    columns.Intensity = vtkUnsignedCharArray::SafeDownCast(pointData->GetArray("intensity"));
+    columns.LaserId = vtkUnsignedCharArray::SafeDownCast(pointData->GetArray("laser_id"));
+    columns.Azimuth = vtkUnsignedShortArray::SafeDownCast(pointData->GetArray("azimuth"));
+    columns.Distance = vtkDoubleArray::SafeDownCast(pointData->GetArray("distance_m"));
+    columns.Timestamp = vtkUnsignedIntArray::SafeDownCast(pointData->GetArray("timestamp"));
+    if (!columns.Points || !columns.Intensity || !columns.LaserId ||
+        !columns.Azimuth || !columns.Distance || !columns.Timestamp)
+      {
+      return;
+      }
+
+    const uint32_t numberOfPoints = static_cast<uint32_t>(polyData->GetNumberOfPoints());
+
+    MessageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.Magic = MAGIC;
+    header.Version = PROTOCOL_VERSION;
+    header.FrameId = this->NextFrameId++;
+    header.FrameTime = frameTime;
+    header.NumberOfPoints = numberOfPoints;
+    header.SectorPoints = numberOfPoints;
+    header.NumberOfSectors = 1;
+
+    if (topics & (TOPIC_FRAME | TOPIC_SECTORS))
+      {
+      boost::shared_ptr<SharedBuffer> buffer = this->CreateSharedBuffer(columns, numberOfPoints, header);
+      if (buffer)
+        {
+        if (topics & TOPIC_FRAME)
+          {
+          boost::shared_ptr<Message> message(new Message);
+          message->Header = header;
+          message->Header.Topic = TOPIC_FRAME;
+          message->Buffer = buffer;
+          this->Post(message);
+          }
+
+        if (topics & TOPIC_SECTORS)
+          {
+          this->PublishSectors(columns, header, buffer);
+          }
+        }
+      }
+
+    if (topics & TOPIC_STATISTICS)
+      {
+      boost::shared_ptr<Message> message(new Message);
+      message->Header = header;
+      message->Header.Topic = TOPIC_STATISTICS;
+      message->Header.BufferSize = 0;
+      memset(message->Header.ColumnOffsets, 0, sizeof(message->Header.ColumnOffsets));
+      message->Header.PayloadSize = sizeof(Statistics);
+      message->Payload.resize(sizeof(Statistics));
+      ComputeStatistics(columns, numberOfPoints, reinterpret_cast<Statistics*>(&message->Payload[0]));
+      this->Post(message);
+      }
+  }
+
+protected:
+
+  struct FrameColumns
+  {
+    vtkFloatArray* Points;
+    vtkUnsignedCharArray* Intensity;
+    vtkUnsignedCharArray* LaserId;
+    vtkUnsignedShortArray* Azimuth;
+    vtkDoubleArray* Distance;
+    vtkUnsignedIntArray* Timestamp;
+  };
+
+  struct SharedBuffer
+  {
+    SharedBuffer(int fileDescriptor) : FileDescriptor(fileDescriptor)
+    {
+    }
+
+    ~SharedBuffer()
+    {
+      ::close(this->FileDescriptor);
+    }
+
+    int FileDescriptor;
+  };
+
+  struct Message
+  {
+    MessageHeader Header;
+    std::vector<char> Payload;
+    boost::shared_ptr<SharedBuffer> Buffer;
+  };
+
+  class Subscriber : public boost::enable_shared_from_this<Subscriber>
+  {
+  public:
+
+    Subscriber(boost::asio::io_service& ioService) : Socket(ioService)
+    {
+      this->Topics = 0;
+      this->Policy = DROP_OLDEST;
+      this->MaxQueuedMessages = 16;
+      this->DroppedMessages = 0;
+      this->SentBytes = 0;
+      this->WaitingForWrite = false;
+    }
+
+    boost::asio::local::stream_protocol::socket Socket;
+    SubscribeRequest Request;
+    unsigned int Topics;
+    unsigned int Policy;
+    size_t MaxQueuedMessages;
+    uint32_t DroppedMessages;
+
+    std::deque<boost::shared_ptr<Message> > Queue;
+    MessageHeader CurrentHeader;
+    size_t SentBytes;
+    bool WaitingForWrite;
+  };
+
+  typedef boost::shared_ptr<Subscriber> SubscriberPointer;
+
+  void ThreadLoop()
+  {
+    this->IOService.run();
+  }
+
+  static size_t AlignedSize(size_t size)
+  {
+    return (size + 7) & ~static_cast<size_t>(7);
+  }
+
+  boost::shared_ptr<SharedBuffer> CreateSharedBuffer(const FrameColumns& columns,
+    uint32_t numberOfPoints, MessageHeader& header)
+  {
+    const size_t columnSizes[NUMBER_OF_COLUMNS] = {
+      3 * sizeof(float) * numberOfPoints,
+      sizeof(unsigned char) * numberOfPoints,
+      sizeof(unsigned char) * numberOfPoints,
+      sizeof(unsigned short) * numberOfPoints,
+      sizeof(double) * numberOfPoints,
+      sizeof(unsigned int) * numberOfPoints};
+    const void* columnData[NUMBER_OF_COLUMNS] = {
+      numberOfPoints ? columns.Points->GetPointer(0) : 0,
+      numberOfPoints ? columns.Intensity->GetPointer(0) : 0,
+      numberOfPoints ? columns.LaserId->GetPointer(0) : 0,
+      numberOfPoints ? columns.Azimuth->GetPointer(0) : 0,
+      numberOfPoints ? columns.Distance->GetPointer(0) : 0,
+      numberOfPoints ? columns.Timestamp->GetPointer(0) : 0};
+
+    size_t bufferSize = 0;
+    for (int i = 0; i < NUMBER_OF_COLUMNS; ++i)
+      {
+      header.ColumnOffsets[i] = bufferSize;
+      bufferSize += AlignedSize(columnSizes[i]);
+      }
+    header.BufferSize = bufferSize;
+
+    const int fileDescriptor = CreateSharedMemory();
+    if (fileDescriptor < 0)
+      {
+      return boost::shared_ptr<SharedBuffer>();
+      }
+    boost::shared_ptr<SharedBuffer> buffer(new SharedBuffer(fileDescriptor));
+
+    if (bufferSize == 0)
+      {
+      return buffer;
+      }
+
+    if (::ftruncate(fileDescriptor, static_cast<off_t>(bufferSize)) != 0)
+      {
+      return boost::shared_ptr<SharedBuffer>();
+      }
+
+    void* memory = ::mmap(0, bufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+    if (memory == MAP_FAILED)
+      {
+      return boost::shared_ptr<SharedBuffer>();
+      }
+
+    for (int i = 0; i < NUMBER_OF_COLUMNS; ++i)
+      {
+      if (columnSizes[i])
+        {
+        memcpy(static_cast<char*>(memory) + header.ColumnOffsets[i], columnData[i], columnSizes[i]);
+        }
+      }
+    ::munmap(memory, bufferSize);
+
+#if defined(F_ADD_SEALS)
+    // subscribers may rely on the buffer never changing under them
+    ::fcntl(fileDescriptor, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+#endif
+    return buffer;
+  }
+
+  static int CreateSharedMemory()
+  {
+    int fileDescriptor = -1;
+#if defined(MFD_CLOEXEC) && defined(MFD_ALLOW_SEALING)
+    fileDescriptor = ::memfd_create("vtkFrameSocketServer", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fileDescriptor >= 0)
+      {
+      return fileDescriptor;
+      }
+#endif
+    static boost::atomic<unsigned int> counter(0);
+    char name[64];
+    snprintf(name, sizeof(name), "/vtkFrameSocketServer-%d-%u",
+      static_cast<int>(::getpid()), counter.fetch_add(1));
+    fileDescriptor = ::shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fileDescriptor >= 0)
+      {
+      ::shm_unlink(name);
+      }
+    return fileDescriptor;
+  }
+
+  void PublishSectors(const FrameColumns& columns, const MessageHeader& header,
+    boost::shared_ptr<SharedBuffer> buffer)
+  {
+    const uint32_t numberOfPoints = header.NumberOfPoints;
+    const int numberOfSectors = this->NumberOfSectors;
+    const unsigned short* azimuth = numberOfPoints ? columns.Azimuth->GetPointer(0) : 0;
+
+    // points are stored in firing order, so a sector is a contiguous range
+    uint32_t firstPoint = 0;
+    for (int sector = 0; sector < numberOfSectors; ++sector)
+      {
+      uint32_t endPoint = firstPoint;
+      while (endPoint < numberOfPoints &&
+             (sector == numberOfSectors - 1 ||
+              static_cast<int>(azimuth[endPoint]) * numberOfSectors / 36000 <= sector))
+        {
+        ++endPoint;
+        }
+
+      boost::shared_ptr<Message> message(new Message);
+      message->Header = header;
+      message->Header.Topic = TOPIC_SECTORS;
+      message->Header.FirstPoint = firstPoint;
+      message->Header.SectorPoints = endPoint - firstPoint;
+      message->Header.SectorIndex = static_cast<uint16_t>(sector);
+      message->Header.NumberOfSectors = static_cast<uint16_t>(numberOfSectors);
+      message->Buffer = buffer;
+      this->Post(message);
+
+      firstPoint = endPoint;
+      }
+  }
+
+  static void ComputeStatistics(const FrameColumns& columns, uint32_t numberOfPoints, Statistics* statistics)
+  {
+    memset(statistics, 0, sizeof(Statistics));
+    statistics->NumberOfPoints = numberOfPoints;
+    if (!numberOfPoints)
+      {
+      return;
+      }
+
+    const unsigned short* azimuth = columns.Azimuth->GetPointer(0);
+    const double* distance = columns.Distance->GetPointer(0);
+    const unsigned char* intensity = columns.Intensity->GetPointer(0);
+    const unsigned int* timestamp = columns.Timestamp->GetPointer(0);
+
+    unsigned short minAzimuth = azimuth[0];
+    unsigned short maxAzimuth = azimuth[0];
+    double minDistance = distance[0];
+    double maxDistance = distance[0];
+    double intensitySum = 0;
+    for (uint32_t i = 0; i < numberOfPoints; ++i)
+      {
+      minAzimuth = std::min(minAzimuth, azimuth[i]);
+      maxAzimuth = std::max(maxAzimuth, azimuth[i]);
+      minDistance = std::min(minDistance, distance[i]);
+      maxDistance = std::max(maxDistance, distance[i]);
+      intensitySum += intensity[i];
+      }
+
+    statistics->FirstTimestamp = timestamp[0];
+    statistics->LastTimestamp = timestamp[numberOfPoints - 1];
+    statistics->MinAzimuth = minAzimuth;
+    statistics->MaxAzimuth = maxAzimuth;
+    statistics->MinDistance = static_cast<float>(minDistance);
+    statistics->MaxDistance = static_cast<float>(maxDistance);
+    statistics->MeanIntensity = static_cast<float>(intensitySum / numberOfPoints);
+  }
+
+  void Post(boost::shared_ptr<Message> message)
+  {
+    this->IOService.post(boost::bind(&vtkFrameSocketServer::Dispatch, this, message));
+  }
+
+  // Everything below runs on the server thread.
+
+  void StartAccept()
+  {
+    SubscriberPointer subscriber(new Subscriber(this->IOService));
+    this->Acceptor->async_accept(subscriber->Socket,
+      boost::bind(&vtkFrameSocketServer::HandleAccept, this, subscriber,
+      boost::asio::placeholders::error));
+  }
+
+  void HandleAccept(SubscriberPointer subscriber, const boost::system::error_code& error)
+  {
+    if (error)
+      {
+      return;
+      }
+
+    this->Subscribers.push_back(subscriber);
+    this->ReadRequest(subscriber);
+    this->StartAccept();
+  }
+
+  void ReadRequest(SubscriberPointer subscriber)
+  {
+    boost::asio::async_read(subscriber->Socket,
+      boost::asio::buffer(&subscriber->Request, sizeof(SubscribeRequest)),
+      boost::bind(&vtkFrameSocketServer::HandleRequest, this, subscriber,
+      boost::asio::placeholders::error));
+  }
+
+  void HandleRequest(SubscriberPointer subscriber, const boost::system::error_code& error)
+  {
+    const SubscribeRequest& request = subscriber->Request;
+    if (error || request.Magic != MAGIC || request.Version != PROTOCOL_VERSION)
+      {
+      this->Disconnect(subscriber);
+      return;
+      }
+
+    subscriber->Topics = request.Topics & (TOPIC_FRAME | TOPIC_SECTORS | TOPIC_STATISTICS);
+    subscriber->Policy = DROP_OLDEST;
+    if (request.Policy == DROP_NEWEST || request.Policy == DISCONNECT)
+      {
+      subscriber->Policy = request.Policy;
+      }
+    subscriber->MaxQueuedMessages = std::max(1u, request.MaxQueuedMessages);
+    this->UpdateActiveTopics();
+    this->ReadRequest(subscriber);
+  }
+
+  void UpdateActiveTopics()
+  {
+    unsigned int topics = 0;
+    for (size_t i = 0; i < this->Subscribers.size(); ++i)
+      {
+      topics |= this->Subscribers[i]->Topics;
+      }
+    this->ActiveTopics.store(topics);
+  }
+
+  void Disconnect(SubscriberPointer subscriber)
+  {
+    std::vector<SubscriberPointer>::iterator itr =
+      std::find(this->Subscribers.begin(), this->Subscribers.end(), subscriber);
+    if (itr == this->Subscribers.end())
+      {
+      return;
+      }
+
+    boost::system::error_code error;
+    subscriber->Socket.close(error);
+    subscriber->Queue.clear();
+    this->Subscribers.erase(itr);
+    this->UpdateActiveTopics();
+  }
+
+  void CloseAll()
+  {
+    boost::system::error_code error;
+    this->Acceptor->close(error);
+    while (!this->Subscribers.empty())
+      {
+      this->Disconnect(this->Subscribers.back());
+      }
+  }
+
+  void Dispatch(boost::shared_ptr<Message> message)
+  {
+    // copy, Enqueue may disconnect subscribers
+    std::vector<SubscriberPointer> subscribers = this->Subscribers;
+    for (size_t i = 0; i < subscribers.size(); ++i)
+      {
+      if (subscribers[i]->Topics & message->Header.Topic)
+        {
+        this->Enqueue(subscribers[i], message);
+        }
+      }
+  }
+
+  void Enqueue(SubscriberPointer subscriber, boost::shared_ptr<Message> message)
+  {
+    std::deque<boost::shared_ptr<Message> >& queue = subscriber->Queue;
+    if (queue.size() >= subscriber->MaxQueuedMessages)
+      {
+      if (subscriber->Policy == DISCONNECT)
+        {
+        this->Disconnect(subscriber);
+        return;
+        }
+
+      ++subscriber->DroppedMessages;
+      if (subscriber->Policy == DROP_NEWEST)
+        {
+        return;
+        }
+
+      // the front message may be partially sent, it has to be completed
+      if (subscriber->SentBytes == 0)
+        {
+        queue.pop_front();
+        }
+      else if (queue.size() > 1)
+        {
+        queue.erase(queue.begin() + 1);
+        }
+      else
+        {
+        return;
+        }
+      }
+
+    queue.push_back(message);
+    this->Send(subscriber);
+  }
+
+  void Send(SubscriberPointer subscriber)
+  {
+    if (subscriber->WaitingForWrite)
+      {
+      return;
+      }
+
+    const int socket = subscriber->Socket.native_handle();
+    while (!subscriber->Queue.empty())
+      {
+      const Message& message = *subscriber->Queue.front();
+      const bool firstChunk = (subscriber->SentBytes == 0);
+      if (firstChunk)
+        {
+        subscriber->CurrentHeader = message.Header;
+        subscriber->CurrentHeader.DroppedMessages = subscriber->DroppedMessages;
+        }
+
+      const size_t headerSize = sizeof(MessageHeader);
+      const size_t messageSize = headerSize + message.Payload.size();
+
+      iovec iov[2];
+      int iovCount = 0;
+      if (subscriber->SentBytes < headerSize)
+        {
+        iov[iovCount].iov_base = reinterpret_cast<char*>(&subscriber->CurrentHeader) + subscriber->SentBytes;
+        iov[iovCount].iov_len = headerSize - subscriber->SentBytes;
+        ++iovCount;
+        }
+      if (!message.Payload.empty())
+        {
+        const size_t payloadOffset = subscriber->SentBytes > headerSize ? subscriber->SentBytes - headerSize : 0;
+        iov[iovCount].iov_base = const_cast<char*>(&message.Payload[0]) + payloadOffset;
+        iov[iovCount].iov_len = message.Payload.size() - payloadOffset;
+        ++iovCount;
+        }
+
+      msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = iovCount;
+
+      // the descriptor travels with the first byte of the message
+      union
+        {
+        cmsghdr Header;
+        char Data[CMSG_SPACE(sizeof(int))];
+        } control;
+      if (firstChunk && message.Buffer)
+        {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.Data;
+        msg.msg_controllen = sizeof(control.Data);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &message.Buffer->FileDescriptor, sizeof(int));
+        }
+
+      const ssize_t sent = ::sendmsg(socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (sent < 0)
+        {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+          {
+          subscriber->WaitingForWrite = true;
+          subscriber->Socket.async_write_some(boost::asio::null_buffers(),
+            boost::bind(&vtkFrameSocketServer::HandleWritable, this, subscriber,
+            boost::asio::placeholders::error));
+          return;
+          }
+        if (errno == EINTR)
+          {
+          continue;
+          }
+        this->Disconnect(subscriber);
+        return;
+        }
+
+      subscriber->SentBytes += static_cast<size_t>(sent);
+      if (subscriber->SentBytes >= messageSize)
+        {
+        subscriber->SentBytes = 0;
+        subscriber->Queue.pop_front();
+        }
+      }
+  }
+
+  void HandleWritable(SubscriberPointer subscriber, const boost::system::error_code& error)
+  {
+    subscriber->WaitingForWrite = false;
+    if (error)
+      {
+      this->Disconnect(subscriber);
+      return;
+      }
+    this->Send(subscriber);
+  }
+
+  int NumberOfSectors;
+  uint64_t NextFrameId;
+  boost::atomic<unsigned int> ActiveTopics;
+  // read by PublishFrame on the decode thread, Thread is only used by
+  // Start and Stop
+  boost::atomic<bool> Running;
+
+  std::string Path;
+  std::string LastError;
+
+  boost::asio::io_service IOService;
+  boost::shared_ptr<boost::asio::io_service::work> Work;
+  boost::shared_ptr<boost::asio::local::stream_protocol::acceptor> Acceptor;
+  boost::shared_ptr<boost::thread> Thread;
+  std::vector<SubscriberPointer> Subscribers;
+};
+
+#endif
+
+#endif
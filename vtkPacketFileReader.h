@@ -27,14 +27,21 @@
 =========================================================================*/
 // .NAME vtkPacketFileReader -
 // .SECTION Description
-//
+// Reads the UDP packets of a pcap file.  Built with zstd, files compressed
+// in the seekable zstd format are read directly, see vtkSeekableZstdFile.h;
+// file positions and offsets are then those of the decompressed file.
 
 #ifndef __vtkPacketFileReader_h
 #define __vtkPacketFileReader_h
 
 #include <pcap.h>
+#include <cstdio>
 #include <string>
 
+#ifdef VTK_HDL_USE_ZSTD
+# include "vtkSeekableZstdFile.h"
+#endif
+
 // Some versions of libpcap do not have PCAP_NETMASK_UNKNOWN
 #if !defined(PCAP_NETMASK_UNKNOWN)
   #define PCAP_NETMASK_UNKNOWN 0xffffffff
@@ -47,6 +54,7 @@ public:
   vtkPacketFileReader()
   {
     this->PCAPFile = 0;
+    this->FileSize = 0;
   }
 
   ~vtkPacketFileReader()
@@ -57,7 +65,31 @@ public:
   bool Open(const std::string& filename)
   {
     char errbuff[PCAP_ERRBUF_SIZE];
-    pcap_t *pcapFile = pcap_open_offline(filename.c_str (), errbuff);
+    pcap_t *pcapFile = 0;
+    double fileSize = 0;
+    if (IsZstdFile(filename))
+      {
+#ifdef VTK_HDL_USE_ZSTD
+      FILE* stream = vtkSeekableZstdFile::OpenStream(filename, fileSize, this->LastError);
+      if (!stream)
+        {
+        return false;
+        }
+      pcapFile = pcap_fopen_offline(stream, errbuff);
+      if (!pcapFile)
+        {
+        fclose(stream);
+        }
+#else
+      this->LastError = filename + " is zstd compressed, which needs a build with zstd";
+      return false;
+#endif
+      }
+    else
+      {
+      pcapFile = pcap_open_offline(filename.c_str (), errbuff);
+      fileSize = ReadFileSize(filename);
+      }
     if (!pcapFile)
       {
       this->LastError = errbuff;
@@ -80,6 +112,7 @@ public:
 
     this->FileName = filename;
     this->PCAPFile = pcapFile;
+    this->FileSize = fileSize;
     this->StartTime.tv_sec = this->StartTime.tv_usec = 0;
     return true;
   }
@@ -129,6 +162,25 @@ public:
 #endif
   }
 
+  // Description:
+  // Size of the file in bytes and the offset of the next packet, used to
+  // report progress while scanning.
+  double GetFileSize()
+  {
+    return this->FileSize;
+  }
+
+  double GetFileOffset()
+  {
+#ifdef _MSC_VER
+    fpos_t position;
+    pcap_fgetpos(this->PCAPFile, &position);
+    return static_cast<double>(position);
+#else
+    return static_cast<double>(ftello(pcap_file(this->PCAPFile)));
+#endif
+  }
+
   bool NextPacket(const unsigned char*& data, unsigned int& dataLength, double& timeSinceStart, pcap_pkthdr** headerReference=NULL)
   {
     if (!this->PCAPFile)
@@ -162,6 +214,39 @@ public:
 
 protected:
 
+  // Files starting with a zstd frame or a skippable frame.
+  static bool IsZstdFile(const std::string& filename)
+  {
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (!f)
+      {
+      return false;
+      }
+    unsigned char magic[4] = { 0, 0, 0, 0 };
+    const bool hasMagic = (fread(magic, 1, 4, f) == 4);
+    fclose(f);
+    const unsigned int value = magic[0] | (magic[1] << 8) | (magic[2] << 16) | (static_cast<unsigned int>(magic[3]) << 24);
+    return hasMagic && (value == 0xFD2FB528 || (value & 0xFFFFFFF0) == 0x184D2A50);
+  }
+
+  static double ReadFileSize(const std::string& filename)
+  {
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (!f)
+      {
+      return 0;
+      }
+#ifdef _MSC_VER
+    _fseeki64(f, 0, SEEK_END);
+    double size = static_cast<double>(_ftelli64(f));
+#else
+    fseeko(f, 0, SEEK_END);
+    double size = static_cast<double>(ftello(f));
+#endif
+    fclose(f);
+    return size;
+  }
+
   double GetElapsedTime(const struct timeval& end, const struct timeval& start)
   {
     return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.00;
@@ -171,6 +256,7 @@ protected:
   std::string FileName;
   std::string LastError;
   struct timeval StartTime;
+  double FileSize;
 };
 
 #endif
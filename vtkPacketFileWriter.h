@@ -33,6 +33,7 @@
 #define __vtkPacketFileWriter_h
 
 #include <pcap.h>
+#include <cstring>
 #include <string>
 #ifdef _MSC_VER
 typedef __int32 int32_t;
@@ -138,6 +139,15 @@ public:
   }
 
   bool WritePacket(const unsigned char* data, unsigned int dataLength)
+  {
+    struct timeval currentTime;
+    gettimeofday(&currentTime, NULL);
+    return this->WritePacket(data, dataLength, currentTime);
+  }
+
+  // Description:
+  // Writes a packet received earlier, stamped with its arrival time.
+  bool WritePacket(const unsigned char* data, unsigned int dataLength, const struct timeval& time)
   {
     if (!this->PCAPFile)
       {
@@ -149,9 +159,7 @@ public:
       return false;
       }
 
-    struct timeval currentTime;
-    gettimeofday(&currentTime, NULL);
-    this->PacketHeader.ts = currentTime;
+    this->PacketHeader.ts = time;
 
     memcpy(this->PacketBuffer + 42, data, dataLength);
 
@@ -0,0 +1,295 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkPacketRingFile.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkPacketRingFile -
+// .SECTION Description
+// Fixed size file holding the most recent 1206 byte sensor packets.  The
+// file is allocated in full when opened, then every packet overwrites the
+// oldest one.  Packets are addressed by their sequence number since the
+// file was opened; a packet can be read back until it is overwritten.
+// Writes and reads may come from different threads.  Reads go through a
+// second handle and only hold the write lock to flush and to validate the
+// range, so a slow read never holds up the writer.
+
+#ifndef __vtkPacketRingFile_h
+#define __vtkPacketRingFile_h
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef _MSC_VER
+# include <io.h>
+typedef __int64 int64_t;
+typedef unsigned __int64 uint64_t;
+#else
+# include <fcntl.h>
+# include <stdint.h>
+# include <sys/types.h>
+#endif
+
+class vtkPacketRingFile
+{
+public:
+
+  enum
+  {
+    PACKET_SIZE = 1206
+  };
+
+  vtkPacketRingFile()
+  {
+    this->File = 0;
+    this->ReadFile = 0;
+    this->Capacity = 0;
+    this->NumberOfPackets = 0;
+    this->WritePositionValid = false;
+  }
+
+  ~vtkPacketRingFile()
+  {
+    this->Close();
+  }
+
+  bool Open(const std::string& filename, uint64_t size)
+  {
+    boost::lock_guard<boost::mutex> readLock(this->ReadMutex);
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    this->CloseFile();
+
+    this->Capacity = size / PACKET_SIZE;
+    if (!this->Capacity)
+      {
+      this->LastError = "the ring file is smaller than one packet";
+      return false;
+      }
+
+    this->File = fopen(filename.c_str(), "w+b");
+    if (!this->File)
+      {
+      this->LastError = "failed to open " + filename;
+      return false;
+      }
+
+    if (!this->Allocate(this->Capacity * PACKET_SIZE))
+      {
+      this->LastError = "failed to allocate " + filename;
+      this->CloseFile();
+      return false;
+      }
+
+    this->ReadFile = fopen(filename.c_str(), "rb");
+    if (!this->ReadFile)
+      {
+      this->LastError = "failed to open " + filename + " for reading";
+      this->CloseFile();
+      return false;
+      }
+
+    this->FileName = filename;
+    this->NumberOfPackets = 0;
+    this->WritePositionValid = false;
+    return true;
+  }
+
+  bool IsOpen()
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    return (this->File != 0);
+  }
+
+  void Close()
+  {
+    boost::lock_guard<boost::mutex> readLock(this->ReadMutex);
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    this->CloseFile();
+  }
+
+  const std::string& GetLastError()
+  {
+    return this->LastError;
+  }
+
+  const std::string& GetFileName()
+  {
+    return this->FileName;
+  }
+
+  // Description:
+  // Stores a packet and returns its sequence number in index.  Returns
+  // false if the file is not open or the write failed, with the reason
+  // in GetLastError(); the packet then does not count as stored.
+  bool WritePacket(const unsigned char* data, uint64_t& index)
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    if (!this->File)
+      {
+      return false;
+      }
+
+    index = this->NumberOfPackets;
+
+    const uint64_t slot = index % this->Capacity;
+    if (!this->WritePositionValid || slot == 0)
+      {
+      if (!this->Seek(slot * PACKET_SIZE))
+        {
+        this->LastError = "failed to seek in " + this->FileName;
+        this->WritePositionValid = false;
+        return false;
+        }
+      this->WritePositionValid = true;
+      }
+
+    if (fwrite(data, 1, PACKET_SIZE, this->File) != PACKET_SIZE)
+      {
+      // the position after a short write is unknown, seek again next time
+      this->LastError = "failed to write to " + this->FileName;
+      this->WritePositionValid = false;
+      clearerr(this->File);
+      return false;
+      }
+
+    ++this->NumberOfPackets;
+    return true;
+  }
+
+  // Description:
+  // Oldest packet that has not been overwritten yet.
+  uint64_t GetFirstAvailablePacket()
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    return this->FirstAvailablePacket();
+  }
+
+  // Description:
+  // Reads count packets from sequence number first, stored back to back.
+  // Fails if any of them has been overwritten, including while reading.
+  bool ReadPackets(uint64_t first, uint64_t count, std::string& packets)
+  {
+    boost::lock_guard<boost::mutex> readLock(this->ReadMutex);
+      {
+      boost::lock_guard<boost::mutex> lock(this->Mutex);
+      if (!this->IsAvailable(first, count))
+        {
+        return false;
+        }
+      fflush(this->File);
+      }
+
+    packets.resize(count * PACKET_SIZE);
+    uint64_t done = 0;
+    while (done < count)
+      {
+      // a range that wraps around is read in two parts
+      const uint64_t slot = (first + done) % this->Capacity;
+      const uint64_t run = std::min(count - done, this->Capacity - slot);
+      if (!this->Seek(this->ReadFile, slot * PACKET_SIZE) ||
+          fread(&packets[done * PACKET_SIZE], 1, run * PACKET_SIZE, this->ReadFile) != run * PACKET_SIZE)
+        {
+        return false;
+        }
+      done += run;
+      }
+
+    // the writer kept going while reading, the range is only valid if
+    // none of it was overwritten meanwhile
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    return this->IsAvailable(first, count);
+  }
+
+protected:
+
+  uint64_t FirstAvailablePacket() const
+  {
+    return this->NumberOfPackets > this->Capacity ? this->NumberOfPackets - this->Capacity : 0;
+  }
+
+  bool IsAvailable(uint64_t first, uint64_t count) const
+  {
+    return this->File && first >= this->FirstAvailablePacket() && first + count <= this->NumberOfPackets;
+  }
+
+  bool Seek(uint64_t offset)
+  {
+    return this->Seek(this->File, offset);
+  }
+
+  static bool Seek(FILE* file, uint64_t offset)
+  {
+#ifdef _MSC_VER
+    return _fseeki64(file, static_cast<int64_t>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+  }
+
+  // Reserves the whole file up front so that the ring never grows or
+  // fragments while recording.
+  bool Allocate(uint64_t size)
+  {
+#ifdef _MSC_VER
+    return _chsize_s(_fileno(this->File), static_cast<int64_t>(size)) == 0;
+#elif defined(__linux__)
+    return posix_fallocate(fileno(this->File), 0, static_cast<off_t>(size)) == 0;
+#else
+    return this->Seek(size - 1) && fputc(0, this->File) != EOF && fflush(this->File) == 0;
+#endif
+  }
+
+  void CloseFile()
+  {
+    if (this->File)
+      {
+      fclose(this->File);
+      this->File = 0;
+      this->FileName.clear();
+      }
+    if (this->ReadFile)
+      {
+      fclose(this->ReadFile);
+      this->ReadFile = 0;
+      }
+  }
+
+  FILE* File;
+  FILE* ReadFile;
+  uint64_t Capacity;
+  uint64_t NumberOfPackets;
+  bool WritePositionValid;
+  boost::mutex Mutex;
+  boost::mutex ReadMutex;
+
+  std::string FileName;
+  std::string LastError;
+};
+
+#endif
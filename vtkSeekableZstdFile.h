@@ -0,0 +1,314 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkSeekableZstdFile.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkSeekableZstdFile -
+// .SECTION Description
+// Read only stdio stream over the content of a file in the seekable zstd
+// format: independent zstd frames followed by a seek table in a skippable
+// frame, as written by the seekable format of the zstd sources.  Stream
+// positions are offsets in the decompressed content; the seek table maps
+// them to the compressed frame that holds them, and a read decompresses
+// only that frame, keeping the last one.  So fgetpos/fsetpos work as on
+// the uncompressed file and a seek costs at most one frame.  glibc only,
+// the stream is made with fopencookie; elsewhere OpenStream() reports that
+// the file cannot be read.
+
+#ifndef __vtkSeekableZstdFile_h
+#define __vtkSeekableZstdFile_h
+
+#include <zstd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#ifdef _MSC_VER
+typedef unsigned __int32 uint32_t;
+typedef __int64 int64_t;
+typedef unsigned __int64 uint64_t;
+#else
+# include <stdint.h>
+# include <sys/types.h>
+#endif
+
+class vtkSeekableZstdFile
+{
+public:
+
+  // Description:
+  // Opens filename and returns a stream over its decompressed content, of
+  // size bytes, or NULL with the reason in error.  fclose() on the stream
+  // closes the file.
+  static FILE* OpenStream(const std::string& filename, double& size, std::string& error)
+  {
+#ifdef __GLIBC__
+    vtkSeekableZstdFile* file = new vtkSeekableZstdFile;
+    if (!file->Open(filename, error))
+      {
+      delete file;
+      return 0;
+      }
+
+    cookie_io_functions_t functions;
+    functions.read = &vtkSeekableZstdFile::ReadCallback;
+    functions.write = 0;
+    functions.seek = &vtkSeekableZstdFile::SeekCallback;
+    functions.close = &vtkSeekableZstdFile::CloseCallback;
+    FILE* stream = fopencookie(file, "rb", functions);
+    if (!stream)
+      {
+      error = "failed to open a stream over " + filename;
+      delete file;
+      return 0;
+      }
+    size = static_cast<double>(file->DecompressedOffsets.back());
+    return stream;
+#else
+    error = "zstd compressed packet files are only supported with glibc";
+    return 0;
+#endif
+  }
+
+protected:
+
+  enum
+  {
+    SKIPPABLE_MAGIC = 0x184D2A5E,
+    SEEKABLE_MAGIC = 0x8F92EAB1,
+    FOOTER_SIZE = 9,
+    SKIPPABLE_HEADER_SIZE = 8
+  };
+
+  vtkSeekableZstdFile()
+  {
+    this->File = 0;
+    this->Context = ZSTD_createDCtx();
+    this->Position = 0;
+    this->CachedFrame = -1;
+  }
+
+  ~vtkSeekableZstdFile()
+  {
+    if (this->File)
+      {
+      fclose(this->File);
+      }
+    ZSTD_freeDCtx(this->Context);
+  }
+
+  static uint32_t ReadLE32(const unsigned char* data)
+  {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+  }
+
+  // 64 bit offsets of the compressed file on every platform.
+  static bool Seek(FILE* file, int64_t offset, int origin)
+  {
+#ifdef _MSC_VER
+    return _fseeki64(file, offset, origin) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), origin) == 0;
+#endif
+  }
+
+  static int64_t Tell(FILE* file)
+  {
+#ifdef _MSC_VER
+    return _ftelli64(file);
+#else
+    return static_cast<int64_t>(ftello(file));
+#endif
+  }
+
+  bool ReadAt(uint64_t offset, void* data, size_t size)
+  {
+    return Seek(this->File, static_cast<int64_t>(offset), SEEK_SET) &&
+      fread(data, 1, size, this->File) == size;
+  }
+
+  bool Open(const std::string& filename, std::string& error)
+  {
+    this->File = fopen(filename.c_str(), "rb");
+    if (!this->File || !this->Context)
+      {
+      error = "failed to open " + filename;
+      return false;
+      }
+
+    const int64_t end = Seek(this->File, 0, SEEK_END) ? Tell(this->File) : -1;
+    if (end < 0)
+      {
+      error = "failed to read " + filename;
+      return false;
+      }
+    const uint64_t fileSize = static_cast<uint64_t>(end);
+
+    // the seek table ends the file: a skippable frame holding one entry
+    // per frame, then the number of frames, a descriptor and the magic
+    unsigned char footer[FOOTER_SIZE];
+    if (fileSize < FOOTER_SIZE + SKIPPABLE_HEADER_SIZE ||
+        !this->ReadAt(fileSize - FOOTER_SIZE, footer, FOOTER_SIZE) ||
+        ReadLE32(footer + 5) != SEEKABLE_MAGIC || (footer[4] & 0x7c))
+      {
+      error = filename + " has no zstd seek table, compress it in the seekable format";
+      return false;
+      }
+
+    const uint64_t nFrames = ReadLE32(footer);
+    const uint64_t entrySize = (footer[4] & 0x80) ? 12 : 8;
+    const uint64_t tableSize = nFrames * entrySize;
+    if (fileSize < tableSize + FOOTER_SIZE + SKIPPABLE_HEADER_SIZE)
+      {
+      error = filename + " has a truncated zstd seek table";
+      return false;
+      }
+
+    const uint64_t tableStart = fileSize - FOOTER_SIZE - tableSize;
+    unsigned char header[SKIPPABLE_HEADER_SIZE];
+    std::vector<unsigned char> table(static_cast<size_t>(tableSize));
+    if (!this->ReadAt(tableStart - SKIPPABLE_HEADER_SIZE, header, SKIPPABLE_HEADER_SIZE) ||
+        ReadLE32(header) != SKIPPABLE_MAGIC || ReadLE32(header + 4) != tableSize + FOOTER_SIZE ||
+        (tableSize && !this->ReadAt(tableStart, &table[0], table.size())))
+      {
+      error = filename + " has a corrupt zstd seek table";
+      return false;
+      }
+
+    this->CompressedOffsets.assign(1, 0);
+    this->DecompressedOffsets.assign(1, 0);
+    for (uint64_t i = 0; i < nFrames; ++i)
+      {
+      const unsigned char* entry = &table[static_cast<size_t>(i * entrySize)];
+      this->CompressedOffsets.push_back(this->CompressedOffsets.back() + ReadLE32(entry));
+      this->DecompressedOffsets.push_back(this->DecompressedOffsets.back() + ReadLE32(entry + 4));
+      }
+    if (this->CompressedOffsets.back() != tableStart - SKIPPABLE_HEADER_SIZE)
+      {
+      error = filename + " does not match its zstd seek table";
+      return false;
+      }
+    return true;
+  }
+
+  // Decompresses the frame into the cache unless it is already there.
+  bool LoadFrame(size_t frame)
+  {
+    if (this->CachedFrame == static_cast<int64_t>(frame))
+      {
+      return true;
+      }
+
+    this->CachedFrame = -1;
+    const size_t compressedSize = static_cast<size_t>(this->CompressedOffsets[frame + 1] - this->CompressedOffsets[frame]);
+    const size_t size = static_cast<size_t>(this->DecompressedOffsets[frame + 1] - this->DecompressedOffsets[frame]);
+    this->Compressed.resize(compressedSize);
+    this->Cache.resize(size);
+    if (!compressedSize || !size ||
+        !this->ReadAt(this->CompressedOffsets[frame], &this->Compressed[0], compressedSize))
+      {
+      return false;
+      }
+
+    const size_t result = ZSTD_decompressDCtx(this->Context, &this->Cache[0], size, &this->Compressed[0], compressedSize);
+    if (ZSTD_isError(result) || result != size)
+      {
+      return false;
+      }
+    this->CachedFrame = static_cast<int64_t>(frame);
+    return true;
+  }
+
+#ifdef __GLIBC__
+  ssize_t Read(char* buffer, size_t size)
+  {
+    size_t done = 0;
+    while (done < size && this->Position < this->DecompressedOffsets.back())
+      {
+      // the last frame starting at or before the position, empty frames
+      // share their start with the next one
+      const size_t frame = std::upper_bound(this->DecompressedOffsets.begin(), this->DecompressedOffsets.end(),
+        this->Position) - this->DecompressedOffsets.begin() - 1;
+      if (!this->LoadFrame(frame))
+        {
+        return done ? static_cast<ssize_t>(done) : -1;
+        }
+
+      const size_t offset = static_cast<size_t>(this->Position - this->DecompressedOffsets[frame]);
+      const size_t count = std::min(size - done, this->Cache.size() - offset);
+      std::copy(this->Cache.begin() + offset, this->Cache.begin() + offset + count, buffer + done);
+      done += count;
+      this->Position += count;
+      }
+    return static_cast<ssize_t>(done);
+  }
+
+  static ssize_t ReadCallback(void* cookie, char* buffer, size_t size)
+  {
+    return static_cast<vtkSeekableZstdFile*>(cookie)->Read(buffer, size);
+  }
+
+  static int SeekCallback(void* cookie, off64_t* offset, int whence)
+  {
+    vtkSeekableZstdFile* file = static_cast<vtkSeekableZstdFile*>(cookie);
+    int64_t base = 0;
+    if (whence == SEEK_CUR)
+      {
+      base = static_cast<int64_t>(file->Position);
+      }
+    else if (whence == SEEK_END)
+      {
+      base = static_cast<int64_t>(file->DecompressedOffsets.back());
+      }
+
+    const int64_t position = base + *offset;
+    if (position < 0)
+      {
+      return -1;
+      }
+    file->Position = static_cast<uint64_t>(position);
+    *offset = position;
+    return 0;
+  }
+
+  static int CloseCallback(void* cookie)
+  {
+    delete static_cast<vtkSeekableZstdFile*>(cookie);
+    return 0;
+  }
+#endif
+
+  FILE* File;
+  ZSTD_DCtx* Context;
+  std::vector<uint64_t> CompressedOffsets;
+  std::vector<uint64_t> DecompressedOffsets;
+  uint64_t Position;
+  int64_t CachedFrame;
+  std::vector<char> Compressed;
+  std::vector<char> Cache;
+};
+
+#endif
@@ -0,0 +1,253 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkSensorClock.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkSensorClock -
+// .SECTION Description
+// Relates the sensor time stamped on data packets, in microseconds past
+// the hour, to absolute UTC time and to the host clock, from the position
+// packets the sensor sends on its own port (8308 by default).
+//
+// A position packet carries the sensor time at offset 198, the PPS status
+// at offset 202 and a $GPRMC NMEA sentence at offset 206.  With a valid
+// sentence the UTC start of the sensor hour is known exactly; without GPS
+// the hour is taken from the host clock.  Every position packet also adds
+// a sample of the host minus sensor offset, the model keeps the smallest
+// offset of the last samples, which is the one least delayed by the
+// network.
+//
+// The model is published as an immutable state swapped atomically, so
+// converting a frame time never waits for the thread parsing packets.
+// Position packets are handled by one thread at a time.
+
+#ifndef __vtkSensorClock_h
+#define __vtkSensorClock_h
+
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+class vtkSensorClock
+{
+public:
+
+  enum
+  {
+    POSITION_PACKET_SIZE = 512,
+    NUMBER_OF_OFFSET_SAMPLES = 64
+  };
+
+  enum
+  {
+    PPS_ABSENT = 0,
+    PPS_SYNCHRONIZING = 1,
+    PPS_LOCKED = 2,
+    PPS_ERROR = 3
+  };
+
+  struct State
+  {
+    // true once a valid $GPRMC sentence was received
+    bool HasGPSTime;
+    // UTC seconds since the epoch at the start of the sensor hour
+    double HourStart;
+    // sensor time of the last position packet, microseconds past the hour
+    double SensorTime;
+    int PPSStatus;
+    // host time minus absolute sensor time, in seconds
+    double Offset;
+  };
+
+  // Description:
+  // Parses a position packet received at hostTime, in seconds since the
+  // epoch.  Returns false if it is not a position packet.
+  bool HandlePositionPacket(const unsigned char* data, size_t length, double hostTime)
+  {
+    if (length != POSITION_PACKET_SIZE)
+      {
+      return false;
+      }
+
+    unsigned int sensorTime = 0;
+    memcpy(&sensorTime, data + 198, sizeof(sensorTime));
+    if (sensorTime >= 3600000000u)
+      {
+      return false;
+      }
+
+    boost::shared_ptr<State> state(new State);
+    state->SensorTime = sensorTime;
+    state->PPSStatus = data[202];
+    if (state->PPSStatus > PPS_ERROR)
+      {
+      state->PPSStatus = PPS_ABSENT;
+      }
+
+    double utcTime = 0;
+    state->HasGPSTime = ParseRMC(std::string(reinterpret_cast<const char*>(data + 206), 72), utcTime);
+    state->HourStart = NearestHour((state->HasGPSTime ? utcTime : hostTime) - sensorTime * 1e-6);
+
+    this->OffsetSamples.push_back(hostTime - (state->HourStart + sensorTime * 1e-6));
+    if (this->OffsetSamples.size() > NUMBER_OF_OFFSET_SAMPLES)
+      {
+      this->OffsetSamples.pop_front();
+      }
+    state->Offset = this->OffsetSamples.front();
+    for (size_t i = 1; i < this->OffsetSamples.size(); ++i)
+      {
+      state->Offset = std::min(state->Offset, this->OffsetSamples[i]);
+      }
+
+    boost::atomic_store(&this->CurrentState, boost::shared_ptr<const State>(state));
+    return true;
+  }
+
+  // Description:
+  // Latest state, NULL until a position packet was received.
+  boost::shared_ptr<const State> GetState()
+  {
+    return boost::atomic_load(&this->CurrentState);
+  }
+
+  // Description:
+  // Absolute UTC time, in seconds since the epoch, of a sensor time in
+  // microseconds past the hour.  The hour may have rolled over on either
+  // side since the last position packet.
+  bool GetAbsoluteTime(double sensorTime, double& absoluteTime)
+  {
+    boost::shared_ptr<const State> state = this->GetState();
+    if (!state)
+      {
+      return false;
+      }
+
+    double hourStart = state->HourStart;
+    const double difference = sensorTime - state->SensorTime;
+    if (difference < -1800e6)
+      {
+      hourStart += 3600;
+      }
+    else if (difference > 1800e6)
+      {
+      hourStart -= 3600;
+      }
+    absoluteTime = hourStart + sensorTime * 1e-6;
+    return true;
+  }
+
+  // Description:
+  // Host clock time, in seconds since the epoch, of a sensor time.
+  bool GetHostTime(double sensorTime, double& hostTime)
+  {
+    boost::shared_ptr<const State> state = this->GetState();
+    if (!state || !this->GetAbsoluteTime(sensorTime, hostTime))
+      {
+      return false;
+      }
+    hostTime += state->Offset;
+    return true;
+  }
+
+  void Reset()
+  {
+    boost::atomic_store(&this->CurrentState, boost::shared_ptr<const State>());
+    this->OffsetSamples.clear();
+  }
+
+protected:
+
+  static double NearestHour(double time)
+  {
+    return std::floor(time / 3600 + 0.5) * 3600;
+  }
+
+  // $GPRMC,hhmmss[.ss],A,lat,N,lon,E,speed,course,ddmmyy,...
+  static bool ParseRMC(const std::string& text, double& utcTime)
+  {
+    size_t start = text.find("RMC,");
+    if (start == std::string::npos || start < 3 || text[start - 3] != '$')
+      {
+      return false;
+      }
+
+    std::vector<std::string> fields;
+    size_t position = start + 4;
+    while (fields.size() < 9)
+      {
+      size_t end = text.find(',', position);
+      if (end == std::string::npos)
+        {
+        return false;
+        }
+      fields.push_back(text.substr(position, end - position));
+      position = end + 1;
+      }
+
+    const std::string& time = fields[0];
+    const std::string& status = fields[1];
+    const std::string& date = fields[8];
+    if (status != "A" || time.length() < 6 || date.length() != 6)
+      {
+      return false;
+      }
+
+    const int hour = atoi(time.substr(0, 2).c_str());
+    const int minute = atoi(time.substr(2, 2).c_str());
+    const double second = atof(time.substr(4).c_str());
+    const int day = atoi(date.substr(0, 2).c_str());
+    const int month = atoi(date.substr(2, 2).c_str());
+    const int year = 2000 + atoi(date.substr(4, 2).c_str());
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59)
+      {
+      return false;
+      }
+
+    utcTime = DaysFromCivil(year, month, day) * 86400.0 + hour * 3600 + minute * 60 + second;
+    return true;
+  }
+
+  // Days since 1970-01-01 of a date of the proleptic Gregorian calendar.
+  static long DaysFromCivil(int year, int month, int day)
+  {
+    year -= (month <= 2) ? 1 : 0;
+    const long era = (year >= 0 ? year : year - 399) / 400;
+    const long yearOfEra = year - era * 400;
+    const long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+  }
+
+  boost::shared_ptr<const State> CurrentState;
+  std::deque<double> OffsetSamples;
+};
+
+#endif
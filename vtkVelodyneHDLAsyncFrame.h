@@ -0,0 +1,159 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkVelodyneHDLAsyncFrame.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkVelodyneHDLAsyncFrame -
+// .SECTION Description
+// Asynchronous wait for the next frame of a vtkVelodyneHDLSource, for
+// applications running a boost::asio event loop:
+//
+//   void OnFrame(vtkSmartPointer<vtkPolyData> frame, double timestep);
+//   vtkVelodyneHDLAsyncFrameWait wait = AsyncNextFrame(source, ioService, OnFrame);
+//
+// The handler is posted to the io_service as soon as the decoding thread
+// publishes the next frame, so no polling thread or sleep is needed.  It
+// is called with a NULL frame if the source is stopped first or the wait
+// is cancelled with wait.Cancel().  Call AsyncNextFrame again from the
+// handler to follow the stream.  The io_service does not run out of work
+// while a wait is pending.
+
+#ifndef __vtkVelodyneHDLAsyncFrame_h
+#define __vtkVelodyneHDLAsyncFrame_h
+
+#include "vtkVelodyneHDLSource.h"
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+// A pending wait, whatever its handler.
+class vtkVelodyneHDLAsyncFrameState
+{
+public:
+
+  virtual ~vtkVelodyneHDLAsyncFrameState()
+  {
+  }
+
+  // Description:
+  // Posts the handler with frame and lets the io_service run out of work,
+  // unless the handler was posted already.  Returns false then.
+  virtual bool Complete(vtkPolyData* frame, double timestep) = 0;
+};
+
+// Description:
+// Handle of a wait returned by AsyncNextFrame.  Cancel() posts the handler
+// with a NULL frame unless it was posted already, and returns false then.
+// The source forgets the cancelled wait at its next frame or when it
+// stops.
+class vtkVelodyneHDLAsyncFrameWait
+{
+public:
+
+  vtkVelodyneHDLAsyncFrameWait()
+  {
+  }
+
+  explicit vtkVelodyneHDLAsyncFrameWait(boost::shared_ptr<vtkVelodyneHDLAsyncFrameState> state)
+    : State(state)
+  {
+  }
+
+  bool Cancel()
+  {
+    return this->State && this->State->Complete(0, 0);
+  }
+
+private:
+
+  boost::shared_ptr<vtkVelodyneHDLAsyncFrameState> State;
+};
+
+template<typename Handler>
+class vtkVelodyneHDLAsyncFrame : public vtkVelodyneHDLAsyncFrameState
+{
+public:
+
+  static vtkVelodyneHDLAsyncFrameWait Wait(vtkVelodyneHDLSource* source, boost::asio::io_service& ioService,
+    Handler handler)
+  {
+    boost::shared_ptr<vtkVelodyneHDLAsyncFrameState> state(new vtkVelodyneHDLAsyncFrame(ioService, handler));
+    source->NotifyNextFrame(&vtkVelodyneHDLAsyncFrame::FrameReady,
+      new boost::shared_ptr<vtkVelodyneHDLAsyncFrameState>(state));
+    return vtkVelodyneHDLAsyncFrameWait(state);
+  }
+
+  virtual bool Complete(vtkPolyData* frame, double timestep)
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    if (!this->Work)
+      {
+      return false;
+      }
+    this->IOService.post(boost::bind(this->FrameHandler, vtkSmartPointer<vtkPolyData>(frame), timestep));
+    this->Work.reset();
+    return true;
+  }
+
+private:
+
+  vtkVelodyneHDLAsyncFrame(boost::asio::io_service& ioService, Handler handler)
+    : IOService(ioService), Work(new boost::asio::io_service::work(ioService)), FrameHandler(handler)
+  {
+  }
+
+  // Called once on the decoding thread, even after a Cancel().
+  static void FrameReady(vtkPolyData* frame, double timestep, void* clientData)
+  {
+    boost::shared_ptr<vtkVelodyneHDLAsyncFrameState>* state =
+      static_cast<boost::shared_ptr<vtkVelodyneHDLAsyncFrameState>*>(clientData);
+    (*state)->Complete(frame, timestep);
+    delete state;
+  }
+
+  boost::mutex Mutex;
+  boost::asio::io_service& IOService;
+  boost::scoped_ptr<boost::asio::io_service::work> Work;
+  Handler FrameHandler;
+};
+
+// Description:
+// Posts handler(vtkSmartPointer<vtkPolyData> frame, double timestep) to
+// ioService with the next frame of source.
+template<typename Handler>
+vtkVelodyneHDLAsyncFrameWait AsyncNextFrame(vtkVelodyneHDLSource* source, boost::asio::io_service& ioService,
+  Handler handler)
+{
+  return vtkVelodyneHDLAsyncFrame<Handler>::Wait(source, ioService, handler);
+}
+
+#endif
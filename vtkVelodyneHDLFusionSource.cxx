@@ -0,0 +1,376 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkVelodyneHDLFusionSource.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+#include "vtkVelodyneHDLFusionSource.h"
+#include "vtkVelodyneHDLSource.h"
+
+#include "vtkCellArray.h"
+#include "vtkDataArray.h"
+#include "vtkDoubleArray.h"
+#include "vtkFieldData.h"
+#include "vtkFloatArray.h"
+#include "vtkIdTypeArray.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkNew.h"
+#include "vtkObjectFactory.h"
+#include "vtkPointData.h"
+#include "vtkPoints.h"
+#include "vtkPolyData.h"
+#include "vtkSmartPointer.h"
+#include "vtkTimerLog.h"
+#include "vtkUnsignedCharArray.h"
+#include "vtkUnsignedIntArray.h"
+#include "vtkUnsignedShortArray.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+const char* const PointArrayNames[] = {"intensity", "laser_id", "azimuth", "distance_m", "timestamp", 0};
+}
+
+//----------------------------------------------------------------------------
+class vtkVelodyneHDLFusionSource::vtkInternal
+{
+public:
+
+  vtkInternal()
+  {
+    this->HasFused = false;
+    this->LastFusedTime = 0;
+    this->HasPending = false;
+    this->PendingTime = 0;
+    this->PendingSince = 0;
+    this->FusedTime = 0;
+    this->BackBuffer = 0;
+  }
+
+  // Arrays of a fused frame, refilled in place on a later update.
+  struct FusedBuffer
+  {
+    vtkSmartPointer<vtkPolyData> Frame;
+    vtkSmartPointer<vtkIdTypeArray> VertexIds;
+
+    void Create(vtkIdType preallocatedPoints);
+    bool IsShared();
+  };
+
+  std::vector<vtkSmartPointer<vtkVelodyneHDLSource> > Sources;
+
+  bool HasFused;
+  double LastFusedTime;
+
+  bool HasPending;
+  double PendingTime;
+  double PendingSince;
+
+  // frames picked by Poll() for the next RequestData()
+  std::vector<vtkSmartPointer<vtkPolyData> > SelectedFrames;
+  double FusedTime;
+
+  // The output shares the arrays of the buffer filled last, so the fused
+  // frame is written into the other one, and the two swap on each update.
+  FusedBuffer Buffers[2];
+  int BackBuffer;
+};
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLFusionSource::vtkInternal::FusedBuffer::Create(vtkIdType preallocatedPoints)
+{
+  this->Frame = vtkSmartPointer<vtkPolyData>::New();
+
+  vtkNew<vtkPoints> points;
+  points->SetDataTypeToFloat();
+  points->GetData()->Allocate(3 * preallocatedPoints);
+  this->Frame->SetPoints(points.GetPointer());
+
+  vtkSmartPointer<vtkDataArray> arrays[] = {
+    vtkSmartPointer<vtkUnsignedCharArray>::New(),
+    vtkSmartPointer<vtkUnsignedCharArray>::New(),
+    vtkSmartPointer<vtkUnsignedShortArray>::New(),
+    vtkSmartPointer<vtkDoubleArray>::New(),
+    vtkSmartPointer<vtkUnsignedIntArray>::New(),
+    vtkSmartPointer<vtkUnsignedCharArray>::New()};
+  for (int i = 0; PointArrayNames[i]; ++i)
+    {
+    arrays[i]->SetName(PointArrayNames[i]);
+    arrays[i]->Allocate(preallocatedPoints);
+    this->Frame->GetPointData()->AddArray(arrays[i]);
+    }
+  arrays[5]->SetName("sensor_id");
+  arrays[5]->Allocate(preallocatedPoints);
+  this->Frame->GetPointData()->AddArray(arrays[5]);
+
+  this->VertexIds = vtkSmartPointer<vtkIdTypeArray>::New();
+  this->VertexIds->Allocate(2 * preallocatedPoints);
+}
+
+//----------------------------------------------------------------------------
+// Whether anything besides the buffer still holds its arrays, such as a
+// consumer that kept an output from two updates ago.
+bool vtkVelodyneHDLFusionSource::vtkInternal::FusedBuffer::IsShared()
+{
+  if (this->Frame->GetReferenceCount() > 1 || this->Frame->GetPoints()->GetReferenceCount() > 1 ||
+      this->Frame->GetPoints()->GetData()->GetReferenceCount() > 1)
+    {
+    return true;
+    }
+
+  vtkPointData* pointData = this->Frame->GetPointData();
+  for (int i = 0; i < pointData->GetNumberOfArrays(); ++i)
+    {
+    if (pointData->GetArray(i)->GetReferenceCount() > 1)
+      {
+      return true;
+      }
+    }
+
+  // the vertex ids are also held by the cell array of the frame
+  vtkCellArray* verts = this->Frame->GetVerts();
+  const int vertexIdsOwners = (verts && verts->GetData() == this->VertexIds) ? 2 : 1;
+  return (verts && verts->GetReferenceCount() > 1) || this->VertexIds->GetReferenceCount() > vertexIdsOwners;
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkVelodyneHDLFusionSource);
+
+//----------------------------------------------------------------------------
+vtkVelodyneHDLFusionSource::vtkVelodyneHDLFusionSource()
+{
+  this->Internal = new vtkInternal;
+  this->MaxTimeDifference = 0.05;
+  this->LatencyBudget = 0.1;
+  this->PreallocatedPoints = 0;
+  this->SetNumberOfInputPorts(0);
+  this->SetNumberOfOutputPorts(1);
+}
+
+//----------------------------------------------------------------------------
+vtkVelodyneHDLFusionSource::~vtkVelodyneHDLFusionSource()
+{
+  delete this->Internal;
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLFusionSource::AddSource(vtkVelodyneHDLSource* source)
+{
+  if (!source)
+    {
+    return;
+    }
+
+  this->Internal->Sources.push_back(source);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLFusionSource::RemoveAllSources()
+{
+  this->Internal->Sources.clear();
+  this->Internal->SelectedFrames.clear();
+  this->Internal->HasFused = false;
+  this->Internal->HasPending = false;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkVelodyneHDLFusionSource::GetNumberOfSources()
+{
+  return static_cast<int>(this->Internal->Sources.size());
+}
+
+//----------------------------------------------------------------------------
+bool vtkVelodyneHDLFusionSource::Poll()
+{
+  std::vector<vtkSmartPointer<vtkVelodyneHDLSource> >& sources = this->Internal->Sources;
+  const size_t numberOfSources = sources.size();
+
+  double referenceTime = 0;
+  if (!numberOfSources || !sources[0]->GetLatestSensorTime(referenceTime))
+    {
+    return false;
+    }
+
+  if (this->Internal->HasFused &&
+      vtkVelodyneHDLSource::SensorTimeDifference(referenceTime, this->Internal->LastFusedTime) <= 0)
+    {
+    return false;
+    }
+
+  const double now = vtkTimerLog::GetUniversalTime();
+  if (!this->Internal->HasPending || this->Internal->PendingTime != referenceTime)
+    {
+    this->Internal->HasPending = true;
+    this->Internal->PendingTime = referenceTime;
+    this->Internal->PendingSince = now;
+    }
+
+  const double maxDifference = this->MaxTimeDifference * 1e6;
+
+  std::vector<vtkSmartPointer<vtkPolyData> > frames(numberOfSources);
+  double frameTime = 0;
+  frames[0] = sources[0]->GetFrameForSensorTime(referenceTime, frameTime);
+
+  bool waiting = false;
+  for (size_t i = 1; i < numberOfSources; ++i)
+    {
+    double latestTime = 0;
+    if (!sources[i]->GetLatestSensorTime(latestTime) ||
+        vtkVelodyneHDLSource::SensorTimeDifference(latestTime, referenceTime) < -maxDifference)
+      {
+      // this sensor has not reached the reference revolution yet
+      waiting = true;
+      }
+
+    vtkSmartPointer<vtkPolyData> frame = sources[i]->GetFrameForSensorTime(referenceTime, frameTime);
+    if (frame && std::abs(vtkVelodyneHDLSource::SensorTimeDifference(frameTime, referenceTime)) <= maxDifference)
+      {
+      frames[i] = frame;
+      }
+    }
+
+  if (waiting && now - this->Internal->PendingSince < this->LatencyBudget)
+    {
+    return false;
+    }
+
+  this->Internal->SelectedFrames = frames;
+  this->Internal->FusedTime = referenceTime;
+  this->Internal->LastFusedTime = referenceTime;
+  this->Internal->HasFused = true;
+  this->Internal->HasPending = false;
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int vtkVelodyneHDLFusionSource::RequestData(
+  vtkInformation *vtkNotUsed(request),
+  vtkInformationVector **vtkNotUsed(inputVector),
+  vtkInformationVector *outputVector)
+{
+  vtkPolyData *output = vtkPolyData::GetData(outputVector);
+
+  vtkInternal::FusedBuffer& buffer = this->Internal->Buffers[this->Internal->BackBuffer];
+  if (!buffer.Frame || buffer.IsShared())
+    {
+    // refilling it would change a frame under whoever holds it
+    buffer.Create(this->PreallocatedPoints);
+    }
+  this->Internal->BackBuffer = 1 - this->Internal->BackBuffer;
+
+  const std::vector<vtkSmartPointer<vtkPolyData> >& frames = this->Internal->SelectedFrames;
+
+  vtkIdType numberOfPoints = 0;
+  int fusedSensors = 0;
+  for (size_t i = 0; i < frames.size(); ++i)
+    {
+    if (frames[i])
+      {
+      numberOfPoints += frames[i]->GetNumberOfPoints();
+      ++fusedSensors;
+      }
+    }
+
+  // the arrays keep their capacity, they are only reallocated to grow
+  vtkPolyData* fused = buffer.Frame;
+  vtkDataArray* fusedPoints = fused->GetPoints()->GetData();
+  fusedPoints->SetNumberOfTuples(numberOfPoints);
+  vtkUnsignedCharArray* sensorId = vtkUnsignedCharArray::SafeDownCast(fused->GetPointData()->GetArray("sensor_id"));
+  sensorId->SetNumberOfTuples(numberOfPoints);
+  for (int j = 0; PointArrayNames[j]; ++j)
+    {
+    fused->GetPointData()->GetArray(PointArrayNames[j])->SetNumberOfTuples(numberOfPoints);
+    }
+
+  vtkIdType offset = 0;
+  for (size_t i = 0; i < frames.size(); ++i)
+    {
+    vtkPolyData* frame = frames[i];
+    const vtkIdType framePoints = frame ? frame->GetNumberOfPoints() : 0;
+    if (!framePoints)
+      {
+      continue;
+      }
+
+    // the one copy of the points, see the class description
+    memcpy(fusedPoints->GetVoidPointer(3 * offset), frame->GetPoints()->GetData()->GetVoidPointer(0),
+      framePoints * 3 * sizeof(float));
+
+    for (int j = 0; PointArrayNames[j]; ++j)
+      {
+      vtkDataArray* source = frame->GetPointData()->GetArray(PointArrayNames[j]);
+      vtkDataArray* destination = fused->GetPointData()->GetArray(PointArrayNames[j]);
+      if (source && source->GetDataType() == destination->GetDataType())
+        {
+        memcpy(destination->GetVoidPointer(offset), source->GetVoidPointer(0),
+          framePoints * destination->GetDataTypeSize());
+        }
+      }
+
+    memset(sensorId->GetPointer(offset), static_cast<int>(i), framePoints);
+    offset += framePoints;
+    }
+
+  buffer.VertexIds->SetNumberOfValues(2 * numberOfPoints);
+  vtkIdType* ids = numberOfPoints ? buffer.VertexIds->GetPointer(0) : 0;
+  for (vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+    ids[i*2] = 1;
+    ids[i*2+1] = i;
+    }
+  vtkSmartPointer<vtkCellArray> verts = vtkSmartPointer<vtkCellArray>::New();
+  verts->SetCells(numberOfPoints, buffer.VertexIds);
+  fused->SetVerts(verts);
+
+  vtkNew<vtkDoubleArray> sensorTime;
+  sensorTime->SetName("sensor_time_us");
+  sensorTime->InsertNextValue(this->Internal->FusedTime);
+  vtkNew<vtkUnsignedCharArray> fusedCount;
+  fusedCount->SetName("fused_sensors");
+  fusedCount->InsertNextValue(static_cast<unsigned char>(fusedSensors));
+  vtkNew<vtkFieldData> fieldData;
+  fieldData->AddArray(sensorTime.GetPointer());
+  fieldData->AddArray(fusedCount.GetPointer());
+  fused->SetFieldData(fieldData.GetPointer());
+
+  output->ShallowCopy(fused);
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLFusionSource::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os,indent);
+  os << indent << "NumberOfSources: " << this->Internal->Sources.size() << endl;
+  os << indent << "MaxTimeDifference: " << this->MaxTimeDifference << endl;
+  os << indent << "LatencyBudget: " << this->LatencyBudget << endl;
+  os << indent << "PreallocatedPoints: " << this->PreallocatedPoints << endl;
+}
@@ -0,0 +1,118 @@
+// Copyright 2013 Velodyne Acoustics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkVelodyneHDLFusionSource.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkVelodyneHDLFusionSource - fuses the frames of several sensors
+// .SECTION Description
+// Aligns the revolutions of several vtkVelodyneHDLSource instances by
+// sensor time and merges them into one point cloud.  The first source is
+// the reference: every new frame of it is fused with the frame of each
+// other source whose sensor time is within MaxTimeDifference.  If another
+// sensor has not delivered that revolution yet, the fusion waits at most
+// LatencyBudget seconds and then publishes without it.
+//
+// The calibration of each sensor is applied while decoding: its intrinsic
+// by the corrections file of its source (see
+// vtkVelodyneHDLSource::SetCorrectionsFile), which every source keeps for
+// itself, and its extrinsic by vtkVelodyneHDLSource::SetSensorTransform.
+// So fusion only concatenates.
+//
+// The output is one point cloud with contiguous arrays, so the points of
+// every sensor are copied into it once.  The sensor frames cannot be
+// appended to in place, since they are also held by the frame cache of
+// their source and by its other consumers.  The output arrays come from
+// two buffers used in turn, which only grow, so steady state fusion does
+// not allocate as long as nobody keeps an output past the next one.
+//
+// The point array "sensor_id" holds the index of the source of each point
+// and the field data array "fused_sensors" the number of sources in the
+// frame.
+
+#ifndef __vtkVelodyneHDLFusionSource_h
+#define __vtkVelodyneHDLFusionSource_h
+
+#include <vtkPolyDataAlgorithm.h>
+
+class vtkVelodyneHDLSource;
+
+class vtkVelodyneHDLFusionSource : public vtkPolyDataAlgorithm
+{
+public:
+  vtkTypeMacro(vtkVelodyneHDLFusionSource, vtkPolyDataAlgorithm);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  static vtkVelodyneHDLFusionSource *New();
+
+  void AddSource(vtkVelodyneHDLSource* source);
+  void RemoveAllSources();
+  int GetNumberOfSources();
+
+  // Description:
+  // Checks the sources for a new reference revolution and marks the
+  // algorithm modified when a fused frame is ready.  Returns true in that
+  // case.  Call it at the rate frames are consumed, like
+  // vtkVelodyneHDLSource::Poll().
+  bool Poll();
+
+  // Description:
+  // Largest sensor time difference, in seconds, between the reference
+  // frame and a frame fused with it.
+  vtkSetMacro(MaxTimeDifference, double);
+  vtkGetMacro(MaxTimeDifference, double);
+
+  // Description:
+  // Longest time, in seconds, to wait for a sensor that lags behind the
+  // reference sensor before publishing a partial fused frame.
+  vtkSetMacro(LatencyBudget, double);
+  vtkGetMacro(LatencyBudget, double);
+
+  // Description:
+  // Number of points reserved in the output arrays up front.
+  vtkSetMacro(PreallocatedPoints, int);
+  vtkGetMacro(PreallocatedPoints, int);
+
+protected:
+
+  virtual int RequestData(vtkInformation *request,
+                          vtkInformationVector **inputVector,
+                          vtkInformationVector *outputVector);
+
+  vtkVelodyneHDLFusionSource();
+  virtual ~vtkVelodyneHDLFusionSource();
+
+  double MaxTimeDifference;
+  double LatencyBudget;
+  int PreallocatedPoints;
+
+private:
+  vtkVelodyneHDLFusionSource(const vtkVelodyneHDLFusionSource&);  // Not implemented.
+  void operator=(const vtkVelodyneHDLFusionSource&);  // Not implemented.
+
+  class vtkInternal;
+  vtkInternal * Internal;
+};
+
+#endif
@@ -41,22 +41,33 @@
 #include "vtkFloatArray.h"
 
 #include "vtkPolyData.h"
+#include "vtkFieldData.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkObjectFactory.h"
 #include "vtkPointData.h"
 #include "vtkMath.h"
+#include "vtkMatrix4x4.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
+#include "vtkFrameBufferPool.h"
 #include "vtkPacketFileReader.h"
+#include "vtkSensorClock.h"
 #include "vtkPacketFileWriter.h"
+#include "vtkArrowFrameWriter.h"
 
 #include <sstream>
 #include <algorithm>
+#include <bitset>
 #include <cmath>
+#include <cstring>
+#include <deque>
 
 
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/once.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 
@@ -130,9 +141,208 @@ struct HDLRGB
   uint8_t b;
 };
 
-double *cos_lookup_table_;
-double *sin_lookup_table_;
-HDLLaserCorrection laser_corrections_[HDL_MAX_NUM_LASERS];
+// Cosine and sine of every azimuth in hundredths of a degree, interleaved
+// so that a point reads both from one cache line.  The tables are static
+// and cache line aligned, each is filled once on first use.
+template<typename T>
+struct HDLTrigPair
+{
+  T Cos;
+  T Sin;
+};
+
+#ifdef _MSC_VER
+# define HDL_CACHE_ALIGNED __declspec(align(64))
+#else
+# define HDL_CACHE_ALIGNED __attribute__((aligned(64)))
+#endif
+
+HDL_CACHE_ALIGNED HDLTrigPair<float> trig_lookup_table_[HDL_NUM_ROT_ANGLES];
+HDL_CACHE_ALIGNED HDLTrigPair<double> trig_lookup_table_double_[HDL_NUM_ROT_ANGLES];
+boost::once_flag trig_lookup_table_once_ = BOOST_ONCE_INIT;
+boost::once_flag trig_lookup_table_double_once_ = BOOST_ONCE_INIT;
+
+template<typename T>
+void FillTrigTable(HDLTrigPair<T>* table)
+{
+  for (int i = 0; i < HDL_NUM_ROT_ANGLES; ++i)
+    {
+    const double rad = HDL_Grabber_toRadians(i / 100.0);
+    table[i].Cos = static_cast<T>(std::cos(rad));
+    table[i].Sin = static_cast<T>(std::sin(rad));
+    }
+}
+
+void FillTrigTableFloat()
+{
+  FillTrigTable(trig_lookup_table_);
+}
+
+void FillTrigTableDouble()
+{
+  FillTrigTable(trig_lookup_table_double_);
+}
+
+const int HDL_PACKET_VALID = -1;
+const unsigned short HDL_MAX_AZIMUTH = 35999;
+const unsigned int HDL_MICROSECONDS_PER_HOUR = 3600000000u;
+
+// Largest azimuth advance from one firing to the next, in hundredths of a
+// degree.  Firings are a fraction of a degree apart at any rotation rate,
+// and the upper and lower blocks of a 64 laser sensor share their azimuth.
+const unsigned int HDL_MAX_AZIMUTH_STEP = 1000;
+
+// Cheap checks run before decoding, so that foreign or corrupted packets
+// of the right size do not turn into garbage points.  Returns the reject
+// reason or HDL_PACKET_VALID.
+int ValidateHDLPacket(const unsigned char* data, std::size_t length)
+{
+  if (length != 1206)
+    {
+    return vtkVelodyneHDLReader::REJECT_LENGTH;
+    }
+
+  const HDLDataPacket* dataPacket = reinterpret_cast<const HDLDataPacket*>(data);
+  unsigned int lastAzimuth = 0;
+  for (int i = 0; i < HDL_FIRING_PER_PKT; ++i)
+    {
+    const HDLFiringData& firingData = dataPacket->firingData[i];
+    if (firingData.blockIdentifier != BLOCK_0_TO_31 && firingData.blockIdentifier != BLOCK_32_TO_63)
+      {
+      return vtkVelodyneHDLReader::REJECT_BLOCK_ID;
+      }
+    if (firingData.rotationalPosition > HDL_MAX_AZIMUTH)
+      {
+      return vtkVelodyneHDLReader::REJECT_AZIMUTH_RANGE;
+      }
+
+    // the azimuth wraps around at most once per packet, which is a small
+    // step modulo a full turn
+    const unsigned int azimuth = firingData.rotationalPosition;
+    if (i && (azimuth + HDL_MAX_AZIMUTH + 1 - lastAzimuth) % (HDL_MAX_AZIMUTH + 1) > HDL_MAX_AZIMUTH_STEP)
+      {
+      return vtkVelodyneHDLReader::REJECT_AZIMUTH_ORDER;
+      }
+    lastAzimuth = azimuth;
+    }
+
+  if (dataPacket->gpsTimestamp >= HDL_MICROSECONDS_PER_HOUR)
+    {
+    return vtkVelodyneHDLReader::REJECT_TIMESTAMP;
+    }
+  return HDL_PACKET_VALID;
+}
+
+const double HDL_MICROSECONDS_PER_HALF_HOUR = 1800e6;
+
+// Orders two packets by sensor time, across the hourly rollover, then by
+// the azimuth of their first firing.  Returns a negative value, 0 or a
+// positive value like strcmp.
+int CompareHDLPackets(unsigned int timestampA, unsigned short azimuthA,
+                      unsigned int timestampB, unsigned short azimuthB)
+{
+  if (timestampA != timestampB)
+    {
+    double difference = static_cast<double>(timestampA) - timestampB;
+    if (difference > HDL_MICROSECONDS_PER_HALF_HOUR)
+      {
+      difference -= 2 * HDL_MICROSECONDS_PER_HALF_HOUR;
+      }
+    else if (difference < -HDL_MICROSECONDS_PER_HALF_HOUR)
+      {
+      difference += 2 * HDL_MICROSECONDS_PER_HALF_HOUR;
+      }
+    return difference < 0 ? -1 : 1;
+    }
+  return static_cast<int>(azimuthA) - static_cast<int>(azimuthB);
+}
+
+enum ReorderResult
+{
+  REORDER_IN_ORDER = 0,
+  REORDER_REORDERED,
+  REORDER_DUPLICATE,
+  REORDER_LATE
+};
+
+// Turns the sensor time, in microseconds past the hour, into a time that
+// keeps increasing across the hourly rollover.  A packet more than half an
+// hour behind the previous one starts the next hour, one more than half an
+// hour ahead is a late packet of the previous hour and leaves the hour
+// unchanged.
+struct SensorTimeTracker
+{
+  SensorTimeTracker()
+  {
+    this->HourBase = 0;
+    this->SeedTime = 0;
+    this->Last = 0;
+    this->HasLast = false;
+    this->HasSeed = false;
+  }
+
+  void Reset()
+  {
+    this->HasLast = false;
+    this->HasSeed = false;
+  }
+
+  // The next packet is placed in the hour that brings it nearest to time.
+  void Seed(double time)
+  {
+    this->SeedTime = time;
+    this->HasSeed = true;
+    this->HasLast = false;
+  }
+
+  // Moves the time origin, for example once an absolute time is known.
+  void Shift(double delta)
+  {
+    this->HourBase += delta;
+    this->SeedTime += delta;
+  }
+
+  double Peek(unsigned int timestamp) const
+  {
+    const double time = timestamp;
+    if (!this->HasLast)
+      {
+      if (this->HasSeed)
+        {
+        return std::floor((this->SeedTime - time) / HDL_MICROSECONDS_PER_HOUR + 0.5) * HDL_MICROSECONDS_PER_HOUR + time;
+        }
+      return this->HourBase + time;
+      }
+    if (time + HDL_MICROSECONDS_PER_HALF_HOUR < this->Last)
+      {
+      return this->HourBase + HDL_MICROSECONDS_PER_HOUR + time;
+      }
+    if (time > this->Last + HDL_MICROSECONDS_PER_HALF_HOUR)
+      {
+      return this->HourBase - HDL_MICROSECONDS_PER_HOUR + time;
+      }
+    return this->HourBase + time;
+  }
+
+  double Update(unsigned int timestamp)
+  {
+    const double time = this->Peek(timestamp);
+    if (!this->HasLast || timestamp <= this->Last + HDL_MICROSECONDS_PER_HALF_HOUR)
+      {
+      this->HourBase = time - timestamp;
+      this->Last = timestamp;
+      this->HasLast = true;
+      this->HasSeed = false;
+      }
+    return time;
+  }
+
+  double HourBase;
+  double SeedTime;
+  double Last;
+  bool HasLast;
+  bool HasSeed;
+};
 }
 
 //-----------------------------------------------------------------------------
@@ -144,7 +354,23 @@ public:
   {
     this->Skip = 0;
     this->LastAzimuth = 0;
+    this->FrameTimestamp = 0;
+    this->FrameTime = 0;
+    this->HasFrameTimestamp = false;
+    this->HasSensorTransform = false;
     this->Reader = 0;
+    this->BufferPool.reset(new vtkFrameBufferPool);
+    this->ExpectedPoints = 0;
+    this->IndexComplete = false;
+    this->IndexStarted = false;
+    this->IndexAzimuth = 0;
+    this->IndexLastTime = -1;
+    this->IndexAnchored = false;
+    this->HasReleasedPacket = false;
+    this->ReleasedTimestamp = 0;
+    this->ReleasedAzimuth = 0;
+    this->PublishBins = 0;
+    this->SkipToWrap = false;
     this->Init();
   }
 
@@ -161,13 +387,67 @@ public:
 
 
   unsigned int LastAzimuth;
+  unsigned int FrameTimestamp;
+  double FrameTime;
+  bool HasFrameTimestamp;
+  SensorTimeTracker TimeTracker;
+
+  // One degree azimuth bins hit by the firings of the frame in progress.
+  enum { AZIMUTH_COVERAGE_BINS = 360 };
+  std::bitset<AZIMUTH_COVERAGE_BINS> Coverage;
+
+  // Bins hit that end a frame before the wrap, 0 to wait for the wrap.
+  // Once such a frame ended, the firings up to the wrap are skipped.
+  int PublishBins;
+  bool SkipToWrap;
+
+  vtkSmartPointer<vtkMatrix4x4> SensorTransformMatrix;
+  double SensorTransform[12];
+  bool HasSensorTransform;
 
   std::vector<fpos_t> FilePositions;
   std::vector<int> Skips;
+  std::vector<double> FrameTimes;
+  std::vector<vtkIdType> FramePoints;
   int Skip;
   vtkPacketFileReader* Reader;
 
-  void SplitFrame();
+  boost::shared_ptr<vtkFrameBufferPool> BufferPool;
+  vtkIdType ExpectedPoints;
+
+  // State of an interrupted ReadFrameInformation(), which resumes from here.
+  bool IndexComplete;
+  bool IndexStarted;
+  fpos_t IndexPosition;
+  unsigned int IndexAzimuth;
+  double IndexLastTime;
+  SensorTimeTracker IndexTracker;
+  vtkSensorClock IndexClock;
+  bool IndexAnchored;
+
+  // Packets held back by the reorder window.  ReorderPending holds the
+  // indices of the used slots sorted by sensor time and azimuth; the slots
+  // are allocated when the window size is set.
+  struct ReorderSlot
+  {
+    unsigned int Timestamp;
+    unsigned short Azimuth;
+    unsigned char Data[1206];
+  };
+  std::vector<ReorderSlot> ReorderSlots;
+  std::vector<int> ReorderPending;
+  std::vector<int> ReorderFree;
+  bool HasReleasedPacket;
+  unsigned int ReleasedTimestamp;
+  unsigned short ReleasedAzimuth;
+
+  void SetReorderWindow(int window);
+  int PushReorderWindow(const unsigned char* data);
+  void ReleaseReorderedPacket();
+  void FlushReorderWindow();
+  void ClearReorderWindow();
+
+  void SplitFrame(bool wrapped = true);
   vtkSmartPointer<vtkPolyData> CreateData(vtkIdType numberOfPoints);
   vtkSmartPointer<vtkCellArray> NewVertexCells(vtkIdType numberOfVerts);
 
@@ -176,6 +456,13 @@ public:
   void SetCorrectionsCommon();
   void Init();
   void InitTables();
+  void SetDoublePrecisionTrig(bool enable);
+
+  // Trig table of the double precision path, NULL for the float table.
+  const HDLTrigPair<double>* TrigTableDouble;
+
+  // Intrinsic calibration of the sensor read by this reader.
+  HDLLaserCorrection LaserCorrections[HDL_MAX_NUM_LASERS];
   void ProcessHDLPacket(unsigned char *data, std::size_t bytesReceived);
 };
 
@@ -186,6 +473,13 @@ vtkStandardNewMacro(vtkVelodyneHDLReader);
 vtkVelodyneHDLReader::vtkVelodyneHDLReader()
 {
   this->Internal = new vtkInternal;
+  this->ValidatePackets = 1;
+  this->DoublePrecisionTrig = 0;
+  this->NumberOfDecodeThreads = 1;
+  this->ReorderWindow = 0;
+  this->PublishCoverage = 0;
+  this->TimeAnchor = TIME_ANCHOR_NONE;
+  this->ResetPacketStatistics();
   this->UnloadData();
   this->SetNumberOfInputPorts(0);
   this->SetNumberOfOutputPorts(1);
@@ -194,6 +488,7 @@ vtkVelodyneHDLReader::vtkVelodyneHDLReader()
 //-----------------------------------------------------------------------------
 vtkVelodyneHDLReader::~vtkVelodyneHDLReader()
 {
+  this->Close();
   delete this->Internal;
 }
 
@@ -211,9 +506,14 @@ void vtkVelodyneHDLReader::SetFileName(const std::string& filename)
     return;
     }
 
+  this->Close();
   this->FileName = filename;
   this->Internal->FilePositions.clear();
   this->Internal->Skips.clear();
+  this->Internal->FrameTimes.clear();
+  this->Internal->FramePoints.clear();
+  this->Internal->IndexComplete = false;
+  this->Internal->IndexStarted = false;
   this->UnloadData();
   this->Modified();
 }
@@ -246,10 +546,57 @@ void vtkVelodyneHDLReader::SetCorrectionsFile(const std::string& correctionsFile
   this->Modified();
 }
 
+//-----------------------------------------------------------------------------
+vtkMatrix4x4* vtkVelodyneHDLReader::GetSensorTransform()
+{
+  return this->Internal->SensorTransformMatrix;
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::SetSensorTransform(vtkMatrix4x4* matrix)
+{
+  if (!matrix)
+    {
+    if (!this->Internal->SensorTransformMatrix)
+      {
+      return;
+      }
+    this->Internal->SensorTransformMatrix = 0;
+    this->Internal->HasSensorTransform = false;
+    }
+  else
+    {
+    if (!this->Internal->SensorTransformMatrix)
+      {
+      this->Internal->SensorTransformMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      }
+    this->Internal->SensorTransformMatrix->DeepCopy(matrix);
+
+    bool isIdentity = true;
+    for (int i = 0; i < 3; ++i)
+      {
+      for (int j = 0; j < 4; ++j)
+        {
+        this->Internal->SensorTransform[i*4 + j] = matrix->GetElement(i, j);
+        isIdentity = isIdentity && (matrix->GetElement(i, j) == (i == j ? 1.0 : 0.0));
+        }
+      }
+    this->Internal->HasSensorTransform = !isIdentity;
+    }
+
+  this->UnloadData();
+  this->Modified();
+}
+
 //-----------------------------------------------------------------------------
 void vtkVelodyneHDLReader::UnloadData()
 {
+  this->Internal->ClearReorderWindow();
   this->Internal->LastAzimuth = 0;
+  this->Internal->HasFrameTimestamp = false;
+  this->Internal->Coverage.reset();
+  this->Internal->SkipToWrap = false;
+  this->Internal->TimeTracker.Reset();
   this->Internal->Datasets.clear();
   this->Internal->CurrentDataset = this->Internal->CreateData(0);
 }
@@ -306,9 +653,18 @@ int vtkVelodyneHDLReader::RequestData(vtkInformation *request,
     return 0;
     }
 
-  this->Open();
+  // the file stays open for the next time step, until the file name
+  // changes or the reader is deleted
+  if (!this->Internal->Reader)
+    {
+    this->Open();
+    }
+  if (!this->Internal->Reader)
+    {
+    output->ShallowCopy(this->Internal->CreateData(0));
+    return 0;
+    }
   output->ShallowCopy(this->GetFrame(timestep));
-  this->Close();
   return 1;
 }
 
@@ -317,7 +673,7 @@ int vtkVelodyneHDLReader::RequestInformation(vtkInformation *request,
                                      vtkInformationVector **inputVector,
                                      vtkInformationVector *outputVector)
 {
-  if (this->FileName.length() && !this->Internal->FilePositions.size())
+  if (this->FileName.length() && !this->Internal->IndexComplete)
     {
     this->ReadFrameInformation();
     }
@@ -333,6 +689,13 @@ void vtkVelodyneHDLReader::PrintSelf(ostream& os, vtkIndent indent)
   this->Superclass::PrintSelf(os, indent);
   os << indent << "FileName: " << this->FileName << endl;
   os << indent << "CorrectionsFile: " << this->CorrectionsFile << endl;
+  os << indent << "ValidatePackets: " << this->ValidatePackets << endl;
+  os << indent << "DoublePrecisionTrig: " << this->DoublePrecisionTrig << endl;
+  os << indent << "NumberOfDecodeThreads: " << this->NumberOfDecodeThreads << endl;
+  os << indent << "TimeAnchor: " << this->TimeAnchor << endl;
+  os << indent << "ReorderWindow: " << this->ReorderWindow << endl;
+  os << indent << "PublishCoverage: " << this->PublishCoverage << endl;
+  os << indent << "AcceptedPackets: " << this->AcceptedPackets << endl;
 }
 
 //-----------------------------------------------------------------------------
@@ -344,15 +707,223 @@ int vtkVelodyneHDLReader::CanReadFile(const char *fname)
 //-----------------------------------------------------------------------------
 void vtkVelodyneHDLReader::ProcessHDLPacket(unsigned char *data, unsigned int bytesReceived)
 {
+  if (bytesReceived == vtkSensorClock::POSITION_PACKET_SIZE)
+    {
+    // interleaved with the data in packet files, not a malformed packet
+    return;
+    }
+
+  if (this->ValidatePackets)
+    {
+    const int reason = ValidateHDLPacket(data, bytesReceived);
+    if (reason != HDL_PACKET_VALID)
+      {
+      ++this->RejectedPackets[reason];
+      return;
+      }
+    ++this->AcceptedPackets;
+    }
+
+  if (this->ReorderWindow > 0 && bytesReceived == 1206)
+    {
+    switch (this->Internal->PushReorderWindow(data))
+      {
+      case REORDER_REORDERED:
+        ++this->ReorderedPackets;
+        break;
+      case REORDER_DUPLICATE:
+        ++this->DuplicatePackets;
+        break;
+      case REORDER_LATE:
+        ++this->LatePackets;
+        break;
+      }
+    return;
+    }
+
   this->Internal->ProcessHDLPacket(data, bytesReceived);
 }
 
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::SetDoublePrecisionTrig(int enable)
+{
+  enable = enable ? 1 : 0;
+  if (enable == this->DoublePrecisionTrig)
+    {
+    return;
+    }
+
+  this->DoublePrecisionTrig = enable;
+  this->Internal->SetDoublePrecisionTrig(enable != 0);
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::SetReorderWindow(int window)
+{
+  window = std::max(0, std::min(window, 64));
+  if (window == this->ReorderWindow)
+    {
+    return;
+    }
+
+  // held back packets are decoded before the window changes
+  this->Internal->FlushReorderWindow();
+  this->ReorderWindow = window;
+  this->Internal->SetReorderWindow(window);
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::FlushReorderWindow()
+{
+  this->Internal->FlushReorderWindow();
+}
+
+//-----------------------------------------------------------------------------
+bool vtkVelodyneHDLReader::PublishPartialFrame()
+{
+  const size_t nDatasets = this->Internal->Datasets.size();
+  this->Internal->FlushReorderWindow();
+  if (this->Internal->CurrentDataset->GetNumberOfPoints())
+    {
+    this->Internal->SplitFrame(false);
+    }
+
+  // the packets that follow start a new frame wherever the azimuth is
+  this->Internal->LastAzimuth = 0;
+  this->Internal->SkipToWrap = false;
+  return this->Internal->Datasets.size() > nDatasets;
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::SetPublishCoverage(double coverage)
+{
+  coverage = std::max(0.0, std::min(coverage, 1.0));
+  if (coverage == this->PublishCoverage)
+    {
+    return;
+    }
+
+  this->PublishCoverage = coverage;
+  this->Internal->PublishBins = static_cast<int>(
+    std::ceil(coverage * vtkInternal::AZIMUTH_COVERAGE_BINS - 1e-9));
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLReader::GetNumberOfReorderedPackets()
+{
+  return this->ReorderedPackets;
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLReader::GetNumberOfDuplicatePackets()
+{
+  return this->DuplicatePackets;
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLReader::GetNumberOfLatePackets()
+{
+  return this->LatePackets;
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLReader::GetNumberOfAcceptedPackets()
+{
+  return this->AcceptedPackets;
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLReader::GetNumberOfRejectedPackets(int reason)
+{
+  if (reason < 0 || reason >= NUMBER_OF_REJECT_REASONS)
+    {
+    return 0;
+    }
+  return this->RejectedPackets[reason];
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::ResetPacketStatistics()
+{
+  this->AcceptedPackets = 0;
+  this->ReorderedPackets = 0;
+  this->DuplicatePackets = 0;
+  this->LatePackets = 0;
+  for (int i = 0; i < NUMBER_OF_REJECT_REASONS; ++i)
+    {
+    this->RejectedPackets[i] = 0;
+    }
+}
+
 //-----------------------------------------------------------------------------
 std::vector<vtkSmartPointer<vtkPolyData> >& vtkVelodyneHDLReader::GetDatasets()
 {
   return this->Internal->Datasets;
 }
 
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::SetTimeAnchor(int anchor)
+{
+  if (anchor == this->TimeAnchor)
+    {
+    return;
+    }
+
+  // the frame times of the index depend on the anchor
+  this->TimeAnchor = anchor;
+  this->Internal->FilePositions.clear();
+  this->Internal->Skips.clear();
+  this->Internal->FrameTimes.clear();
+  this->Internal->FramePoints.clear();
+  this->Internal->IndexComplete = false;
+  this->Internal->IndexStarted = false;
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+double vtkVelodyneHDLReader::GetFrameTime(int frameNumber)
+{
+  if (frameNumber < 0 || static_cast<size_t>(frameNumber) >= this->Internal->FrameTimes.size())
+    {
+    return -1;
+    }
+  return this->Internal->FrameTimes[frameNumber];
+}
+
+//-----------------------------------------------------------------------------
+int vtkVelodyneHDLReader::GetFrameForTime(double time)
+{
+  const std::vector<double>& frameTimes = this->Internal->FrameTimes;
+  if (frameTimes.empty())
+    {
+    return -1;
+    }
+
+  // frame times increase, the frame holding time is the last one starting
+  // at or before it
+  std::vector<double>::const_iterator it = std::upper_bound(frameTimes.begin(), frameTimes.end(), time);
+  if (it == frameTimes.begin())
+    {
+    return 0;
+    }
+  return static_cast<int>(it - frameTimes.begin()) - 1;
+}
+
+//-----------------------------------------------------------------------------
+vtkFrameBufferPool* vtkVelodyneHDLReader::GetFrameBufferPool()
+{
+  return this->Internal->BufferPool.get();
+}
+
+//-----------------------------------------------------------------------------
+bool vtkVelodyneHDLReader::IsIndexComplete()
+{
+  return this->Internal->IndexComplete;
+}
+
 //-----------------------------------------------------------------------------
 int vtkVelodyneHDLReader::GetNumberOfFrames()
 {
@@ -438,22 +1009,60 @@ void vtkVelodyneHDLReader::DumpFrames(int startFrame, int endFrame, const std::s
 }
 
 //-----------------------------------------------------------------------------
-vtkSmartPointer<vtkPolyData> vtkVelodyneHDLReader::GetFrame(int frameNumber)
+void vtkVelodyneHDLReader::ExportFramesToArrow(int startFrame, int endFrame, const std::string& filename)
 {
-  this->UnloadData();
   if (!this->Internal->Reader)
     {
-    vtkErrorMacro("GetFrame() called but packet file reader is not open.");
-    return 0;
+    vtkErrorMacro("ExportFramesToArrow() called but packet file reader is not open.");
+    return;
     }
 
-  const unsigned char* data = 0;
-  unsigned int dataLength = 0;
-  double timeSinceStart = 0;
-
+  vtkArrowFrameWriter writer;
+  if (!writer.Open(filename, vtkArrowFrameWriter::GetFormatForFileName(filename)))
+    {
+    vtkErrorMacro("Failed to open arrow file for writing: " << filename);
+    return;
+    }
 
-  this->Internal->Reader->SetFilePosition(&this->Internal->FilePositions[frameNumber]);
+  endFrame = std::min(endFrame, this->GetNumberOfFrames() - 1);
+  for (int frameNumber = std::max(startFrame, 0); frameNumber <= endFrame; ++frameNumber)
+    {
+    if (!writer.WriteFrame(this->GetFrame(frameNumber)))
+      {
+      vtkErrorMacro("Failed to write frame " << frameNumber << " to " << filename << ": " << writer.GetLastError());
+      break;
+      }
+    }
+
+  writer.Close();
+}
+
+//-----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> vtkVelodyneHDLReader::GetFrame(int frameNumber)
+{
+  this->UnloadData();
+  if (!this->Internal->Reader)
+    {
+    vtkErrorMacro("GetFrame() called but packet file reader is not open.");
+    return 0;
+    }
+
+  if (this->NumberOfDecodeThreads > 1 && this->ReorderWindow == 0)
+    {
+    return this->GetFrameParallel(frameNumber);
+    }
+
+  const unsigned char* data = 0;
+  unsigned int dataLength = 0;
+  double timeSinceStart = 0;
+
+
+  this->Internal->Reader->SetFilePosition(&this->Internal->FilePositions[frameNumber]);
   this->Internal->Skip = this->Internal->Skips[frameNumber];
+  if (static_cast<size_t>(frameNumber) < this->Internal->FrameTimes.size())
+    {
+    this->Internal->TimeTracker.Seed(this->Internal->FrameTimes[frameNumber]);
+    }
 
   while (this->Internal->Reader->NextPacket(data, dataLength, timeSinceStart))
     {
@@ -465,10 +1074,63 @@ vtkSmartPointer<vtkPolyData> vtkVelodyneHDLReader::GetFrame(int frameNumber)
       }
     }
 
-  this->Internal->SplitFrame();
+  this->Internal->FlushReorderWindow();
+  if (this->Internal->Datasets.size())
+    {
+    return this->Internal->Datasets.back();
+    }
+  this->Internal->SplitFrame(false);
   return this->Internal->Datasets.back();
 }
 
+//-----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> vtkVelodyneHDLReader::DecodeFrame(const std::string& packets, double frameTime,
+  bool partial)
+{
+  this->UnloadData();
+  if (frameTime >= 0)
+    {
+    this->Internal->TimeTracker.Seed(frameTime);
+    }
+
+  const size_t packetSize = 1206;
+  for (size_t offset = 0; offset + packetSize <= packets.size(); offset += packetSize)
+    {
+    this->ProcessHDLPacket(reinterpret_cast<unsigned char*>(const_cast<char*>(packets.data() + offset)), packetSize);
+    }
+  if (partial)
+    {
+    this->PublishPartialFrame();
+    }
+  else
+    {
+    this->Internal->FlushReorderWindow();
+    }
+
+  // the first packet may also complete the tail of the previous frame,
+  // the requested frame is the one completed last
+  vtkSmartPointer<vtkPolyData> frame;
+  if (this->Internal->Datasets.size())
+    {
+    frame = this->Internal->Datasets.back();
+    }
+  this->UnloadData();
+  return frame;
+}
+
+//-----------------------------------------------------------------------------
+namespace
+{
+template<typename ValueType>
+void ReserveArray(vtkFrameBufferPool* pool, vtkDataArrayTemplate<ValueType>* array, vtkIdType capacity)
+{
+  if (array && pool->Attach(array, capacity))
+    {
+    array->Reset();
+    }
+}
+}
+
 //-----------------------------------------------------------------------------
 vtkSmartPointer<vtkPolyData> vtkVelodyneHDLReader::vtkInternal::CreateData(vtkIdType numberOfPoints)
 {
@@ -518,6 +1180,19 @@ vtkSmartPointer<vtkPolyData> vtkVelodyneHDLReader::vtkInternal::CreateData(vtkId
   this->Distance = distance.GetPointer();
   this->Timestamp = timestamp.GetPointer();
 
+  if (numberOfPoints == 0 && this->ExpectedPoints && this->BufferPool->IsEnabled())
+    {
+    // consecutive frames have about the same size, so a new frame reserves
+    // a little more than the previous one from the pool instead of growing
+    const vtkIdType capacity = this->ExpectedPoints + this->ExpectedPoints / 8;
+    ReserveArray(this->BufferPool.get(), vtkFloatArray::SafeDownCast(points->GetData()), capacity * 3);
+    ReserveArray(this->BufferPool.get(), intensity.GetPointer(), capacity);
+    ReserveArray(this->BufferPool.get(), laserId.GetPointer(), capacity);
+    ReserveArray(this->BufferPool.get(), azimuth.GetPointer(), capacity);
+    ReserveArray(this->BufferPool.get(), distance.GetPointer(), capacity);
+    ReserveArray(this->BufferPool.get(), timestamp.GetPointer(), capacity);
+    }
+
   return polyData;
 }
 
@@ -525,7 +1200,10 @@ vtkSmartPointer<vtkPolyData> vtkVelodyneHDLReader::vtkInternal::CreateData(vtkId
 vtkSmartPointer<vtkCellArray> vtkVelodyneHDLReader::vtkInternal::NewVertexCells(vtkIdType numberOfVerts)
 {
   vtkNew<vtkIdTypeArray> cells;
-  cells->SetNumberOfValues(numberOfVerts*2);
+  if (!this->BufferPool->IsEnabled() || !this->BufferPool->Attach(cells.GetPointer(), numberOfVerts*2))
+    {
+    cells->SetNumberOfValues(numberOfVerts*2);
+    }
   vtkIdType* ids = cells->GetPointer(0);
   for (vtkIdType i = 0; i < numberOfVerts; ++i)
     {
@@ -541,13 +1219,22 @@ vtkSmartPointer<vtkCellArray> vtkVelodyneHDLReader::vtkInternal::NewVertexCells(
 
 namespace
 {
-void PushFiringData(vtkPolyData* polyData, unsigned char laserId, unsigned short azimuth, unsigned int timestamp, HDLLaserReturn laserReturn, HDLLaserCorrection correction, vtkVelodyneHDLReader::vtkInternal* internal)
+// Position of a laser return in meters, in world coordinates when the
+// reader has a sensor transform.
+void ComputeFiringPoint(unsigned short azimuth, const HDLLaserReturn& laserReturn,
+  const HDLLaserCorrection& correction, const vtkVelodyneHDLReader::vtkInternal* internal,
+  double point[3], double& distanceM)
 {
   double cosAzimuth, sinAzimuth;
-  if (correction.azimuthCorrection == 0)
+  if (correction.azimuthCorrection == 0 && internal->TrigTableDouble)
   {
-    cosAzimuth = cos_lookup_table_[azimuth];
-    sinAzimuth = sin_lookup_table_[azimuth];
+    cosAzimuth = internal->TrigTableDouble[azimuth].Cos;
+    sinAzimuth = internal->TrigTableDouble[azimuth].Sin;
+  }
+  else if (correction.azimuthCorrection == 0)
+  {
+    cosAzimuth = trig_lookup_table_[azimuth].Cos;
+    sinAzimuth = trig_lookup_table_[azimuth].Sin;
   }
   else
   {
@@ -556,41 +1243,495 @@ void PushFiringData(vtkPolyData* polyData, unsigned char laserId, unsigned short
     sinAzimuth = std::sin (azimuthInRadians);
   }
 
-  double distanceM = laserReturn.distance * 0.002 + correction.distanceCorrection;
+  distanceM = laserReturn.distance * 0.002 + correction.distanceCorrection;
   double xyDistance = distanceM * correction.cosVertCorrection - correction.sinVertOffsetCorrection;
 
   double x = (xyDistance * sinAzimuth - correction.horizontalOffsetCorrection * cosAzimuth);
   double y = (xyDistance * cosAzimuth + correction.horizontalOffsetCorrection * sinAzimuth);
   double z = (distanceM * correction.sinVertCorrection + correction.cosVertOffsetCorrection);
-  unsigned char intensity = laserReturn.intensity;
 
-  internal->Points->InsertNextPoint(x,y,z);
-  internal->Intensity->InsertNextValue(intensity);
+  if (internal->HasSensorTransform)
+    {
+    const double* m = internal->SensorTransform;
+    const double sensorX = x;
+    const double sensorY = y;
+    const double sensorZ = z;
+    x = m[0] * sensorX + m[1] * sensorY + m[2] * sensorZ + m[3];
+    y = m[4] * sensorX + m[5] * sensorY + m[6] * sensorZ + m[7];
+    z = m[8] * sensorX + m[9] * sensorY + m[10] * sensorZ + m[11];
+    }
+
+  point[0] = x;
+  point[1] = y;
+  point[2] = z;
+}
+
+void PushFiringData(vtkPolyData* polyData, unsigned char laserId, unsigned short azimuth, unsigned int timestamp, HDLLaserReturn laserReturn, HDLLaserCorrection correction, vtkVelodyneHDLReader::vtkInternal* internal)
+{
+  double point[3];
+  double distanceM = 0;
+  ComputeFiringPoint(azimuth, laserReturn, correction, internal, point, distanceM);
+
+  internal->Points->InsertNextPoint(point);
+  internal->Intensity->InsertNextValue(laserReturn.intensity);
   internal->LaserId->InsertNextValue(laserId);
   internal->Azimuth->InsertNextValue(azimuth);
   internal->Distance->InsertNextValue(distanceM);
   internal->Timestamp->InsertNextValue(timestamp);
 }
 
+// Arrays of a frame allocated in full, written by the decoding threads at
+// the offsets of their packets.
+struct FrameSlices
+{
+  float* Points;
+  unsigned char* Intensity;
+  unsigned char* LaserId;
+  unsigned short* Azimuth;
+  double* Distance;
+  unsigned int* Timestamp;
+};
+
+// Decodes packets begin to end of a frame read in full.  The first packet
+// of the frame starts at firing firstFiring and the last one ends before
+// firing lastEndFiring, offsets[i] is the first point of packet i.
+void DecodePacketRun(const unsigned char* packets, size_t nPackets, size_t begin, size_t end,
+  int firstFiring, int lastEndFiring, const vtkIdType* offsets, const FrameSlices& slices,
+  const vtkVelodyneHDLReader::vtkInternal* internal)
+{
+  for (size_t p = begin; p < end; ++p)
+    {
+    const HDLDataPacket* dataPacket = reinterpret_cast<const HDLDataPacket*>(packets + p * 1206);
+    const int endFiring = (p + 1 == nPackets) ? lastEndFiring : HDL_FIRING_PER_PKT;
+    vtkIdType id = offsets[p];
+    for (int i = (p == 0) ? firstFiring : 0; i < endFiring; ++i)
+      {
+      const HDLFiringData& firingData = dataPacket->firingData[i];
+      const int offset = (firingData.blockIdentifier == BLOCK_0_TO_31) ? 0 : 32;
+      for (int j = 0; j < HDL_LASER_PER_FIRING; j++)
+        {
+        const HDLLaserReturn& laserReturn = firingData.laserReturns[j];
+        if (laserReturn.distance == 0)
+          {
+          continue;
+          }
+
+        double point[3];
+        double distanceM = 0;
+        ComputeFiringPoint(firingData.rotationalPosition, laserReturn, internal->LaserCorrections[j + offset],
+          internal, point, distanceM);
+        slices.Points[id * 3] = static_cast<float>(point[0]);
+        slices.Points[id * 3 + 1] = static_cast<float>(point[1]);
+        slices.Points[id * 3 + 2] = static_cast<float>(point[2]);
+        slices.Intensity[id] = laserReturn.intensity;
+        slices.LaserId[id] = static_cast<unsigned char>(j + offset);
+        slices.Azimuth[id] = firingData.rotationalPosition;
+        slices.Distance[id] = distanceM;
+        slices.Timestamp[id] = dataPacket->gpsTimestamp;
+        ++id;
+        }
+      }
+    }
+}
+
 }
 
 
 //-----------------------------------------------------------------------------
-void vtkVelodyneHDLReader::vtkInternal::InitTables()
+bool vtkVelodyneHDLReader::ReadFramePackets(vtkPacketFileReader* reader, int frameNumber,
+  std::string& packets, int& lastEndFiring)
 {
-  if (cos_lookup_table_ == NULL && sin_lookup_table_ == NULL)
+  // packets already holds the first packet of the frame when it is the one
+  // the previous frame ended in, which saves the seek
+  if (packets.empty())
+    {
+    reader->SetFilePosition(&this->Internal->FilePositions[frameNumber]);
+    }
+
+  const unsigned char* data = 0;
+  unsigned int dataLength = 0;
+  double timeSinceStart = 0;
+  unsigned int lastAzimuth = 0;
+  for (size_t offset = 0; ; offset += 1206)
     {
-    cos_lookup_table_ = static_cast<double *> (malloc (HDL_NUM_ROT_ANGLES * sizeof (*cos_lookup_table_)));
-    sin_lookup_table_ = static_cast<double *> (malloc (HDL_NUM_ROT_ANGLES * sizeof (*sin_lookup_table_)));
-    for (unsigned int i = 0; i < HDL_NUM_ROT_ANGLES; i++)
+    while (offset == packets.size())
+      {
+      if (!reader->NextPacket(data, dataLength, timeSinceStart))
+        {
+        lastEndFiring = HDL_FIRING_PER_PKT;
+        return false;
+        }
+      if (dataLength == vtkSensorClock::POSITION_PACKET_SIZE)
+        {
+        continue;
+        }
+      if (this->ValidatePackets)
+        {
+        const int reason = ValidateHDLPacket(data, dataLength);
+        if (reason != HDL_PACKET_VALID)
+          {
+          ++this->RejectedPackets[reason];
+          continue;
+          }
+        ++this->AcceptedPackets;
+        }
+      if (dataLength == 1206)
+        {
+        packets.append(reinterpret_cast<const char*>(data), dataLength);
+        }
+      }
+
+    // the frame ends before the firing where the azimuth wraps
+    const HDLDataPacket* dataPacket = reinterpret_cast<const HDLDataPacket*>(packets.data() + offset);
+    for (int i = offset ? 0 : this->Internal->Skips[frameNumber]; i < HDL_FIRING_PER_PKT; ++i)
       {
-      double rad = HDL_Grabber_toRadians(i / 100.0);
-      cos_lookup_table_[i] = std::cos(rad);
-      sin_lookup_table_[i] = std::sin(rad);
+      if (dataPacket->firingData[i].rotationalPosition < lastAzimuth)
+        {
+        lastEndFiring = i;
+        return true;
+        }
+      lastAzimuth = dataPacket->firingData[i].rotationalPosition;
       }
     }
 }
 
+//-----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> vtkVelodyneHDLReader::GetFrameParallel(int frameNumber)
+{
+  const int firstFiring = this->Internal->Skips[frameNumber];
+  if (static_cast<size_t>(frameNumber) < this->Internal->FrameTimes.size())
+    {
+    this->Internal->TimeTracker.Seed(this->Internal->FrameTimes[frameNumber]);
+    }
+
+  std::string packets;
+  int lastEndFiring = HDL_FIRING_PER_PKT;
+  const bool wrapped = this->ReadFramePackets(this->Internal->Reader, frameNumber, packets, lastEndFiring);
+
+  // count the points of every packet so that each one has its slice
+  const size_t nPackets = packets.size() / 1206;
+  std::vector<vtkIdType> offsets(nPackets + 1, 0);
+  for (size_t p = 0; p < nPackets; ++p)
+    {
+    const HDLDataPacket* dataPacket = reinterpret_cast<const HDLDataPacket*>(packets.data() + p * 1206);
+    const double packetTime = this->Internal->TimeTracker.Update(dataPacket->gpsTimestamp);
+    const int endFiring = (p + 1 == nPackets) ? lastEndFiring : HDL_FIRING_PER_PKT;
+    vtkIdType count = 0;
+    for (int i = (p == 0) ? firstFiring : 0; i < endFiring; ++i)
+      {
+      const HDLFiringData& firingData = dataPacket->firingData[i];
+      if (!this->Internal->HasFrameTimestamp)
+        {
+        this->Internal->FrameTimestamp = dataPacket->gpsTimestamp;
+        this->Internal->FrameTime = packetTime;
+        this->Internal->HasFrameTimestamp = true;
+        }
+      this->Internal->Coverage.set(std::min<int>(firingData.rotationalPosition / 100,
+        vtkInternal::AZIMUTH_COVERAGE_BINS - 1));
+      for (int j = 0; j < HDL_LASER_PER_FIRING; j++)
+        {
+        count += (firingData.laserReturns[j].distance != 0) ? 1 : 0;
+        }
+      }
+    offsets[p + 1] = offsets[p] + count;
+    }
+
+  const vtkIdType numberOfPoints = offsets[nPackets];
+  this->Internal->CurrentDataset = this->Internal->CreateData(numberOfPoints);
+  if (numberOfPoints)
+    {
+    FrameSlices slices;
+    slices.Points = static_cast<float*>(this->Internal->Points->GetVoidPointer(0));
+    slices.Intensity = this->Internal->Intensity->GetPointer(0);
+    slices.LaserId = this->Internal->LaserId->GetPointer(0);
+    slices.Azimuth = this->Internal->Azimuth->GetPointer(0);
+    slices.Distance = this->Internal->Distance->GetPointer(0);
+    slices.Timestamp = this->Internal->Timestamp->GetPointer(0);
+
+    // contiguous runs of packets, the calling thread decodes the first
+    const unsigned char* packetData = reinterpret_cast<const unsigned char*>(packets.data());
+    const size_t nThreads = std::min(static_cast<size_t>(this->NumberOfDecodeThreads), nPackets);
+    boost::thread_group threads;
+    for (size_t t = 1; t < nThreads; ++t)
+      {
+      threads.create_thread(boost::bind(&DecodePacketRun, packetData, nPackets,
+        t * nPackets / nThreads, (t + 1) * nPackets / nThreads, firstFiring, lastEndFiring,
+        &offsets[0], boost::cref(slices), this->Internal));
+      }
+    DecodePacketRun(packetData, nPackets, 0, nPackets / nThreads, firstFiring, lastEndFiring,
+      &offsets[0], slices, this->Internal);
+    threads.join_all();
+    }
+
+  this->Internal->SplitFrame(wrapped);
+  return this->Internal->Datasets.back();
+}
+
+//-----------------------------------------------------------------------------
+bool vtkVelodyneHDLReader::GetFrameInfo(int frameNumber, FrameInfo& info)
+{
+  if (frameNumber < 0 || frameNumber >= this->GetNumberOfFrames())
+    {
+    return false;
+    }
+
+  info.FrameNumber = frameNumber;
+  info.Time = this->GetFrameTime(frameNumber);
+  info.NumberOfPoints = (static_cast<size_t>(frameNumber) < this->Internal->FramePoints.size()) ?
+    this->Internal->FramePoints[frameNumber] : 0;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+vtkVelodyneHDLReader::FrameSelection::FrameSelection()
+{
+  this->StartFrame = 0;
+  this->EndFrame = -1;
+  this->Stride = 1;
+  this->StartTime = -VTK_DOUBLE_MAX;
+  this->EndTime = VTK_DOUBLE_MAX;
+  this->Predicate = 0;
+  this->PredicateClientData = 0;
+}
+
+//-----------------------------------------------------------------------------
+std::vector<int> vtkVelodyneHDLReader::SelectFrames(const FrameSelection& selection)
+{
+  std::vector<int> frames;
+  const int nFrames = this->GetNumberOfFrames();
+  int first = std::max(selection.StartFrame, 0);
+  int last = (selection.EndFrame < 0) ? nFrames - 1 : std::min(selection.EndFrame, nFrames - 1);
+
+  // frame times increase, so the time window is a range of frames
+  const std::vector<double>& frameTimes = this->Internal->FrameTimes;
+  if (frameTimes.size() == static_cast<size_t>(nFrames))
+    {
+    first = std::max(first, static_cast<int>(
+      std::lower_bound(frameTimes.begin(), frameTimes.end(), selection.StartTime) - frameTimes.begin()));
+    last = std::min(last, static_cast<int>(
+      std::upper_bound(frameTimes.begin(), frameTimes.end(), selection.EndTime) - frameTimes.begin()) - 1);
+    }
+
+  const int stride = std::max(selection.Stride, 1);
+  for (int frameNumber = first; frameNumber <= last; frameNumber += stride)
+    {
+    FrameInfo info;
+    if (selection.Predicate &&
+        (!this->GetFrameInfo(frameNumber, info) || !selection.Predicate(info, selection.PredicateClientData)))
+      {
+      continue;
+      }
+    frames.push_back(frameNumber);
+    }
+  return frames;
+}
+
+//-----------------------------------------------------------------------------
+namespace
+{
+// Decodes the frames read by the calling thread on worker threads, each
+// with a reader of its own, while the next frames are read.
+class FrameDecodePool
+{
+public:
+
+  struct Job
+  {
+    vtkVelodyneHDLReader::FrameInfo Info;
+    bool Partial;
+    bool Done;
+    std::string Packets;
+    vtkSmartPointer<vtkPolyData> Frame;
+  };
+
+  // Starts a thread for each reader, configured like the calling reader.
+  FrameDecodePool(const std::vector<vtkSmartPointer<vtkVelodyneHDLReader> >& readers)
+  {
+    this->Stopping = false;
+    this->Readers = readers;
+    for (size_t i = 0; i < readers.size(); ++i)
+      {
+      this->Threads.create_thread(boost::bind(&FrameDecodePool::ThreadLoop, this, readers[i].GetPointer()));
+      }
+  }
+
+  ~FrameDecodePool()
+  {
+      {
+      boost::lock_guard<boost::mutex> lock(this->Mutex);
+      this->Stopping = true;
+      }
+    this->JobReady.notify_all();
+    this->Threads.join_all();
+  }
+
+  void Submit(const boost::shared_ptr<Job>& job)
+  {
+      {
+      boost::lock_guard<boost::mutex> lock(this->Mutex);
+      this->Queue.push_back(job);
+      }
+    this->JobReady.notify_one();
+  }
+
+  bool IsDone(const boost::shared_ptr<Job>& job)
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    return job->Done;
+  }
+
+  void Wait(const boost::shared_ptr<Job>& job)
+  {
+    boost::unique_lock<boost::mutex> lock(this->Mutex);
+    while (!job->Done)
+      {
+      this->JobDone.wait(lock);
+      }
+  }
+
+private:
+
+  void ThreadLoop(vtkVelodyneHDLReader* reader)
+  {
+    for (;;)
+      {
+      boost::shared_ptr<Job> job;
+        {
+        boost::unique_lock<boost::mutex> lock(this->Mutex);
+        while (this->Queue.empty() && !this->Stopping)
+          {
+          this->JobReady.wait(lock);
+          }
+        if (this->Queue.empty())
+          {
+          return;
+          }
+        job = this->Queue.front();
+        this->Queue.pop_front();
+        }
+
+      vtkSmartPointer<vtkPolyData> frame = reader->DecodeFrame(job->Packets, job->Info.Time, job->Partial);
+        {
+        boost::lock_guard<boost::mutex> lock(this->Mutex);
+        job->Frame = frame;
+        job->Packets.clear();
+        job->Done = true;
+        }
+      this->JobDone.notify_all();
+      }
+  }
+
+  boost::mutex Mutex;
+  boost::condition_variable JobReady;
+  boost::condition_variable JobDone;
+  std::deque<boost::shared_ptr<Job> > Queue;
+  std::vector<vtkSmartPointer<vtkVelodyneHDLReader> > Readers;
+  boost::thread_group Threads;
+  bool Stopping;
+};
+}
+
+//-----------------------------------------------------------------------------
+int vtkVelodyneHDLReader::ForEachFrame(const FrameSelection& selection, FrameCallback callback, void* clientData)
+{
+  const std::vector<int> frames = this->SelectFrames(selection);
+  if (frames.empty())
+    {
+    return 0;
+    }
+
+  vtkPacketFileReader reader;
+  if (!reader.Open(this->FileName))
+    {
+    vtkErrorMacro("Failed to open packet file: " << this->FileName << endl << reader.GetLastError());
+    return 0;
+    }
+
+  // the packets are validated as they are read, the workers decode them
+  // with the calibration of this reader
+  std::vector<vtkSmartPointer<vtkVelodyneHDLReader> > workers;
+  for (int i = 0; i < this->NumberOfDecodeThreads; ++i)
+    {
+    vtkSmartPointer<vtkVelodyneHDLReader> worker = vtkSmartPointer<vtkVelodyneHDLReader>::New();
+    worker->SetValidatePackets(0);
+    worker->SetSensorTransform(this->Internal->SensorTransformMatrix);
+    worker->SetDoublePrecisionTrig(this->DoublePrecisionTrig);
+    worker->CorrectionsFile = this->CorrectionsFile;
+    std::copy(this->Internal->LaserCorrections, this->Internal->LaserCorrections + HDL_MAX_NUM_LASERS,
+      worker->Internal->LaserCorrections);
+    workers.push_back(worker);
+    }
+
+  typedef FrameDecodePool::Job Job;
+  FrameDecodePool pool(workers);
+  const size_t maxPending = 2 * this->NumberOfDecodeThreads;
+  std::deque<boost::shared_ptr<Job> > pending;
+  int nVisited = 0;
+
+  // the packet where the last frame read ended starts the next frame
+  std::string nextPacket;
+  int nextFrame = -1;
+
+  this->SetAbortExecute(0);
+  for (size_t k = 0; k < frames.size() && !this->GetAbortExecute(); ++k)
+    {
+    boost::shared_ptr<Job> job(new Job);
+    this->GetFrameInfo(frames[k], job->Info);
+    job->Done = false;
+    if (frames[k] == nextFrame)
+      {
+      job->Packets.swap(nextPacket);
+      }
+
+    int lastEndFiring = 0;
+    job->Partial = !this->ReadFramePackets(&reader, frames[k], job->Packets, lastEndFiring);
+    nextPacket.clear();
+    nextFrame = -1;
+    if (!job->Partial)
+      {
+      nextPacket.assign(job->Packets, job->Packets.size() - 1206, 1206);
+      nextFrame = frames[k] + 1;
+      }
+    pool.Submit(job);
+    pending.push_back(job);
+
+    while (pending.size() >= maxPending || (!pending.empty() && pool.IsDone(pending.front())))
+      {
+      pool.Wait(pending.front());
+      callback(pending.front()->Frame, pending.front()->Info, clientData);
+      pending.pop_front();
+      ++nVisited;
+      }
+    this->UpdateProgress(static_cast<double>(k + 1) / frames.size());
+    }
+
+  while (!pending.empty() && !this->GetAbortExecute())
+    {
+    pool.Wait(pending.front());
+    callback(pending.front()->Frame, pending.front()->Info, clientData);
+    pending.pop_front();
+    ++nVisited;
+    }
+  return nVisited;
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::vtkInternal::InitTables()
+{
+  boost::call_once(trig_lookup_table_once_, &FillTrigTableFloat);
+  this->TrigTableDouble = 0;
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::vtkInternal::SetDoublePrecisionTrig(bool enable)
+{
+  if (enable)
+    {
+    boost::call_once(trig_lookup_table_double_once_, &FillTrigTableDouble);
+    }
+  this->TrigTableDouble = enable ? trig_lookup_table_double_ : 0;
+}
+
 //-----------------------------------------------------------------------------
 void vtkVelodyneHDLReader::vtkInternal::LoadCorrectionsFile(const std::string& correctionsFile)
 {
@@ -640,14 +1781,14 @@ void vtkVelodyneHDLReader::vtkInternal::LoadCorrectionsFile(const std::string& c
             }
           if (index != -1)
             {
-            laser_corrections_[index].azimuthCorrection = azimuth;
-            laser_corrections_[index].verticalCorrection = vertCorrection;
-            laser_corrections_[index].distanceCorrection = distCorrection / 100.0;
-            laser_corrections_[index].verticalOffsetCorrection = vertOffsetCorrection / 100.0;
-            laser_corrections_[index].horizontalOffsetCorrection = horizOffsetCorrection / 100.0;
-
-            laser_corrections_[index].cosVertCorrection = std::cos (HDL_Grabber_toRadians(laser_corrections_[index].verticalCorrection));
-            laser_corrections_[index].sinVertCorrection = std::sin (HDL_Grabber_toRadians(laser_corrections_[index].verticalCorrection));
+            this->LaserCorrections[index].azimuthCorrection = azimuth;
+            this->LaserCorrections[index].verticalCorrection = vertCorrection;
+            this->LaserCorrections[index].distanceCorrection = distCorrection / 100.0;
+            this->LaserCorrections[index].verticalOffsetCorrection = vertOffsetCorrection / 100.0;
+            this->LaserCorrections[index].horizontalOffsetCorrection = horizOffsetCorrection / 100.0;
+
+            this->LaserCorrections[index].cosVertCorrection = std::cos (HDL_Grabber_toRadians(this->LaserCorrections[index].verticalCorrection));
+            this->LaserCorrections[index].sinVertCorrection = std::sin (HDL_Grabber_toRadians(this->LaserCorrections[index].verticalCorrection));
             }
           }
         }
@@ -668,24 +1809,24 @@ void vtkVelodyneHDLReader::vtkInternal::LoadHDL32Corrections()
 
   for (int i = 0; i < HDL_LASER_PER_FIRING; i++)
     {
-    laser_corrections_[i].azimuthCorrection = 0.0;
-    laser_corrections_[i].distanceCorrection = 0.0;
-    laser_corrections_[i].horizontalOffsetCorrection = 0.0;
-    laser_corrections_[i].verticalOffsetCorrection = 0.0;
-    laser_corrections_[i].verticalCorrection = hdl32VerticalCorrections[i];
-    laser_corrections_[i].sinVertCorrection = std::sin (HDL_Grabber_toRadians(hdl32VerticalCorrections[i]));
-    laser_corrections_[i].cosVertCorrection = std::cos (HDL_Grabber_toRadians(hdl32VerticalCorrections[i]));
+    this->LaserCorrections[i].azimuthCorrection = 0.0;
+    this->LaserCorrections[i].distanceCorrection = 0.0;
+    this->LaserCorrections[i].horizontalOffsetCorrection = 0.0;
+    this->LaserCorrections[i].verticalOffsetCorrection = 0.0;
+    this->LaserCorrections[i].verticalCorrection = hdl32VerticalCorrections[i];
+    this->LaserCorrections[i].sinVertCorrection = std::sin (HDL_Grabber_toRadians(hdl32VerticalCorrections[i]));
+    this->LaserCorrections[i].cosVertCorrection = std::cos (HDL_Grabber_toRadians(hdl32VerticalCorrections[i]));
     }
 
   for (int i = HDL_LASER_PER_FIRING; i < HDL_MAX_NUM_LASERS; i++)
     {
-    laser_corrections_[i].azimuthCorrection = 0.0;
-    laser_corrections_[i].distanceCorrection = 0.0;
-    laser_corrections_[i].horizontalOffsetCorrection = 0.0;
-    laser_corrections_[i].verticalOffsetCorrection = 0.0;
-    laser_corrections_[i].verticalCorrection = 0.0;
-    laser_corrections_[i].sinVertCorrection = 0.0;
-    laser_corrections_[i].cosVertCorrection = 1.0;
+    this->LaserCorrections[i].azimuthCorrection = 0.0;
+    this->LaserCorrections[i].distanceCorrection = 0.0;
+    this->LaserCorrections[i].horizontalOffsetCorrection = 0.0;
+    this->LaserCorrections[i].verticalOffsetCorrection = 0.0;
+    this->LaserCorrections[i].verticalCorrection = 0.0;
+    this->LaserCorrections[i].sinVertCorrection = 0.0;
+    this->LaserCorrections[i].cosVertCorrection = 1.0;
     }
 
   this->SetCorrectionsCommon();
@@ -696,10 +1837,10 @@ void vtkVelodyneHDLReader::vtkInternal::SetCorrectionsCommon()
 {
   for (int i = 0; i < HDL_MAX_NUM_LASERS; i++)
     {
-    HDLLaserCorrection correction = laser_corrections_[i];
-    laser_corrections_[i].sinVertOffsetCorrection = correction.verticalOffsetCorrection
+    HDLLaserCorrection correction = this->LaserCorrections[i];
+    this->LaserCorrections[i].sinVertOffsetCorrection = correction.verticalOffsetCorrection
                                        * correction.sinVertCorrection;
-    laser_corrections_[i].cosVertOffsetCorrection = correction.verticalOffsetCorrection
+    this->LaserCorrections[i].cosVertOffsetCorrection = correction.verticalOffsetCorrection
                                        * correction.cosVertCorrection;
     }
 }
@@ -712,13 +1853,145 @@ void vtkVelodyneHDLReader::vtkInternal::Init()
 }
 
 //-----------------------------------------------------------------------------
-void vtkVelodyneHDLReader::vtkInternal::SplitFrame()
+void vtkVelodyneHDLReader::vtkInternal::SplitFrame(bool wrapped)
 {
-  this->CurrentDataset->SetVerts(this->NewVertexCells(this->CurrentDataset->GetNumberOfPoints()));
+  // sensor time of the first firing, used to align frames of several sensors
+  vtkNew<vtkDoubleArray> sensorTime;
+  sensorTime->SetName("sensor_time_us");
+  sensorTime->InsertNextValue(this->FrameTimestamp);
+  this->CurrentDataset->GetFieldData()->AddArray(sensorTime.GetPointer());
+
+  // the same time without the hourly rollover
+  vtkNew<vtkDoubleArray> continuousTime;
+  continuousTime->SetName("continuous_time_us");
+  continuousTime->InsertNextValue(this->FrameTime);
+  this->CurrentDataset->GetFieldData()->AddArray(continuousTime.GetPointer());
+  this->HasFrameTimestamp = false;
+
+  vtkNew<vtkUnsignedCharArray> coverageBins;
+  coverageBins->SetName("azimuth_coverage_bins");
+  coverageBins->SetNumberOfValues(AZIMUTH_COVERAGE_BINS / 8);
+  for (int i = 0; i < AZIMUTH_COVERAGE_BINS / 8; ++i)
+    {
+    unsigned char bits = 0;
+    for (int j = 0; j < 8; ++j)
+      {
+      bits |= static_cast<unsigned char>(this->Coverage[i * 8 + j]) << j;
+      }
+    coverageBins->SetValue(i, bits);
+    }
+  this->CurrentDataset->GetFieldData()->AddArray(coverageBins.GetPointer());
+
+  vtkNew<vtkDoubleArray> coverage;
+  coverage->SetName("azimuth_coverage");
+  coverage->InsertNextValue(static_cast<double>(this->Coverage.count()) / AZIMUTH_COVERAGE_BINS);
+  this->CurrentDataset->GetFieldData()->AddArray(coverage.GetPointer());
+
+  vtkNew<vtkUnsignedCharArray> complete;
+  complete->SetName("frame_complete");
+  complete->InsertNextValue(wrapped && this->Coverage.count() == this->Coverage.size() ? 1 : 0);
+  this->CurrentDataset->GetFieldData()->AddArray(complete.GetPointer());
+  this->Coverage.reset();
+
+  this->ExpectedPoints = this->CurrentDataset->GetNumberOfPoints();
+  this->CurrentDataset->SetVerts(this->NewVertexCells(this->ExpectedPoints));
   this->Datasets.push_back(this->CurrentDataset);
   this->CurrentDataset = this->CreateData(0);
 }
 
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::vtkInternal::SetReorderWindow(int window)
+{
+  this->ReorderSlots.resize(window > 0 ? window + 1 : 0);
+  this->ClearReorderWindow();
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::vtkInternal::ClearReorderWindow()
+{
+  this->ReorderPending.clear();
+  this->ReorderFree.clear();
+  for (int i = static_cast<int>(this->ReorderSlots.size()) - 1; i >= 0; --i)
+    {
+    this->ReorderFree.push_back(i);
+    }
+  this->HasReleasedPacket = false;
+}
+
+//-----------------------------------------------------------------------------
+// Holds the packet back until the window is full, then decodes the oldest
+// held packet.  A packet older than one already decoded is too late to be
+// put back in place and is dropped, like a second copy of a packet.
+int vtkVelodyneHDLReader::vtkInternal::PushReorderWindow(const unsigned char* data)
+{
+  const HDLDataPacket* dataPacket = reinterpret_cast<const HDLDataPacket*>(data);
+  const unsigned int timestamp = dataPacket->gpsTimestamp;
+  const unsigned short azimuth = dataPacket->firingData[0].rotationalPosition;
+
+  if (this->HasReleasedPacket)
+    {
+    const int order = CompareHDLPackets(timestamp, azimuth, this->ReleasedTimestamp, this->ReleasedAzimuth);
+    if (order <= 0)
+      {
+      return order == 0 ? REORDER_DUPLICATE : REORDER_LATE;
+      }
+    }
+
+  // packets nearly always arrive in order, the search starts at the end
+  size_t position = this->ReorderPending.size();
+  while (position > 0)
+    {
+    const ReorderSlot& previous = this->ReorderSlots[this->ReorderPending[position - 1]];
+    const int order = CompareHDLPackets(timestamp, azimuth, previous.Timestamp, previous.Azimuth);
+    if (order == 0)
+      {
+      return REORDER_DUPLICATE;
+      }
+    if (order > 0)
+      {
+      break;
+      }
+    --position;
+    }
+  const int result = (position < this->ReorderPending.size()) ? REORDER_REORDERED : REORDER_IN_ORDER;
+
+  const int slot = this->ReorderFree.back();
+  this->ReorderFree.pop_back();
+  this->ReorderSlots[slot].Timestamp = timestamp;
+  this->ReorderSlots[slot].Azimuth = azimuth;
+  memcpy(this->ReorderSlots[slot].Data, data, sizeof(this->ReorderSlots[slot].Data));
+  this->ReorderPending.insert(this->ReorderPending.begin() + position, slot);
+
+  if (this->ReorderFree.empty())
+    {
+    this->ReleaseReorderedPacket();
+    }
+  return result;
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::vtkInternal::ReleaseReorderedPacket()
+{
+  const int slot = this->ReorderPending.front();
+  this->ReorderPending.erase(this->ReorderPending.begin());
+  this->ReorderFree.push_back(slot);
+
+  ReorderSlot& packet = this->ReorderSlots[slot];
+  this->ReleasedTimestamp = packet.Timestamp;
+  this->ReleasedAzimuth = packet.Azimuth;
+  this->HasReleasedPacket = true;
+  this->ProcessHDLPacket(packet.Data, sizeof(packet.Data));
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLReader::vtkInternal::FlushReorderWindow()
+{
+  while (!this->ReorderPending.empty())
+    {
+    this->ReleaseReorderedPacket();
+    }
+}
+
 //-----------------------------------------------------------------------------
 void vtkVelodyneHDLReader::vtkInternal::ProcessHDLPacket(unsigned char *data, std::size_t bytesReceived)
 {
@@ -728,7 +2001,7 @@ void vtkVelodyneHDLReader::vtkInternal::ProcessHDLPacket(unsigned char *data, st
     }
 
   HDLDataPacket* dataPacket = reinterpret_cast<HDLDataPacket *>(data);
-
+  const double packetTime = this->TimeTracker.Update(dataPacket->gpsTimestamp);
 
   int i = this->Skip;
   this->Skip = 0;
@@ -742,10 +2015,30 @@ void vtkVelodyneHDLReader::vtkInternal::ProcessHDLPacket(unsigned char *data, st
         )
         //&& this->CurrentDataset->GetNumberOfPoints())
       {
-      this->SplitFrame();
+      if (this->SkipToWrap)
+        {
+        // the frame already ended on the publish coverage
+        this->SkipToWrap = false;
+        }
+      else
+        {
+        this->SplitFrame();
+        }
       }
 
     this->LastAzimuth = firingData.rotationalPosition;
+    if (this->SkipToWrap)
+      {
+      continue;
+      }
+    this->Coverage.set(std::min<int>(firingData.rotationalPosition / 100, AZIMUTH_COVERAGE_BINS - 1));
+
+    if (!this->HasFrameTimestamp)
+      {
+      this->FrameTimestamp = dataPacket->gpsTimestamp;
+      this->FrameTime = packetTime;
+      this->HasFrameTimestamp = true;
+      }
 
     for (int j = 0; j < HDL_LASER_PER_FIRING; j++)
       {
@@ -753,9 +2046,15 @@ void vtkVelodyneHDLReader::vtkInternal::ProcessHDLPacket(unsigned char *data, st
       if (firingData.laserReturns[j].distance != 0.0)
         {
         PushFiringData(this->CurrentDataset, laserId, firingData.rotationalPosition,
-          dataPacket->gpsTimestamp, firingData.laserReturns[j], laser_corrections_[j + offset], this);
+          dataPacket->gpsTimestamp, firingData.laserReturns[j], this->LaserCorrections[j + offset], this);
         }
       }
+
+    if (this->PublishBins > 0 && static_cast<int>(this->Coverage.count()) >= this->PublishBins)
+      {
+      this->SplitFrame();
+      this->SkipToWrap = true;
+      }
     }
 }
 
@@ -774,30 +2073,101 @@ int vtkVelodyneHDLReader::ReadFrameInformation()
   double timeSinceStart = 0;
 
   unsigned int lastAzimuth = 0;
-  unsigned int lastTimestamp = 0;
 
-  std::vector<fpos_t> filePositions;
-  std::vector<int> skips;
+  std::vector<fpos_t>& filePositions = this->Internal->FilePositions;
+  std::vector<int>& skips = this->Internal->Skips;
+  std::vector<double>& frameTimes = this->Internal->FrameTimes;
+  std::vector<vtkIdType>& framePoints = this->Internal->FramePoints;
+  SensorTimeTracker& tracker = this->Internal->IndexTracker;
 
   fpos_t lastFilePosition;
-  reader.GetFilePosition(&lastFilePosition);
 
+  if (this->Internal->IndexStarted && !this->Internal->IndexComplete)
+    {
+    // resume an interrupted scan, the frames found so far are kept
+    lastFilePosition = this->Internal->IndexPosition;
+    lastAzimuth = this->Internal->IndexAzimuth;
+    reader.SetFilePosition(&lastFilePosition);
+    }
+  else
+    {
+    reader.GetFilePosition(&lastFilePosition);
+    filePositions.clear();
+    skips.clear();
+    frameTimes.clear();
+    framePoints.clear();
+    filePositions.push_back(lastFilePosition);
+    skips.push_back(0);
+    framePoints.push_back(0);
+    tracker = SensorTimeTracker();
+    this->Internal->IndexClock.Reset();
+    this->Internal->IndexLastTime = -1;
+    this->Internal->IndexAnchored = (this->TimeAnchor == TIME_ANCHOR_NONE);
+    this->Internal->IndexStarted = true;
+    this->Internal->IndexComplete = false;
+    }
 
-  filePositions.push_back(lastFilePosition);
-  skips.push_back(0);
+  // progress follows the bytes read and is reported in steps of 1%, the
+  // abort flag is polled at the same points
+  const double fileSize = reader.GetFileSize();
+  double reportedProgress = -1.0;
+  unsigned int packetCount = 0;
+  this->SetAbortExecute(0);
 
   while (reader.NextPacket(data, dataLength, timeSinceStart))
     {
 
-    if (dataLength != 1206)
+    if (!this->Internal->IndexAnchored && this->TimeAnchor == TIME_ANCHOR_POSITION &&
+        dataLength == vtkSensorClock::POSITION_PACKET_SIZE &&
+        this->Internal->IndexClock.HandlePositionPacket(data, dataLength, timeSinceStart))
+      {
+      boost::shared_ptr<const vtkSensorClock::State> state = this->Internal->IndexClock.GetState();
+      if (state->HasGPSTime)
+        {
+        // move the frames found so far to UTC microseconds since the epoch
+        const unsigned int positionTimestamp = static_cast<unsigned int>(state->SensorTime);
+        const double delta = (state->HourStart * 1e6 + positionTimestamp) - tracker.Peek(positionTimestamp);
+        tracker.Shift(delta);
+        if (frameTimes.empty())
+          {
+          tracker.Seed(state->HourStart * 1e6 + positionTimestamp);
+          }
+        for (size_t i = 0; i < frameTimes.size(); ++i)
+          {
+          frameTimes[i] += delta;
+          }
+        if (this->Internal->IndexLastTime >= 0)
+          {
+          this->Internal->IndexLastTime += delta;
+          }
+        this->Internal->IndexAnchored = true;
+        }
+      }
+
+    // frame boundaries are found among the packets ProcessHDLPacket decodes
+    if (dataLength != 1206 || (this->ValidatePackets && ValidateHDLPacket(data, dataLength) != HDL_PACKET_VALID))
       {
       continue;
       }
 
     const HDLDataPacket* dataPacket = reinterpret_cast<const HDLDataPacket *>(data);
 
-    unsigned int timeDiff = dataPacket->gpsTimestamp - lastTimestamp;
-    if (timeDiff > 600 && lastTimestamp != 0)
+    if (!this->Internal->IndexAnchored && this->TimeAnchor == TIME_ANCHOR_PACKET_CAPTURE)
+      {
+      // the capture clock picks the hour, it only has to be within half an
+      // hour of the sensor clock
+      tracker.Seed(timeSinceStart * 1e6);
+      this->Internal->IndexAnchored = true;
+      }
+
+    const double packetTime = tracker.Update(dataPacket->gpsTimestamp);
+    if (frameTimes.empty())
+      {
+      frameTimes.push_back(packetTime);
+      }
+
+    const double timeDiff = packetTime - this->Internal->IndexLastTime;
+    if (timeDiff > 600 && this->Internal->IndexLastTime >= 0)
       {
       printf("missed %d packets\n",  static_cast<int>(floor((timeDiff/553.0) + 0.5)));
       }
@@ -810,17 +2180,40 @@ int vtkVelodyneHDLReader::ReadFrameInformation()
         {
         filePositions.push_back(lastFilePosition);
         skips.push_back(i);
-        this->UpdateProgress(0.0);
+        frameTimes.push_back(packetTime);
+        framePoints.push_back(0);
         }
 
       lastAzimuth = firingData.rotationalPosition;
+      for (int j = 0; j < HDL_LASER_PER_FIRING; ++j)
+        {
+        framePoints.back() += (firingData.laserReturns[j].distance != 0) ? 1 : 0;
+        }
       }
 
-    lastTimestamp = dataPacket->gpsTimestamp;
+    this->Internal->IndexLastTime = std::max(this->Internal->IndexLastTime, packetTime);
     reader.GetFilePosition(&lastFilePosition);
+
+    if (++packetCount % 1000 == 0 && fileSize > 0)
+      {
+      const double progress = std::min(reader.GetFileOffset() / fileSize, 1.0);
+      if (progress - reportedProgress >= 0.01)
+        {
+        this->UpdateProgress(progress);
+        reportedProgress = progress;
+        }
+
+      if (this->GetAbortExecute())
+        {
+        // the last indexed frame may still grow when the scan resumes
+        this->Internal->IndexPosition = lastFilePosition;
+        this->Internal->IndexAzimuth = lastAzimuth;
+        return this->GetNumberOfFrames();
+        }
+      }
     }
 
-  this->Internal->FilePositions = filePositions;
-  this->Internal->Skips = skips;
+  this->Internal->IndexComplete = true;
+  this->UpdateProgress(1.0);
   return this->GetNumberOfFrames();
 }
@@ -35,6 +35,11 @@
 #include <vtkPolyDataAlgorithm.h>
 #include <vtkSmartPointer.h>
 #include <string>
+#include <vector>
+
+class vtkFrameBufferPool;
+class vtkMatrix4x4;
+class vtkPacketFileReader;
 
 class VTK_EXPORT vtkVelodyneHDLReader : public vtkPolyDataAlgorithm
 {
@@ -49,23 +54,219 @@ public:
   void SetFileName(const std::string& filename);
 
   //Description:
-  //
+  // Laser calibration file of the sensor, the default HDL-32 calibration
+  // if empty.  Each reader keeps its own calibration.
   const std::string& GetCorrectionsFile();
   void SetCorrectionsFile(const std::string& correctionsFile);
 
+  //Description:
+  // Sensor to world transform applied to every point while decoding, for
+  // example the extrinsic calibration of one sensor in a multi sensor rig.
+  // A copy of the matrix is kept; pass NULL to decode in sensor coordinates.
+  vtkMatrix4x4* GetSensorTransform();
+  void SetSensorTransform(vtkMatrix4x4* matrix);
+
+//BTX
+  //Description:
+  // Pool the arrays of new frames are taken from when it is enabled, with
+  // optional huge pages and NUMA local placement; see vtkFrameBufferPool.h.
+  // Disabled by default.
+  vtkFrameBufferPool* GetFrameBufferPool();
+//ETX
+
   //Description:
   //
   int CanReadFile(const char* fname);
 
   void Open();
   void Close();
+
+  //Description:
+  // Scans the file for frame boundaries and returns the number of frames.
+  // Progress events follow the bytes read.  Setting AbortExecute, for
+  // example from a progress observer, stops the scan: the frames found so
+  // far can be read and the next call resumes where the scan stopped.
   int ReadFrameInformation();
+  bool IsIndexComplete();
   int GetNumberOfFrames();
+
+  //Description:
+  // Sensor time stamps roll over every hour.  Frames carry the time of
+  // their first packet without the rollover in the field data array
+  // "continuous_time_us", next to "sensor_time_us", and the index keeps it
+  // for every frame.  With no anchor the continuous time counts hours from
+  // the start of the file; anchored by the packet capture time or by the
+  // GPS time of the position packets it is in UTC microseconds since the
+  // epoch.  Changing the anchor discards the index.
+  enum TimeAnchorType
+  {
+    TIME_ANCHOR_NONE = 0,
+    TIME_ANCHOR_PACKET_CAPTURE = 1,
+    TIME_ANCHOR_POSITION = 2
+  };
+
+  void SetTimeAnchor(int anchor);
+  vtkGetMacro(TimeAnchor, int);
+
+  //Description:
+  // Continuous time of an indexed frame, -1 if unknown, and the frame that
+  // holds a continuous time, -1 if the index is empty.
+  double GetFrameTime(int frameNumber);
+  int GetFrameForTime(double time);
   vtkSmartPointer<vtkPolyData> GetFrame(int frameNumber);
 
+  //Description:
+  // Threads GetFrame() decodes a frame on, 1 to 64.  Above 1 the packets
+  // of the frame are read first, counted, and decoded in contiguous runs
+  // straight into their slices of the frame arrays, which cuts the latency
+  // of loading a single frame.  The frame is the same as with 1 thread, the
+  // default.  Not used while a reorder window is set.
+  vtkSetClampMacro(NumberOfDecodeThreads, int, 1, 64);
+  vtkGetMacro(NumberOfDecodeThreads, int);
+
+//BTX
+  //Description:
+  // Index entry of a frame: its number, continuous time (see
+  // GetFrameTime) and number of points.
+  struct FrameInfo
+  {
+    int FrameNumber;
+    double Time;
+    vtkIdType NumberOfPoints;
+  };
+  bool GetFrameInfo(int frameNumber, FrameInfo& info);
+
+  typedef bool (*FramePredicate)(const FrameInfo& info, void* clientData);
+  typedef void (*FrameCallback)(vtkPolyData* frame, const FrameInfo& info, void* clientData);
+
+  //Description:
+  // Frames of the index to visit: every Stride-th frame from StartFrame to
+  // EndFrame (-1 for the last one) that starts between StartTime and
+  // EndTime, in continuous time, and that the predicate accepts.  By
+  // default every frame.
+  struct FrameSelection
+  {
+    FrameSelection();
+    int StartFrame;
+    int EndFrame;
+    int Stride;
+    double StartTime;
+    double EndTime;
+    FramePredicate Predicate;
+    void* PredicateClientData;
+  };
+  std::vector<int> SelectFrames(const FrameSelection& selection);
+
+  //Description:
+  // Calls callback with every selected frame, in frame order, and returns
+  // the number of frames visited.  Only the selected frames are read, in
+  // file order: a frame that follows the previous one is read on without
+  // seeking.  They are decoded by NumberOfDecodeThreads threads while the
+  // next ones are read.  Uses its own handle on the file, so GetFrame()
+  // may be called from the callback.  Setting AbortExecute stops it.
+  int ForEachFrame(const FrameSelection& selection, FrameCallback callback, void* clientData);
+//ETX
+
   void DumpFrames(int startFrame, int endFrame, const std::string& filename);
 
+  //Description:
+  // Write frames as Arrow record batches.  Filenames ending in .arrows (or
+  // "-" for stdout) use the IPC stream format, other names the file format.
+  void ExportFramesToArrow(int startFrame, int endFrame, const std::string& filename);
+
+  //Description:
+  // Decodes the frame completed by a run of 1206 byte packets stored back
+  // to back, as kept by the live cache of vtkVelodyneHDLSource: the packets
+  // of one frame, starting with the packet in which the previous frame
+  // ended.  Returns NULL if no frame is completed.  frameTime, the
+  // continuous time of the frame when known, places it in the right hour.
+  // A partial frame, published by PublishPartialFrame(), ends with the
+  // last packet.
+  vtkSmartPointer<vtkPolyData> DecodeFrame(const std::string& packets, double frameTime = -1,
+    bool partial = false);
+
+  //Description:
+  // Decodes one packet.  Unless ValidatePackets is off, packets with a
+  // wrong length, an unknown block identifier, an azimuth out of range,
+  // azimuths that do not advance in small steps from one firing to the
+  // next or a timestamp past the hour are dropped before decoding and
+  // counted by reason.  Position packets are skipped without counting.
   void ProcessHDLPacket(unsigned char *data, unsigned int bytesReceived);
+
+  enum PacketRejectReason
+  {
+    REJECT_LENGTH = 0,
+    REJECT_BLOCK_ID,
+    REJECT_AZIMUTH_RANGE,
+    REJECT_AZIMUTH_ORDER,
+    REJECT_TIMESTAMP,
+    NUMBER_OF_REJECT_REASONS
+  };
+
+  vtkSetMacro(ValidatePackets, int);
+  vtkGetMacro(ValidatePackets, int);
+  vtkBooleanMacro(ValidatePackets, int);
+
+  //Description:
+  // Cosines and sines of the azimuths come from a single precision table
+  // by default, as precise as the float points and small enough to stay
+  // in cache while decoding.  On, a double precision table twice the size
+  // is used instead.
+  void SetDoublePrecisionTrig(int enable);
+  vtkGetMacro(DoublePrecisionTrig, int);
+  vtkBooleanMacro(DoublePrecisionTrig, int);
+
+  vtkIdType GetNumberOfAcceptedPackets();
+  vtkIdType GetNumberOfRejectedPackets(int reason);
+  void ResetPacketStatistics();
+
+  //Description:
+  // Number of packets, 0 to 64, held back to be decoded in the order of
+  // their sensor time and azimuth.  Packets swapped on the network within
+  // the window are put back in place, so they no longer split a
+  // revolution, and second copies of a packet are dropped.  Decoding lags
+  // the last received packet by the window.  Off (0) by default since the
+  // frame index of files does not reorder.
+  void SetReorderWindow(int window);
+  vtkGetMacro(ReorderWindow, int);
+
+  //Description:
+  // Decodes the packets held back by the reorder window.
+  void FlushReorderWindow();
+
+  //Description:
+  // Every frame records which of the 360 one degree azimuth bins its
+  // firings hit, as 45 bytes in the field data array
+  // "azimuth_coverage_bins" (bin i is bit i % 8 of byte i / 8), the
+  // fraction of bins hit in "azimuth_coverage", and in "frame_complete" 1
+  // if the frame ended on the wrap or on PublishCoverage and every bin was
+  // hit.  A lost packet leaves a gap of a few bins, found without scanning
+  // the points.
+  //
+  // PublishPartialFrame() ends the frame in progress without waiting for
+  // the wrap, after decoding the packets held by the reorder window, and
+  // adds it to the datasets if it has points.  Returns true if a frame was
+  // added.
+  bool PublishPartialFrame();
+
+  //Description:
+  // Above 0, a frame decoded packet by packet also ends on the firing that
+  // brings its coverage to PublishCoverage (0 to 1), without waiting for
+  // the wrap.  The firings left in the revolution are skipped, so the next
+  // frame still starts at the wrap: the end of the revolution is traded
+  // for latency.  Off (0) by default.  The frame index of packet files
+  // always splits on the wrap.
+  void SetPublishCoverage(double coverage);
+  vtkGetMacro(PublishCoverage, double);
+
+  //Description:
+  // Packets the reorder window put back in place, second copies it dropped
+  // and packets that came after a later packet was already decoded, which
+  // are dropped too.  Reset by ResetPacketStatistics().
+  vtkIdType GetNumberOfReorderedPackets();
+  vtkIdType GetNumberOfDuplicatePackets();
+  vtkIdType GetNumberOfLatePackets();
+
   std::vector<vtkSmartPointer<vtkPolyData> >& GetDatasets();
 
   class vtkInternal;
@@ -85,10 +286,24 @@ protected:
 
   void UnloadData();
   void SetTimestepInformation(vtkInformation *info);
+  vtkSmartPointer<vtkPolyData> GetFrameParallel(int frameNumber);
+  bool ReadFramePackets(vtkPacketFileReader* reader, int frameNumber, std::string& packets, int& lastEndFiring);
 
   std::string CorrectionsFile;
   std::string FileName;
 
+  int ValidatePackets;
+  int DoublePrecisionTrig;
+  int NumberOfDecodeThreads;
+  int TimeAnchor;
+  int ReorderWindow;
+  double PublishCoverage;
+  vtkIdType AcceptedPackets;
+  vtkIdType ReorderedPackets;
+  vtkIdType DuplicatePackets;
+  vtkIdType LatePackets;
+  vtkIdType RejectedPackets[NUMBER_OF_REJECT_REASONS];
+
 
   vtkInternal* Internal;
 
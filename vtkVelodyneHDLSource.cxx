@@ -29,19 +29,49 @@
 #include "vtkVelodyneHDLReader.h"
 #include "vtkPacketFileReader.h"
 #include "vtkPacketFileWriter.h"
+#include "vtkArrowFrameWriter.h"
+#include "vtkCompressedFrame.h"
+#include "vtkPacketRingFile.h"
+#include "vtkSensorClock.h"
+#include "vtkFrameSocketServer.h"
 #include "vtkPolyData.h"
+#include "vtkFieldData.h"
+#include "vtkDataArray.h"
+#include "vtkDoubleArray.h"
+#include "vtkUnsignedCharArray.h"
+#include "vtkPointData.h"
+#include "vtkMatrix4x4.h"
 #include "vtkInformation.h"
+#include "vtkInformationDoubleKey.h"
 #include "vtkInformationVector.h"
 #include "vtkObjectFactory.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
+#include "vtkTimerLog.h"
 #include "vtkSmartPointer.h"
 #include "vtkNew.h"
 
 #include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <map>
 #include <queue>
+#include <sstream>
 #include <deque>
+#include <algorithm>
+#include <cmath>
+
+#ifdef __linux__
+# include <cerrno>
+# include <linux/filter.h>
+# include <sys/socket.h>
+# ifdef SO_ATTACH_REUSEPORT_CBPF
+#  define VTK_HDL_REUSEPORT_STEERING
+# endif
+#endif
 
 //----------------------------------------------------------------------------
 namespace
@@ -55,7 +85,8 @@ namespace
       SynchronizedQueue () :
         queue_(), mutex_(), cond_(), request_to_end_(false), enqueue_data_(true) { }
 
-      void
+      // Returns false if the queue was stopped, the caller keeps data.
+      bool
       enqueue (const T& data)
       {
         boost::unique_lock<boost::mutex> lock (mutex_);
@@ -64,7 +95,9 @@ namespace
         {
           queue_.push (data);
           cond_.notify_one ();
+          return true;
         }
+        return false;
       }
 
       bool
@@ -89,6 +122,24 @@ namespace
         return true;
       }
 
+      // Pops without waiting, for the owner to release what is left once
+      // the queue is stopped.
+      bool
+      tryDequeue (T& result)
+      {
+        boost::unique_lock<boost::mutex> lock (mutex_);
+
+        if (queue_.empty ())
+        {
+          return false;
+        }
+
+        result = queue_.front ();
+        queue_.pop ();
+
+        return true;
+      }
+
       void
       stopQueue ()
       {
@@ -112,15 +163,13 @@ namespace
       }
 
     private:
+      // Stops accepting data.  What is still queued stays there, since it
+      // may own memory, until the owner pops it with tryDequeue or
+      // destroys the queue.
       void
       doEndActions ()
       {
         enqueue_data_ = false;
-
-        while (!queue_.empty ())
-        {
-          queue_.pop ();
-        }
       }
 
       std::queue<T> queue_;              // Use STL queue to store data
@@ -132,95 +181,146 @@ namespace
   };
 
 //----------------------------------------------------------------------------
-class PacketConsumer
+class FrameArrowWriter
 {
 public:
 
-  PacketConsumer()
+  void ThreadLoop()
   {
-    this->NewData = false;
-    this->MaxNumberOfDatasets = 1000;
-    this->LastTime = 0.0;
+    vtkSmartPointer<vtkPolyData> frame;
+    while (this->Frames->dequeue(frame))
+      {
+      if (!this->ArrowWriter.WriteFrame(frame))
+        {
+        vtkGenericWarningMacro("Failed to write frame to arrow file: " << this->ArrowWriter.GetLastError());
+        }
+      frame = 0;
+      }
   }
 
-  void HandleSensorData(const unsigned char* data, unsigned int length)
+  void Start(const std::string& filename)
   {
-    this->HDLReader->ProcessHDLPacket(const_cast<unsigned char*>(data), length);
-    if (this->HDLReader->GetDatasets().size())
+    if (this->Thread)
       {
-      this->HandleNewData(this->HDLReader->GetDatasets().back());
-      this->HDLReader->GetDatasets().clear();
+      return;
       }
-  }
 
-  vtkSmartPointer<vtkPolyData> GetDatasetForTime(double timeRequest, double& actualTime)
-  {
-    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    if (this->ArrowWriter.GetFileName() != filename)
+      {
+      this->ArrowWriter.Close();
+      }
 
-    size_t stepIndex = this->GetIndexForTime(timeRequest);
-    if (stepIndex < this->Timesteps.size())
+    if (!this->ArrowWriter.IsOpen())
       {
-      actualTime = this->Timesteps[stepIndex];
-      return this->Datasets[stepIndex];
+      if (!this->ArrowWriter.Open(filename, vtkArrowFrameWriter::GetFormatForFileName(filename)))
+        {
+        vtkGenericWarningMacro("Failed to open arrow file: " << filename);
+        return;
+        }
       }
-    actualTime = 0;
-    return 0;
+
+    boost::atomic_store(&this->Frames,
+      boost::shared_ptr<SynchronizedQueue<vtkSmartPointer<vtkPolyData> > >(
+      new SynchronizedQueue<vtkSmartPointer<vtkPolyData> >));
+    this->Thread = boost::shared_ptr<boost::thread>(
+      new boost::thread(boost::bind(&FrameArrowWriter::ThreadLoop, this)));
   }
 
-  std::vector<double> GetTimesteps()
+  void Stop()
   {
-    boost::lock_guard<boost::mutex> lock(this->Mutex);
-    const size_t nTimesteps = this->Timesteps.size();
-    std::vector<double> timesteps(nTimesteps, 0);
-    for (size_t i = 0; i < nTimesteps; ++i)
+    if (this->Thread)
       {
-      timesteps[i] = this->Timesteps[i];
+      this->Frames->stopQueue();
+      this->Thread->join();
+      this->Thread.reset();
+      boost::atomic_store(&this->Frames, boost::shared_ptr<SynchronizedQueue<vtkSmartPointer<vtkPolyData> > >());
       }
-    return timesteps;
   }
 
-
-  int GetMaxNumberOfDatasets()
+  // Called on the decode thread, possibly while Stop() runs: works on its
+  // own reference to the queue, which refuses frames once stopped.
+  void Enqueue(vtkSmartPointer<vtkPolyData> frame)
   {
-    return this->MaxNumberOfDatasets;
+    boost::shared_ptr<SynchronizedQueue<vtkSmartPointer<vtkPolyData> > > frames =
+      boost::atomic_load(&this->Frames);
+    if (frames)
+      {
+      frames->enqueue(frame);
+      }
   }
 
-  void SetMaxNumberOfDatasets(int nDatasets)
+  bool IsOpen()
   {
-    boost::lock_guard<boost::mutex> lock(this->Mutex);
-    this->MaxNumberOfDatasets = nDatasets;
-    this->UpdateDequeSize();
+    return this->ArrowWriter.IsOpen();
   }
 
-  bool CheckForNewData()
+  void Close()
   {
-    boost::lock_guard<boost::mutex> lock(this->Mutex);
-    bool newData = this->NewData;
-    this->NewData = false;
-    return newData;
+    this->ArrowWriter.Close();
   }
 
+private:
+  vtkArrowFrameWriter ArrowWriter;
+  boost::shared_ptr<boost::thread> Thread;
+  boost::shared_ptr<SynchronizedQueue<vtkSmartPointer<vtkPolyData> > > Frames;
+};
+
+
+//----------------------------------------------------------------------------
+// Writes the packets around trigger events to new packet files.  The
+// packets of the last PreTriggerTime seconds are kept in memory; a trigger
+// starts a file with them and records until PostTriggerTime seconds after
+// the trigger.  A trigger during a recording extends it.
+class TriggeredPacketRecorder
+{
+public:
+
+  struct TimedPacket
+  {
+    struct timeval Time;
+    std::string* Data;
+  };
+
+  TriggeredPacketRecorder()
+  {
+    this->PreTriggerTime = 0;
+    this->PostTriggerTime = 0;
+    this->RecordUntil = 0;
+    this->HasPendingTrigger = false;
+    this->FirstPendingTrigger = 0;
+    this->LastPendingTrigger = 0;
+    this->NumberOfRecordings = 0;
+  }
 
   void ThreadLoop()
   {
-    std::string* packet = 0;
+    TimedPacket packet;
     while (this->Packets->dequeue(packet))
       {
-      this->HandleSensorData(reinterpret_cast<const unsigned char*>(packet->c_str()), packet->length());
-      delete packet;
+      this->HandlePacket(packet);
+      }
+
+    this->PacketWriter.Close();
+    while (!this->Ring.empty())
+      {
+      delete this->Ring.front().Data;
+      this->Ring.pop_front();
       }
   }
 
-  void Start()
+  void Start(const std::string& filePrefix, double preTriggerTime, double postTriggerTime)
   {
     if (this->Thread)
       {
       return;
       }
 
-    this->Packets.reset(new SynchronizedQueue<std::string*>);
+    this->FilePrefix = filePrefix;
+    this->PreTriggerTime = preTriggerTime;
+    this->PostTriggerTime = postTriggerTime;
+    this->Packets.reset(new SynchronizedQueue<TimedPacket>);
     this->Thread = boost::shared_ptr<boost::thread>(
-      new boost::thread(boost::bind(&PacketConsumer::ThreadLoop, this)));
+      new boost::thread(boost::bind(&TriggeredPacketRecorder::ThreadLoop, this)));
   }
 
   void Stop()
@@ -230,267 +330,2239 @@ public:
       this->Packets->stopQueue();
       this->Thread->join();
       this->Thread.reset();
+
+      TimedPacket packet;
+      while (this->Packets->tryDequeue(packet))
+        {
+        delete packet.Data;
+        }
       this->Packets.reset();
       }
   }
 
   void Enqueue(std::string* packet)
   {
-    this->Packets->enqueue(packet);
+    TimedPacket timedPacket;
+    gettimeofday(&timedPacket.Time, NULL);
+    timedPacket.Data = packet;
+    if (!this->Packets->enqueue(timedPacket))
+      {
+      delete packet;
+      }
   }
 
-  vtkVelodyneHDLReader* GetReader()
+  // Description:
+  // Requests a recording around the current time.  Safe to call from any
+  // thread.
+  void Trigger()
   {
-    return this->HDLReader.GetPointer();
+    struct timeval currentTime;
+    gettimeofday(&currentTime, NULL);
+    const double time = ToSeconds(currentTime);
+
+    boost::lock_guard<boost::mutex> lock(this->TriggerMutex);
+    if (!this->HasPendingTrigger)
+      {
+      this->FirstPendingTrigger = time;
+      }
+    this->LastPendingTrigger = time;
+    this->HasPendingTrigger = true;
   }
 
-protected:
+  bool IsRunning()
+  {
+    return this->Thread.get() != 0;
+  }
+
+private:
+
+  static double ToSeconds(const struct timeval& time)
+  {
+    return time.tv_sec + 1e-6 * time.tv_usec;
+  }
 
-  void UpdateDequeSize()
+  void HandlePacket(const TimedPacket& packet)
   {
-    if (this->MaxNumberOfDatasets <= 0)
+    const double time = ToSeconds(packet.Time);
+
+    bool triggered = false;
+    double firstTrigger = 0;
+    double lastTrigger = 0;
       {
-      return;
+      boost::lock_guard<boost::mutex> lock(this->TriggerMutex);
+      triggered = this->HasPendingTrigger;
+      firstTrigger = this->FirstPendingTrigger;
+      lastTrigger = this->LastPendingTrigger;
+      this->HasPendingTrigger = false;
+      }
+
+    if (triggered)
+      {
+      if (!this->PacketWriter.IsOpen())
+        {
+        this->StartRecording(firstTrigger - this->PreTriggerTime);
+        }
+      this->RecordUntil = std::max(this->RecordUntil, lastTrigger + this->PostTriggerTime);
       }
-    while (this->Datasets.size() >= this->MaxNumberOfDatasets)
+
+    if (this->PacketWriter.IsOpen() && time > this->RecordUntil)
       {
-      this->Datasets.pop_front();
-      this->Timesteps.pop_front();
+      this->PacketWriter.Close();
       }
-  }
 
-  size_t GetIndexForTime(double time)
-  {
-    size_t index = 0;
-    double minDifference = VTK_DOUBLE_MAX;
-    const size_t nTimesteps = this->Timesteps.size();
-    for (size_t i = 0; i < nTimesteps; ++i)
+    if (this->PacketWriter.IsOpen())
       {
-      double difference = std::abs(this->Timesteps[i] - time);
-        if (difference < minDifference)
-          {
-          minDifference = difference;
-          index = i;
-          }
+      this->PacketWriter.WritePacket(reinterpret_cast<const unsigned char*>(packet.Data->c_str()),
+        packet.Data->length(), packet.Time);
+      delete packet.Data;
+      return;
+      }
+
+    this->Ring.push_back(packet);
+    while (!this->Ring.empty() && ToSeconds(this->Ring.front().Time) < time - this->PreTriggerTime)
+      {
+      delete this->Ring.front().Data;
+      this->Ring.pop_front();
       }
-    return index;
   }
 
-  void HandleNewData(vtkSmartPointer<vtkPolyData> polyData)
+  void StartRecording(double startTime)
   {
-    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    std::stringstream filename;
+    filename << this->FilePrefix << "-"
+             << boost::posix_time::to_iso_string(boost::posix_time::second_clock::local_time())
+             << "-" << this->NumberOfRecordings++ << ".pcap";
 
-    this->UpdateDequeSize();
-    this->Timesteps.push_back(this->LastTime);
-    this->Datasets.push_back(polyData);
-    this->NewData = true;
-    this->LastTime += 1.0;
+    if (!this->PacketWriter.Open(filename.str()))
+      {
+      vtkGenericWarningMacro("Failed to open packet file: " << filename.str());
+      return;
+      }
+
+    while (!this->Ring.empty())
+      {
+      TimedPacket& packet = this->Ring.front();
+      if (ToSeconds(packet.Time) >= startTime)
+        {
+        this->PacketWriter.WritePacket(reinterpret_cast<const unsigned char*>(packet.Data->c_str()),
+          packet.Data->length(), packet.Time);
+        }
+      delete packet.Data;
+      this->Ring.pop_front();
+      }
   }
 
-  bool NewData;
-  int MaxNumberOfDatasets;
-  double LastTime;
-  boost::mutex Mutex;
-  boost::mutex PacketMutex;
-  std::deque<vtkSmartPointer<vtkPolyData> > Datasets;
-  std::deque<double> Timesteps;
-  vtkNew<vtkVelodyneHDLReader> HDLReader;
+  std::string FilePrefix;
+  double PreTriggerTime;
+  double PostTriggerTime;
+  double RecordUntil;
+  int NumberOfRecordings;
 
-  boost::shared_ptr<SynchronizedQueue<std::string*> > Packets;
+  boost::mutex TriggerMutex;
+  bool HasPendingTrigger;
+  double FirstPendingTrigger;
+  double LastPendingTrigger;
 
+  std::deque<TimedPacket> Ring;
+  vtkPacketFileWriter PacketWriter;
   boost::shared_ptr<boost::thread> Thread;
+  boost::shared_ptr<SynchronizedQueue<TimedPacket> > Packets;
 };
 
 
 //----------------------------------------------------------------------------
-class PacketFileWriter
+void ComputeFrameStatistics(vtkPolyData* frame, vtkVelodyneHDLSource::FrameStatistics& statistics)
+{
+  statistics.NumberOfPoints = frame->GetNumberOfPoints();
+  statistics.MinDistance = 0;
+  statistics.MaxDistance = 0;
+  statistics.MeanIntensity = 0;
+
+  vtkDoubleArray* distance = vtkDoubleArray::SafeDownCast(frame->GetPointData()->GetArray("distance_m"));
+  vtkUnsignedCharArray* intensity = vtkUnsignedCharArray::SafeDownCast(frame->GetPointData()->GetArray("intensity"));
+  if (!statistics.NumberOfPoints || !distance || !intensity)
+    {
+    return;
+    }
+
+  statistics.MinDistance = VTK_DOUBLE_MAX;
+  double intensitySum = 0;
+  for (vtkIdType i = 0; i < statistics.NumberOfPoints; ++i)
+    {
+    const double value = distance->GetValue(i);
+    statistics.MinDistance = std::min(statistics.MinDistance, value);
+    statistics.MaxDistance = std::max(statistics.MaxDistance, value);
+    intensitySum += intensity->GetValue(i);
+    }
+  statistics.MeanIntensity = intensitySum / statistics.NumberOfPoints;
+}
+
+//----------------------------------------------------------------------------
+// Microsecond histogram of the time from the receipt of a packet to the end
+// of its decoding.  Written by the decoding thread and read by any thread
+// without locking.
+class LatencyHistogram
 {
 public:
 
-  void ThreadLoop()
+  enum
   {
-    std::string* packet = 0;
-    while (this->Packets->dequeue(packet))
-      {
-      this->PacketWriter.WritePacket(reinterpret_cast<const unsigned char*>(packet->c_str()), packet->length());
-      delete packet;
-      }
-  }
+    NUMBER_OF_BINS = 1024
+  };
 
-  void Start(const std::string& filename)
+  LatencyHistogram()
   {
-    if (this->Thread)
-      {
-      return;
-      }
+    this->Reset();
+  }
 
-    if (this->PacketWriter.GetFileName() != filename)
+  void Reset()
+  {
+    for (int i = 0; i <= NUMBER_OF_BINS; ++i)
       {
-      this->PacketWriter.Close();
+      this->Bins[i].store(0, boost::memory_order_relaxed);
       }
+    this->Count.store(0, boost::memory_order_relaxed);
+    this->Sum.store(0, boost::memory_order_relaxed);
+    this->Max.store(0, boost::memory_order_relaxed);
+  }
 
-    if (!this->PacketWriter.IsOpen())
+  void Add(double seconds)
+  {
+    const vtkTypeUInt64 microseconds = seconds > 0 ? static_cast<vtkTypeUInt64>(seconds * 1e6) : 0;
+    const int bin = static_cast<int>(std::min<vtkTypeUInt64>(microseconds, NUMBER_OF_BINS));
+    this->Bins[bin].fetch_add(1, boost::memory_order_relaxed);
+    this->Count.fetch_add(1, boost::memory_order_relaxed);
+    this->Sum.fetch_add(microseconds, boost::memory_order_relaxed);
+
+    // single writer, no compare and swap needed
+    if (microseconds > this->Max.load(boost::memory_order_relaxed))
       {
-      if (!this->PacketWriter.Open(filename))
-        {
-        vtkGenericWarningMacro("Failed to open packet file: " << filename);
-        return;
-        }
+      this->Max.store(microseconds, boost::memory_order_relaxed);
       }
-
-    this->Packets.reset(new SynchronizedQueue<std::string*>);
-    this->Thread = boost::shared_ptr<boost::thread>(
-      new boost::thread(boost::bind(&PacketFileWriter::ThreadLoop, this)));
   }
 
-  void Stop()
+  vtkIdType GetCount() const
   {
-    if (this->Thread)
-      {
-      this->Packets->stopQueue();
-      this->Thread->join();
-      this->Thread.reset();
-      this->Packets.reset();
-      }
+    return static_cast<vtkIdType>(this->Count.load(boost::memory_order_relaxed));
   }
 
-  void Enqueue(std::string* packet)
+  double GetMean() const
   {
-    this->Packets->enqueue(packet);
+    const vtkTypeUInt64 count = this->Count.load(boost::memory_order_relaxed);
+    return count ? static_cast<double>(this->Sum.load(boost::memory_order_relaxed)) / count : 0;
   }
 
-  bool IsOpen()
+  double GetMax() const
   {
-    return this->PacketWriter.IsOpen();
+    return static_cast<double>(this->Max.load(boost::memory_order_relaxed));
   }
 
-  void Close()
+  // Upper bound of the bin holding the percentile, or the maximum past the
+  // last bin.
+  double GetPercentile(double percentile) const
   {
-    this->PacketWriter.Close();
+    const vtkTypeUInt64 count = this->Count.load(boost::memory_order_relaxed);
+    if (!count)
+      {
+      return 0;
+      }
+
+    const double rank = std::max(1.0, std::ceil(std::min(percentile, 100.0) / 100.0 * count));
+    vtkTypeUInt64 seen = 0;
+    for (int i = 0; i < NUMBER_OF_BINS; ++i)
+      {
+      seen += this->Bins[i].load(boost::memory_order_relaxed);
+      if (seen >= rank)
+        {
+        return i + 1;
+        }
+      }
+    return this->GetMax();
   }
 
 private:
-  vtkPacketFileWriter PacketWriter;
-  boost::shared_ptr<boost::thread> Thread;
-  boost::shared_ptr<SynchronizedQueue<std::string*> > Packets;
-};
 
+  boost::atomic<vtkTypeUInt64> Bins[NUMBER_OF_BINS + 1];
+  boost::atomic<vtkTypeUInt64> Count;
+  boost::atomic<vtkTypeUInt64> Sum;
+  boost::atomic<vtkTypeUInt64> Max;
+};
 
 //----------------------------------------------------------------------------
-class PacketNetworkSource
+class PacketConsumer
 {
 public:
 
-  void StartReceive()
+  PacketConsumer()
   {
-    // expecting exactly 1206 bytes, using a larger buffer so that if a
-    // larger packet arrives unexpectedly we'll notice it.
-    this->Socket->async_receive(boost::asio::buffer(this->RXBuffer, 1500),
-      boost::bind(&PacketNetworkSource::SocketCallback, this,
-      boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+    this->NewData = false;
+    this->MaxNumberOfDatasets = 1000;
+    this->MemoryBudget = static_cast<vtkTypeUInt64>(1024) * 1024 * 1024;
+    this->MemoryUsage = 0;
+    this->TimeWindow = 1.0;
+    this->Compression = false;
+    this->CompressionFormat = vtkVelodyneHDLSource::COMPRESS_LOSSLESS;
+    this->CompressionAge = 0;
+    this->QuantizationStep = 0.005;
+    this->LastTime = 0.0;
+    this->FirstTimestep = VTK_DOUBLE_MAX;
+    this->HasHistoryFrameStart = false;
+    this->HistoryFrameStart = 0;
+    this->Predicate = 0;
+    this->PredicateClientData = 0;
+    this->TimestepsOffset = 0;
+    this->ClearPendingHistory = false;
+    this->MinimumCoverage = 0;
+    this->FrameTimeout = 0;
+    this->LastPacketTime = 0;
+    this->StopTimeout = false;
+    this->LastPacketIndex = 0;
+    this->DroppedFrames = 0;
   }
 
-  void SocketCallback(const boost::system::error_code& error, std::size_t numberOfBytes)
+  // Description:
+  // Decodes a packet.  receiveTime, from vtkTimerLog::GetUniversalTime(),
+  // is when the packet came off the network, 0 for packets read from a
+  // file, which pass their capture time in captureTime instead.  Several
+  // threads may call it, the packets are decoded one at a time.
+  void HandleSensorData(const unsigned char* data, unsigned int length, double receiveTime = 0,
+    double captureTime = 0)
   {
-    if (this->ShouldStop)
-      {
-      return;
-      }
-
-    //this->Consumer->HandleSensorData(this->RXBuffer, numberOfBytes);
-
-    std::string* packet = new std::string(this->RXBuffer, numberOfBytes);
-    this->Consumer->Enqueue(packet);
-
-    if (this->Writer)
+    boost::lock_guard<boost::mutex> lock(this->DecodeMutex);
+    this->DecodePacket(data, length, receiveTime > 0 ? receiveTime : captureTime);
+    if (receiveTime > 0)
       {
-      std::string* packet = new std::string(this->RXBuffer, numberOfBytes);
-      this->Writer->Enqueue(packet);
+      this->Latency.Add(vtkTimerLog::GetUniversalTime() - receiveTime);
       }
-
-    this->StartReceive();
-
-    //static unsigned long packetCounter = 0;
-    //if ((++packetCounter % 500) == 0)
-    //  {
-    //  printf("total recv packets %lu\n", packetCounter);
-    //  }
-  }
-
-  void ThreadLoop()
-  {
-    this->StartReceive();
-    this->IOService.reset();
-    this->IOService.run();
   }
 
-  void Start(int sensorPort)
+  void DecodePacket(const unsigned char* data, unsigned int length, double hostTime)
   {
-    if (this->Thread)
+    if (length == vtkSensorClock::POSITION_PACKET_SIZE)
       {
+      // position packets interleaved with the data in packet files
+      this->HandlePositionPacket(data, length, hostTime);
       return;
       }
 
-    std::string destinationIp = "192.168.3.255";
-
-    this->Socket.reset();
-
-    // destinationEndpoint is the socket on this machine where the data packet are received
-    boost::asio::ip::udp::endpoint destinationEndpoint(boost::asio::ip::address_v4::any(), sensorPort);
-    //boost::asio::ip::udp::endpoint destinationEndpoint(boost::asio::ip::address::from_string(destinationIp), sensorPort);
-
-    try
+    const bool keepPackets = (this->CompressionFormat.load() == vtkVelodyneHDLSource::COMPRESS_PACKETS &&
+      length == 1206);
+    if (keepPackets)
       {
-      this->Socket = boost::shared_ptr<boost::asio::ip::udp::socket>(new boost::asio::ip::udp::socket(this->IOService));
-      this->Socket->open(destinationEndpoint.protocol());
-      this->Socket->bind(destinationEndpoint);
+      this->CurrentPackets.append(reinterpret_cast<const char*>(data), length);
       }
-    catch( std::exception & e )
+    else
       {
-      vtkGenericWarningMacro("Caught exception while binding to " << destinationIp << ": " << e.what());
+      this->CurrentPackets.clear();
+      }
 
-      try
-        {
-        destinationEndpoint = boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::any(), sensorPort);
+    uint64_t packetIndex = 0;
+    const bool onDisk = (this->HistoryFile && length == 1206 && this->HistoryFile->WritePacket(data, packetIndex));
+    if (onDisk && (!this->HasHistoryFrameStart || packetIndex < this->HistoryFrameStart))
+      {
+      // first packet written, or the history file was opened again
+      this->HistoryFrameStart = packetIndex;
+      this->HasHistoryFrameStart = true;
+      }
+    else if (!onDisk)
+      {
+      this->HasHistoryFrameStart = false;
+      }
 
-        this->Socket = boost::shared_ptr<boost::asio::ip::udp::socket>(new boost::asio::ip::udp::socket(this->IOService));
-        this->Socket->open(destinationEndpoint.protocol());
-        this->Socket->bind(destinationEndpoint);
-        }
-      catch( std::exception & e )
+    if (onDisk)
+      {
+      this->LastPacketIndex = packetIndex;
+      }
+    if (this->FrameTimeout > 0)
+      {
+      if (this->LastPacketTime <= 0)
         {
-        vtkGenericWarningMacro("Caught Exception: " << e.what());
-        return;
+        // the timeout thread waits for the first packet of a frame, later
+        // ones only move its deadline
+        this->TimeoutCondition.notify_one();
         }
+      this->LastPacketTime = vtkTimerLog::GetUniversalTime();
       }
 
-    this->ShouldStop = false;
-    this->Thread = boost::shared_ptr<boost::thread>(
-      new boost::thread(boost::bind(&PacketNetworkSource::ThreadLoop, this)));
+    this->HDLReader->ProcessHDLPacket(const_cast<unsigned char*>(data), length);
+    if (this->HDLReader->GetDatasets().size())
+      {
+      // the packet that completed the frame also starts the next one, and
+      // so do the packets still held back by the reorder window, which the
+      // history reader puts back in order
+      const size_t overlap = this->HDLReader->GetReorderWindow() + 1;
+      boost::shared_ptr<std::string> packets;
+      if (keepPackets)
+        {
+        packets.reset(new std::string(this->CurrentPackets));
+        const size_t keep = std::min(this->CurrentPackets.size(), overlap * length);
+        this->CurrentPackets.erase(0, this->CurrentPackets.size() - keep);
+        }
+
+      HistoryFrame historyFrame;
+      historyFrame.FirstPacket = 0;
+      historyFrame.NumberOfPackets = 0;
+      historyFrame.Partial = false;
+      if (onDisk)
+        {
+        historyFrame.FirstPacket = this->HistoryFrameStart;
+        historyFrame.NumberOfPackets = packetIndex + 1 - this->HistoryFrameStart;
+        this->HistoryFrameStart = std::max(this->HistoryFrameStart, packetIndex + 1 - std::min<uint64_t>(overlap, packetIndex + 1));
+        }
+
+      this->PublishFrame(packets, historyFrame);
+      }
+  }
+
+  // Description:
+  // Publishes the frame in progress, which got no packet for the frame
+  // timeout, so that the last frame before the sensor stops is not held
+  // back forever.  Called with DecodeMutex held.
+  void PublishTimedOutFrame()
+  {
+    this->LastPacketTime = 0;
+
+    if (!this->HDLReader->PublishPartialFrame())
+      {
+      return;
+      }
+    std::vector<vtkSmartPointer<vtkPolyData> >& datasets = this->HDLReader->GetDatasets();
+    while (datasets.size() > 1)
+      {
+      // the reorder window held a wrap, the frame it completed goes first
+      // with no packets to decode it again
+      HistoryFrame historyFrame;
+      historyFrame.FirstPacket = 0;
+      historyFrame.NumberOfPackets = 0;
+      historyFrame.Partial = false;
+      vtkSmartPointer<vtkPolyData> frame = datasets.front();
+      datasets.erase(datasets.begin());
+      this->PublishFrame(boost::shared_ptr<std::string>(), historyFrame, frame);
+      }
+
+    // every packet since the frame started is needed to decode it again,
+    // none starts the next frame
+    boost::shared_ptr<std::string> packets;
+    if (!this->CurrentPackets.empty())
+      {
+      packets.reset(new std::string);
+      packets->swap(this->CurrentPackets);
+      }
+
+    HistoryFrame historyFrame;
+    historyFrame.FirstPacket = 0;
+    historyFrame.NumberOfPackets = 0;
+    historyFrame.Partial = true;
+    if (this->HasHistoryFrameStart && this->LastPacketIndex >= this->HistoryFrameStart)
+      {
+      historyFrame.FirstPacket = this->HistoryFrameStart;
+      historyFrame.NumberOfPackets = this->LastPacketIndex + 1 - this->HistoryFrameStart;
+      this->HistoryFrameStart = this->LastPacketIndex + 1;
+      }
+
+    this->PublishFrame(packets, historyFrame);
+  }
+
+  // Waits on TimeoutCondition, with the decode mutex, until the last
+  // packet is older than the timeout.  It only wakes for the first packet
+  // after a frame timed out and at the deadline.
+  void ThreadLoopTimeout()
+  {
+    boost::unique_lock<boost::mutex> lock(this->DecodeMutex);
+    while (!this->StopTimeout)
+      {
+      if (this->LastPacketTime <= 0)
+        {
+        this->TimeoutCondition.wait(lock);
+        continue;
+        }
+
+      const double remaining = this->LastPacketTime + this->FrameTimeout - vtkTimerLog::GetUniversalTime();
+      if (remaining > 0)
+        {
+        this->TimeoutCondition.timed_wait(lock,
+          boost::posix_time::microseconds(static_cast<boost::int64_t>(remaining * 1e6) + 1));
+        continue;
+        }
+
+      this->PublishTimedOutFrame();
+      }
+  }
+
+  // Description:
+  // Frames completed by an azimuth wrap with a smaller fraction of the
+  // revolution covered are dropped, and a frame left incomplete for the
+  // timeout in seconds is published as it is.  With publishOnCoverage,
+  // frames are published as soon as they reach minimumCoverage instead of
+  // on the wrap.  Set before Start().
+  void SetFramePolicy(double minimumCoverage, bool publishOnCoverage, double frameTimeout)
+  {
+    boost::lock_guard<boost::mutex> lock(this->DecodeMutex);
+    this->MinimumCoverage = minimumCoverage;
+    this->FrameTimeout = frameTimeout;
+
+    // the history reader ends the frames where the live one did
+    const double publishCoverage = publishOnCoverage ? minimumCoverage : 0;
+    this->HDLReader->SetPublishCoverage(publishCoverage);
+    this->HistoryReader->SetPublishCoverage(publishCoverage);
+  }
+
+  vtkIdType GetNumberOfDroppedFrames()
+  {
+    return this->DroppedFrames.load();
+  }
+
+  void StartFrameTimeout()
+  {
+    if (this->TimeoutThread || this->FrameTimeout <= 0)
+      {
+      return;
+      }
+
+    this->StopTimeout = false;
+    this->TimeoutThread.reset(new boost::thread(boost::bind(&PacketConsumer::ThreadLoopTimeout, this)));
+  }
+
+  void StopFrameTimeout()
+  {
+    if (this->TimeoutThread)
+      {
+        {
+        boost::lock_guard<boost::mutex> lock(this->DecodeMutex);
+        this->StopTimeout = true;
+        }
+      this->TimeoutCondition.notify_one();
+      this->TimeoutThread->join();
+      this->TimeoutThread.reset();
+      }
+  }
+
+  LatencyHistogram& GetLatency()
+  {
+    return this->Latency;
+  }
+
+  vtkSmartPointer<vtkPolyData> GetDatasetForTime(double timeRequest, double& actualTime)
+  {
+    // the newest frame, which is what the pipeline asks for while
+    // following the sensor, is served without locking
+    boost::shared_ptr<const LatestFrame> latest = boost::atomic_load(&this->Latest);
+    if (latest && timeRequest >= latest->Timestep)
+      {
+      actualTime = latest->Timestep;
+      return latest->Dataset;
+      }
+
+    CachedFrame frame;
+    HistoryFrame historyFrame;
+    bool fromHistory = false;
+      {
+      boost::lock_guard<boost::mutex> lock(this->Mutex);
+
+      // history only frames precede the cached frames, the request is
+      // served from the side whose boundary timestep is nearer
+      const size_t nHistoryOnly = this->GetNumberOfHistoryOnlyFrames();
+      if (!this->Frames.empty() && (!nHistoryOnly ||
+          timeRequest - this->HistoryFrames[nHistoryOnly - 1].Timestep > this->Frames.front().Timestep - timeRequest))
+        {
+        frame = this->Frames[FindNearestTimestep(this->Frames, timeRequest)];
+        }
+      else if (nHistoryOnly)
+        {
+        size_t index = std::min(FindNearestTimestep(this->HistoryFrames, timeRequest), nHistoryOnly - 1);
+        historyFrame = this->HistoryFrames[index];
+        fromHistory = true;
+        }
+      else
+        {
+        actualTime = 0;
+        return 0;
+        }
+      }
+
+    if (fromHistory)
+      {
+      actualTime = historyFrame.Timestep;
+      return this->ReadHistoryFrame(historyFrame);
+      }
+
+    actualTime = frame.Timestep;
+    return this->GetDataset(frame);
+  }
+
+  // Description:
+  // Frame with the sensor time nearest to sensorTime, in microseconds past
+  // the hour as stamped by the reader.
+  vtkSmartPointer<vtkPolyData> GetDatasetForSensorTime(double sensorTime, double& actualSensorTime)
+  {
+    CachedFrame frame;
+      {
+      boost::lock_guard<boost::mutex> lock(this->Mutex);
+
+      size_t index = 0;
+      double minDifference = VTK_DOUBLE_MAX;
+      const size_t nDatasets = this->Frames.size();
+      for (size_t i = 0; i < nDatasets; ++i)
+        {
+        double difference = std::abs(vtkVelodyneHDLSource::SensorTimeDifference(this->Frames[i].SensorTime, sensorTime));
+        if (difference < minDifference)
+          {
+          minDifference = difference;
+          index = i;
+          }
+        }
+
+      if (index >= nDatasets)
+        {
+        actualSensorTime = 0;
+        return 0;
+        }
+      frame = this->Frames[index];
+      }
+
+    actualSensorTime = frame.SensorTime;
+    return this->GetDataset(frame);
+  }
+
+  bool GetLatestSensorTime(double& sensorTime)
+  {
+    boost::shared_ptr<const LatestFrame> latest = boost::atomic_load(&this->Latest);
+    if (!latest)
+      {
+      return false;
+      }
+    sensorTime = latest->SensorTime;
+    return true;
+  }
+
+  void GetTimesteps(std::vector<double>& timesteps)
+  {
+    boost::shared_ptr<const LatestFrame> latest = boost::atomic_load(&this->Latest);
+
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    timesteps.assign(this->Timesteps.begin() + this->TimestepsOffset, this->Timesteps.end());
+    if (latest && (timesteps.empty() || timesteps.back() < latest->Timestep))
+      {
+      // the newest frame is published before it is committed to the cache
+      timesteps.push_back(latest->Timestep);
+      }
+  }
+
+  // Description:
+  // First and last timestep, in constant time and without locking.  The
+  // first timestep is the one of the last commit, so an eviction through
+  // the cache settings shows with the next frame.
+  bool GetTimeRange(double timeRange[2])
+  {
+    boost::shared_ptr<const LatestFrame> latest = boost::atomic_load(&this->Latest);
+    if (!latest)
+      {
+      return false;
+      }
+    timeRange[0] = latest->FirstTimestep;
+    timeRange[1] = latest->Timestep;
+    return true;
+  }
+
+
+  int GetMaxNumberOfDatasets()
+  {
+    return this->MaxNumberOfDatasets;
+  }
+
+  void SetMaxNumberOfDatasets(int nDatasets)
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    this->MaxNumberOfDatasets = nDatasets;
+    this->EvictFrames();
+  }
+
+  vtkTypeUInt64 GetMemoryBudget()
+  {
+    return this->MemoryBudget;
+  }
+
+  void SetMemoryBudget(vtkTypeUInt64 bytes)
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    this->MemoryBudget = bytes;
+    this->EvictFrames();
+  }
+
+  vtkTypeUInt64 GetMemoryUsage()
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    return this->MemoryUsage;
+  }
+
+  double GetTimeWindow()
+  {
+    return this->TimeWindow;
+  }
+
+  void SetTimeWindow(double seconds)
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    this->TimeWindow = seconds;
+  }
+
+  bool GetCompression()
+  {
+    return this->Compression;
+  }
+
+  void SetCompression(bool compression)
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    this->Compression = compression;
+  }
+
+  int GetCompressionFormat()
+  {
+    return this->CompressionFormat.load();
+  }
+
+  void SetCompressionFormat(int format)
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    this->CompressionFormat = format;
+  }
+
+  double GetCompressionAge()
+  {
+    return this->CompressionAge;
+  }
+
+  void SetCompressionAge(double seconds)
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    this->CompressionAge = seconds;
+  }
+
+  double GetQuantizationStep()
+  {
+    return this->QuantizationStep;
+  }
+
+  void SetQuantizationStep(double step)
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    this->QuantizationStep = step;
+  }
+
+  bool CheckForNewData()
+  {
+    return this->NewData.exchange(false);
+  }
+
+
+  void ThreadLoop()
+  {
+    ReceivedPacket packet;
+    while (this->Packets->dequeue(packet))
+      {
+      this->HandleSensorData(reinterpret_cast<const unsigned char*>(packet.Data->c_str()), packet.Data->length(),
+        packet.Time);
+      delete packet.Data;
+      }
+  }
+
+  void Start()
+  {
+    if (this->Thread)
+      {
+      return;
+      }
+
+    this->Packets.reset(new SynchronizedQueue<ReceivedPacket>);
+    this->Thread = boost::shared_ptr<boost::thread>(
+      new boost::thread(boost::bind(&PacketConsumer::ThreadLoop, this)));
+  }
+
+  void Stop()
+  {
+    if (this->Thread)
+      {
+      this->Packets->stopQueue();
+      this->Thread->join();
+      this->Thread.reset();
+
+      // packets received after the last one decoded
+      ReceivedPacket packet;
+      while (this->Packets->tryDequeue(packet))
+        {
+        delete packet.Data;
+        }
+      this->Packets.reset();
+      }
+  }
+
+  void Enqueue(std::string* packet, double receiveTime)
+  {
+    ReceivedPacket receivedPacket;
+    receivedPacket.Data = packet;
+    receivedPacket.Time = receiveTime;
+    if (!this->Packets->enqueue(receivedPacket))
+      {
+      delete packet;
+      }
+  }
+
+  vtkVelodyneHDLReader* GetReader()
+  {
+    return this->HDLReader.GetPointer();
+  }
+
+  // Description:
+  // hostTime is when the packet was received, or captured for packets
+  // read from a file, in seconds since the epoch.
+  void HandlePositionPacket(const unsigned char* data, unsigned int length, double hostTime)
+  {
+    this->Clock.HandlePositionPacket(data, length, hostTime);
+  }
+
+  vtkSensorClock* GetClock()
+  {
+    return &this->Clock;
+  }
+
+  // Description:
+  // Reader that decodes the frames kept as packets, configured like the
+  // live reader.
+  vtkVelodyneHDLReader* GetHistoryReader()
+  {
+    return this->HistoryReader.GetPointer();
+  }
+
+  void SetArrowWriter(boost::shared_ptr<FrameArrowWriter> writer)
+  {
+    boost::lock_guard<boost::mutex> lock(this->OutputsMutex);
+    this->ArrowWriter = writer;
+  }
+
+#ifndef _WIN32
+  void SetFrameServer(boost::shared_ptr<vtkFrameSocketServer> server)
+  {
+    boost::lock_guard<boost::mutex> lock(this->OutputsMutex);
+    this->FrameServer = server;
+  }
+#endif
+
+  void SetRecorder(boost::shared_ptr<TriggeredPacketRecorder> recorder)
+  {
+    boost::lock_guard<boost::mutex> lock(this->OutputsMutex);
+    this->Recorder = recorder;
+  }
+
+  void SetTriggerPredicate(vtkVelodyneHDLSource::TriggerPredicate predicate, void* clientData)
+  {
+    boost::lock_guard<boost::mutex> lock(this->OutputsMutex);
+    this->Predicate = predicate;
+    this->PredicateClientData = clientData;
+  }
+
+  void NotifyNextFrame(vtkVelodyneHDLSource::FrameCallback callback, void* clientData)
+  {
+    boost::lock_guard<boost::mutex> lock(this->OutputsMutex);
+    this->FrameCallbacks.push_back(std::make_pair(callback, clientData));
+  }
+
+  // Description:
+  // Calls the waiting frame callbacks with a NULL frame.
+  void CancelFrameCallbacks()
+  {
+    std::vector<std::pair<vtkVelodyneHDLSource::FrameCallback, void*> > callbacks;
+      {
+      boost::lock_guard<boost::mutex> lock(this->OutputsMutex);
+      callbacks.swap(this->FrameCallbacks);
+      }
+    for (size_t i = 0; i < callbacks.size(); ++i)
+      {
+      callbacks[i].first(0, 0, callbacks[i].second);
+      }
+  }
+
+  // Description:
+  // Ring file every packet is written to while it is open.  Set it before
+  // the consumer starts; the file itself may be opened and closed later.
+  void SetHistoryFile(boost::shared_ptr<vtkPacketRingFile> historyFile)
+  {
+    this->HistoryFile = historyFile;
+  }
+
+  // Description:
+  // Forgets the frames indexed in the history file, called when the file
+  // is opened again.
+  void ClearHistory()
+  {
+    boost::lock_guard<boost::mutex> lock(this->Mutex);
+    this->HistoryFrames.clear();
+    this->ClearPendingHistory = true;
+    this->TrimTimesteps();
+  }
+
+protected:
+
+  // Frame whose packets are stored in the history file.
+  struct HistoryFrame
+  {
+    double Timestep;
+    double SensorTime;
+    double ContinuousTime;
+    uint64_t FirstPacket;
+    uint64_t NumberOfPackets;
+    bool Partial;
+  };
+
+  vtkSmartPointer<vtkPolyData> ReadHistoryFrame(const HistoryFrame& frame)
+  {
+    std::string packets;
+    if (!this->HistoryFile->ReadPackets(frame.FirstPacket, frame.NumberOfPackets, packets))
+      {
+      return 0;
+      }
+
+    boost::lock_guard<boost::mutex> lock(this->HistoryMutex);
+    return this->HistoryReader->DecodeFrame(packets, frame.ContinuousTime, frame.Partial);
+  }
+
+  // Frames that were evicted from the cache but can still be read from the
+  // history file.  They come first in the time steps, followed by the
+  // cached frames.
+  size_t GetNumberOfHistoryOnlyFrames()
+  {
+    if (this->Frames.empty())
+      {
+      return this->HistoryFrames.size();
+      }
+    return LowerBoundTimestep(this->HistoryFrames, this->Frames.front().Timestep);
+  }
+
+  // Both kinds of frames are stored in timestep order, so lookups are
+  // binary searches.
+  template<typename FrameType>
+  static size_t LowerBoundTimestep(const std::deque<FrameType>& frames, double time)
+  {
+    size_t low = 0;
+    size_t high = frames.size();
+    while (low < high)
+      {
+      const size_t middle = low + (high - low) / 2;
+      if (frames[middle].Timestep < time)
+        {
+        low = middle + 1;
+        }
+      else
+        {
+        high = middle;
+        }
+      }
+    return low;
+  }
+
+  template<typename FrameType>
+  static size_t FindNearestTimestep(const std::deque<FrameType>& frames, double time)
+  {
+    size_t index = LowerBoundTimestep(frames, time);
+    if (index == frames.size() ||
+        (index > 0 && time - frames[index - 1].Timestep <= frames[index].Timestep - time))
+      {
+      return index ? index - 1 : 0;
+      }
+    return index;
+  }
+
+  // The published timesteps are those of the history only frames and the
+  // cached frames.  New frames are appended and evicted ones skipped by
+  // moving an offset, which is compacted once it covers half the array.
+  void TrimTimesteps()
+  {
+    double firstTimestep = VTK_DOUBLE_MAX;
+    if (!this->HistoryFrames.empty())
+      {
+      firstTimestep = this->HistoryFrames.front().Timestep;
+      }
+    if (!this->Frames.empty())
+      {
+      firstTimestep = std::min(firstTimestep, this->Frames.front().Timestep);
+      }
+
+    while (this->TimestepsOffset < this->Timesteps.size() && this->Timesteps[this->TimestepsOffset] < firstTimestep)
+      {
+      ++this->TimestepsOffset;
+      }
+
+    if (this->TimestepsOffset && this->TimestepsOffset >= this->Timesteps.size() / 2)
+      {
+      this->Timesteps.erase(this->Timesteps.begin(), this->Timesteps.begin() + this->TimestepsOffset);
+      this->TimestepsOffset = 0;
+      }
+  }
+
+  // A cached frame holds the decoded dataset or, once compressed, either
+  // its compact copy or the packets it was decoded from.  Neither is
+  // modified after it is stored, so frames are expanded outside the lock.
+  struct CachedFrame
+  {
+    vtkSmartPointer<vtkPolyData> Dataset;
+    boost::shared_ptr<vtkCompressedFrame> Compressed;
+    boost::shared_ptr<std::string> Packets;
+    double Timestep;
+    double SensorTime;
+    double ContinuousTime;
+    double ArrivalTime;
+    vtkTypeUInt64 MemorySize;
+    bool Partial;
+  };
+
+  vtkSmartPointer<vtkPolyData> GetDataset(const CachedFrame& frame)
+  {
+    if (frame.Dataset)
+      {
+      return frame.Dataset;
+      }
+    if (frame.Compressed)
+      {
+      return frame.Compressed->Decompress();
+      }
+    if (frame.Packets)
+      {
+      boost::lock_guard<boost::mutex> lock(this->HistoryMutex);
+      return this->HistoryReader->DecodeFrame(*frame.Packets, frame.ContinuousTime, frame.Partial);
+      }
+    return 0;
+  }
+
+  void PopFrame()
+  {
+    this->MemoryUsage -= this->Frames.front().MemorySize;
+    this->Frames.pop_front();
+  }
+
+  // Enforces the frame count, then evicts the oldest frames while the
+  // memory budget is exceeded, keeping the frames of the time window.
+  void EvictFrames()
+  {
+    if (this->MaxNumberOfDatasets > 0)
+      {
+      while (this->Frames.size() > static_cast<size_t>(this->MaxNumberOfDatasets))
+        {
+        this->PopFrame();
+        }
+      }
+
+    if (this->MemoryBudget)
+      {
+      const double now = vtkTimerLog::GetUniversalTime();
+      while (this->Frames.size() > 1 && this->MemoryUsage > this->MemoryBudget &&
+             now - this->Frames.front().ArrivalTime > this->TimeWindow)
+        {
+        this->PopFrame();
+        }
+      }
+
+    this->TrimTimesteps();
+  }
+
+  // Oldest frame that is still decoded, other than the newest one, once
+  // half of the memory budget is used or once it is older than the
+  // compression age.
+  CachedFrame* GetCompressionCandidate(double now)
+  {
+    const bool underPressure = this->Compression && this->MemoryBudget &&
+      this->MemoryUsage > this->MemoryBudget / 2;
+    if (!underPressure && this->CompressionAge <= 0)
+      {
+      return 0;
+      }
+
+    const size_t nFrames = this->Frames.size();
+    for (size_t i = 0; i + 1 < nFrames; ++i)
+      {
+      CachedFrame& frame = this->Frames[i];
+      if (frame.Dataset)
+        {
+        if (underPressure || (this->CompressionAge > 0 && now - frame.ArrivalTime > this->CompressionAge))
+          {
+          return &frame;
+          }
+        return 0;
+        }
+      }
+    return 0;
+  }
+
+  // Frames that kept their packets only drop the decoded dataset.
+  void DropDataset(CachedFrame& frame)
+  {
+    this->MemoryUsage -= frame.MemorySize;
+    frame.MemorySize = frame.Packets->size();
+    this->MemoryUsage += frame.MemorySize;
+    frame.Dataset = 0;
+  }
+
+  // Newest frame, published to readers with an atomic pointer swap.  It is
+  // never modified once published.
+  struct LatestFrame
+  {
+    vtkSmartPointer<vtkPolyData> Dataset;
+    double Timestep;
+    double SensorTime;
+    double FirstTimestep;
+  };
+
+  // Frame decoded but not yet stored in the cache, and compact copy not
+  // yet swapped in, kept by the decoding thread while readers hold the
+  // cache lock.
+  struct PendingFrame
+  {
+    CachedFrame Frame;
+    HistoryFrame History;
+  };
+
+  struct PendingCompression
+  {
+    vtkSmartPointer<vtkPolyData> Dataset;
+    double Timestep;
+    boost::shared_ptr<vtkCompressedFrame> Compressed;
+  };
+
+  // Stores the pending frames and compact copies in the cache and picks the
+  // next frame to compress.  Called by the decoding thread with the lock
+  // held.
+  void CommitPending(double now, vtkSmartPointer<vtkPolyData>& compressDataset,
+                     double& compressTimestep, double& quantizationStep)
+  {
+    for (size_t i = 0; i < this->PendingCompressions.size(); ++i)
+      {
+      this->StoreCompressedFrame(this->PendingCompressions[i]);
+      }
+    this->PendingCompressions.clear();
+
+    if (this->ClearPendingHistory)
+      {
+      // pending frames index the history file as it was before reopening
+      for (size_t i = 0; i < this->PendingFrames.size(); ++i)
+        {
+        this->PendingFrames[i].History.NumberOfPackets = 0;
+        }
+      this->ClearPendingHistory = false;
+      }
+
+    bool hasHistory = false;
+    for (size_t i = 0; i < this->PendingFrames.size(); ++i)
+      {
+      const PendingFrame& pending = this->PendingFrames[i];
+      this->Frames.push_back(pending.Frame);
+      this->Timesteps.push_back(pending.Frame.Timestep);
+      this->MemoryUsage += pending.Frame.MemorySize;
+      if (pending.History.NumberOfPackets)
+        {
+        this->HistoryFrames.push_back(pending.History);
+        hasHistory = true;
+        }
+      }
+    this->PendingFrames.clear();
+    this->EvictFrames();
+
+    if (hasHistory)
+      {
+      const uint64_t firstAvailable = this->HistoryFile->GetFirstAvailablePacket();
+      while (!this->HistoryFrames.empty() && this->HistoryFrames.front().FirstPacket < firstAvailable)
+        {
+        this->HistoryFrames.pop_front();
+        }
+      this->TrimTimesteps();
+      }
+
+    if (CachedFrame* candidate = this->GetCompressionCandidate(now))
+      {
+      if (candidate->Packets)
+        {
+        this->DropDataset(*candidate);
+        }
+      else
+        {
+        compressDataset = candidate->Dataset;
+        compressTimestep = candidate->Timestep;
+        if (this->CompressionFormat.load() == vtkVelodyneHDLSource::COMPRESS_QUANTIZED)
+          {
+          quantizationStep = this->QuantizationStep;
+          }
+        }
+      }
+  }
+
+  void StoreCompressedFrame(const PendingCompression& compression)
+  {
+    const size_t nFrames = this->Frames.size();
+    for (size_t i = 0; i < nFrames; ++i)
+      {
+      CachedFrame& frame = this->Frames[i];
+      if (frame.Timestep == compression.Timestep && frame.Dataset == compression.Dataset)
+        {
+        this->MemoryUsage -= frame.MemorySize;
+        frame.MemorySize = compression.Compressed->GetMemorySize();
+        this->MemoryUsage += frame.MemorySize;
+        frame.Compressed = compression.Compressed;
+        frame.Dataset = 0;
+        break;
+        }
+      }
+  }
+
+  void CompressFrame(vtkSmartPointer<vtkPolyData> dataset, double timestep, double quantizationStep)
+  {
+    PendingCompression compression;
+    compression.Dataset = dataset;
+    compression.Timestep = timestep;
+    compression.Compressed.reset(new vtkCompressedFrame);
+    compression.Compressed->Compress(dataset, quantizationStep);
+
+    boost::unique_lock<boost::mutex> lock(this->Mutex, boost::try_to_lock);
+    if (lock.owns_lock())
+      {
+      this->StoreCompressedFrame(compression);
+      }
+    else
+      {
+      this->PendingCompressions.push_back(compression);
+      }
+  }
+
+  // The decoding thread never waits for readers: the new frame is
+  // published to the lock free latest frame first, then stored in the
+  // cache only if the lock is free.  Otherwise it waits in the pending
+  // frames for the next frame.
+  // Hands the frame completed last, or the given frame, to HandleNewData
+  // unless its coverage is below the minimum.
+  void PublishFrame(boost::shared_ptr<std::string> packets, const HistoryFrame& historyFrame,
+                    vtkSmartPointer<vtkPolyData> polyData = 0)
+  {
+    if (!polyData)
+      {
+      polyData = this->HDLReader->GetDatasets().back();
+      this->HDLReader->GetDatasets().clear();
+      }
+
+    vtkDataArray* coverage = polyData->GetFieldData()->GetArray("azimuth_coverage");
+    if (!historyFrame.Partial && this->MinimumCoverage > 0 &&
+        coverage && coverage->GetNumberOfTuples() && coverage->GetComponent(0, 0) < this->MinimumCoverage)
+      {
+      ++this->DroppedFrames;
+      return;
+      }
+
+    this->HandleNewData(polyData, packets, historyFrame);
+  }
+
+  void HandleNewData(vtkSmartPointer<vtkPolyData> polyData, boost::shared_ptr<std::string> packets,
+                     HistoryFrame historyFrame)
+  {
+    PendingFrame pending;
+    CachedFrame& frame = pending.Frame;
+    frame.Dataset = polyData;
+    frame.Packets = packets;
+    frame.SensorTime = 0;
+    frame.ContinuousTime = -1;
+    frame.ArrivalTime = vtkTimerLog::GetUniversalTime();
+    frame.Partial = historyFrame.Partial;
+    frame.MemorySize = static_cast<vtkTypeUInt64>(polyData->GetActualMemorySize()) * 1024;
+    if (packets)
+      {
+      frame.MemorySize += packets->size();
+      }
+    vtkDataArray* sensorTimeArray = polyData->GetFieldData()->GetArray("sensor_time_us");
+    if (sensorTimeArray && sensorTimeArray->GetNumberOfTuples())
+      {
+      frame.SensorTime = sensorTimeArray->GetComponent(0, 0);
+      }
+    vtkDataArray* continuousTimeArray = polyData->GetFieldData()->GetArray("continuous_time_us");
+    if (continuousTimeArray && continuousTimeArray->GetNumberOfTuples())
+      {
+      frame.ContinuousTime = continuousTimeArray->GetComponent(0, 0);
+      }
+    frame.Timestep = this->LastTime;
+    this->LastTime += 1.0;
+
+    // one value per frame, points keep their sensor time
+    double absoluteTime = 0;
+    if (sensorTimeArray && sensorTimeArray->GetNumberOfTuples() &&
+        this->Clock.GetAbsoluteTime(frame.SensorTime, absoluteTime))
+      {
+      vtkNew<vtkDoubleArray> absoluteTimeArray;
+      absoluteTimeArray->SetName("absolute_time_s");
+      absoluteTimeArray->InsertNextValue(absoluteTime);
+      polyData->GetFieldData()->AddArray(absoluteTimeArray.GetPointer());
+      }
+
+    historyFrame.Timestep = frame.Timestep;
+    historyFrame.SensorTime = frame.SensorTime;
+    historyFrame.ContinuousTime = frame.ContinuousTime;
+    pending.History = historyFrame;
+    this->PendingFrames.push_back(pending);
+
+    boost::shared_ptr<LatestFrame> latest(new LatestFrame);
+    latest->Dataset = polyData;
+    latest->Timestep = frame.Timestep;
+    latest->SensorTime = frame.SensorTime;
+    latest->FirstTimestep = this->FirstTimestep;
+
+    vtkSmartPointer<vtkPolyData> compressDataset;
+    double compressTimestep = 0;
+    double quantizationStep = 0;
+      {
+      boost::unique_lock<boost::mutex> lock(this->Mutex, boost::try_to_lock);
+      if (lock.owns_lock())
+        {
+        this->CommitPending(frame.ArrivalTime, compressDataset, compressTimestep, quantizationStep);
+        if (this->TimestepsOffset < this->Timesteps.size())
+          {
+          this->FirstTimestep = this->Timesteps[this->TimestepsOffset];
+          }
+        latest->FirstTimestep = this->FirstTimestep;
+        }
+      }
+    if (latest->FirstTimestep > latest->Timestep)
+      {
+      // nothing committed yet
+      latest->FirstTimestep = latest->Timestep;
+      }
+
+    boost::atomic_store(&this->Latest, boost::shared_ptr<const LatestFrame>(latest));
+    this->NewData = true;
+
+    boost::shared_ptr<FrameArrowWriter> arrowWriter;
+    boost::shared_ptr<TriggeredPacketRecorder> recorder;
+    vtkVelodyneHDLSource::TriggerPredicate predicate = 0;
+    void* predicateClientData = 0;
+    std::vector<std::pair<vtkVelodyneHDLSource::FrameCallback, void*> > callbacks;
+#ifndef _WIN32
+    boost::shared_ptr<vtkFrameSocketServer> frameServer;
+#endif
+      {
+      // only taken by the setters, never by readers
+      boost::lock_guard<boost::mutex> lock(this->OutputsMutex);
+      callbacks.swap(this->FrameCallbacks);
+      arrowWriter = this->ArrowWriter;
+      recorder = this->Recorder;
+      predicate = this->Predicate;
+      predicateClientData = this->PredicateClientData;
+#ifndef _WIN32
+      frameServer = this->FrameServer;
+#endif
+      }
+
+    if (recorder && predicate)
+      {
+      vtkVelodyneHDLSource::FrameStatistics statistics;
+      ComputeFrameStatistics(polyData, statistics);
+      if (predicate(statistics, predicateClientData))
+        {
+        recorder->Trigger();
+        }
+      }
+
+    for (size_t i = 0; i < callbacks.size(); ++i)
+      {
+      callbacks[i].first(polyData, frame.Timestep, callbacks[i].second);
+      }
+
+    // outputs are fed outside the lock so readers are not held up
+    if (arrowWriter)
+      {
+      arrowWriter->Enqueue(polyData);
+      }
+#ifndef _WIN32
+    if (frameServer)
+      {
+      frameServer->PublishFrame(polyData, frame.Timestep);
+      }
+#endif
+
+    // one frame is compressed per new frame, which keeps up with the
+    // incoming data while spreading the cost
+    if (compressDataset)
+      {
+      this->CompressFrame(compressDataset, compressTimestep, quantizationStep);
+      }
+  }
+
+  boost::atomic<bool> NewData;
+  int MaxNumberOfDatasets;
+  vtkTypeUInt64 MemoryBudget;
+  vtkTypeUInt64 MemoryUsage;
+  double TimeWindow;
+  bool Compression;
+  // read by the decode thread for every packet, without the cache mutex
+  boost::atomic<int> CompressionFormat;
+  double CompressionAge;
+  double QuantizationStep;
+  double LastTime;
+  double FirstTimestep;
+  boost::mutex Mutex;
+  boost::mutex OutputsMutex;
+  boost::mutex PacketMutex;
+  boost::mutex HistoryMutex;
+  boost::shared_ptr<const LatestFrame> Latest;
+  std::deque<PendingFrame> PendingFrames;
+  std::deque<PendingCompression> PendingCompressions;
+  bool ClearPendingHistory;
+  std::deque<CachedFrame> Frames;
+  std::deque<HistoryFrame> HistoryFrames;
+  std::vector<double> Timesteps;
+  size_t TimestepsOffset;
+  std::string CurrentPackets;
+  bool HasHistoryFrameStart;
+  uint64_t HistoryFrameStart;
+  boost::shared_ptr<vtkPacketRingFile> HistoryFile;
+  vtkNew<vtkVelodyneHDLReader> HDLReader;
+  vtkNew<vtkVelodyneHDLReader> HistoryReader;
+  vtkSensorClock Clock;
+  LatencyHistogram Latency;
+
+  boost::mutex DecodeMutex;
+  double MinimumCoverage;
+  double FrameTimeout;
+  double LastPacketTime;
+  uint64_t LastPacketIndex;
+  boost::atomic<vtkIdType> DroppedFrames;
+  boost::shared_ptr<boost::thread> TimeoutThread;
+  boost::condition_variable TimeoutCondition;
+  bool StopTimeout;
+
+  struct ReceivedPacket
+  {
+    std::string* Data;
+    double Time;
+  };
+
+  boost::shared_ptr<SynchronizedQueue<ReceivedPacket> > Packets;
+  boost::shared_ptr<FrameArrowWriter> ArrowWriter;
+  boost::shared_ptr<TriggeredPacketRecorder> Recorder;
+  vtkVelodyneHDLSource::TriggerPredicate Predicate;
+  void* PredicateClientData;
+  std::vector<std::pair<vtkVelodyneHDLSource::FrameCallback, void*> > FrameCallbacks;
+#ifndef _WIN32
+  boost::shared_ptr<vtkFrameSocketServer> FrameServer;
+#endif
+
+  boost::shared_ptr<boost::thread> Thread;
+};
+
+
+//----------------------------------------------------------------------------
+class PacketFileWriter
+{
+public:
+
+  void ThreadLoop()
+  {
+    std::string* packet = 0;
+    while (this->Packets->dequeue(packet))
+      {
+      this->PacketWriter.WritePacket(reinterpret_cast<const unsigned char*>(packet->c_str()), packet->length());
+      delete packet;
+      }
+  }
+
+  void Start(const std::string& filename)
+  {
+    if (this->Thread)
+      {
+      return;
+      }
+
+    if (this->PacketWriter.GetFileName() != filename)
+      {
+      this->PacketWriter.Close();
+      }
+
+    if (!this->PacketWriter.IsOpen())
+      {
+      if (!this->PacketWriter.Open(filename))
+        {
+        vtkGenericWarningMacro("Failed to open packet file: " << filename);
+        return;
+        }
+      }
+
+    this->Packets.reset(new SynchronizedQueue<std::string*>);
+    this->Thread = boost::shared_ptr<boost::thread>(
+      new boost::thread(boost::bind(&PacketFileWriter::ThreadLoop, this)));
+  }
+
+  void Stop()
+  {
+    if (this->Thread)
+      {
+      this->Packets->stopQueue();
+      this->Thread->join();
+      this->Thread.reset();
+
+      std::string* packet = 0;
+      while (this->Packets->tryDequeue(packet))
+        {
+        delete packet;
+        }
+      this->Packets.reset();
+      }
+  }
+
+  void Enqueue(std::string* packet)
+  {
+    if (!this->Packets->enqueue(packet))
+      {
+      delete packet;
+      }
+  }
+
+  bool IsOpen()
+  {
+    return this->PacketWriter.IsOpen();
+  }
+
+  void Close()
+  {
+    this->PacketWriter.Close();
+  }
+
+private:
+  vtkPacketFileWriter PacketWriter;
+  boost::shared_ptr<boost::thread> Thread;
+  boost::shared_ptr<SynchronizedQueue<std::string*> > Packets;
+};
+
+
+//----------------------------------------------------------------------------
+class PacketNetworkSource;
+
+// One or more sockets with a receive thread each per local port, shared by
+// every source listening on that port.  Each datagram is routed by its
+// sender address through a table sorted by address to the source
+// registered for that sensor, so a whole rack of sensors sending to the
+// default port is decoded in separate lanes.  A source registered for
+// address 0 receives the packets of all senders without a lane of their
+// own.
+//
+// With several sockets, they share the port through SO_REUSEPORT and a
+// steering program spreads the packets over them by sender address, so
+// every sensor stays on one thread and its packets stay in order.
+//
+// Multicast groups are joined by the kernel on behalf of the sockets, so
+// the packets reach every host in the group without a relay.  The sockets
+// only receive the groups they joined themselves (IP_MULTICAST_ALL off),
+// and each group is joined on one socket only since every socket in a
+// SO_REUSEPORT group gets its own copy of a multicast datagram.
+class PacketReceiver : public boost::enable_shared_from_this<PacketReceiver>
+{
+public:
+
+  // Description:
+  // Packets from Address, in host byte order, go to Source, or all the
+  // packets without a lane of their own if Address is 0.  A non zero Group
+  // is a multicast group joined on the interface with the address
+  // Interface, or on the default interface if it is 0.
+  struct Lane
+  {
+    Lane()
+    {
+      this->Address = 0;
+      this->Group = 0;
+      this->Interface = 0;
+      this->Source = 0;
+      this->Position = false;
+    }
+
+    bool operator<(const Lane& other) const
+    {
+      return this->Address < other.Address;
+    }
+
+    uint32_t Address;
+    uint32_t Group;
+    uint32_t Interface;
+    PacketNetworkSource* Source;
+    bool Position;
+  };
+
+  // Description:
+  // Settings of a port, fixed by the first source opening it; the other
+  // sources on the port must ask for the same ones.  With Spin
+  // the receive threads poll their non blocking sockets instead of waiting
+  // for packets, and a non zero BusyPollTime sets SO_BUSY_POLL to that many
+  // microseconds so the kernel polls the device queue as well.
+  struct PortOptions
+  {
+    PortOptions()
+    {
+      this->NumberOfSockets = 1;
+      this->Spin = false;
+      this->BusyPollTime = 0;
+    }
+
+    bool operator==(const PortOptions& other) const
+    {
+      return this->NumberOfSockets == other.NumberOfSockets && this->Spin == other.Spin &&
+        this->BusyPollTime == other.BusyPollTime;
+    }
+
+    int NumberOfSockets;
+    bool Spin;
+    int BusyPollTime;
+  };
+
+  ~PacketReceiver()
+  {
+    this->Close();
+  }
+
+  // Description:
+  // Registers lane on port, opening the port with options if no other
+  // source listens on it yet.  Returns NULL if the port cannot be bound,
+  // is already open with other options, the group cannot be joined or the
+  // address already has a lane there.
+  static boost::shared_ptr<PacketReceiver> Acquire(int port, const PortOptions& options, const Lane& lane)
+  {
+    boost::lock_guard<boost::mutex> lock(GetRegistryMutex());
+    boost::shared_ptr<PacketReceiver> receiver = GetRegistry()[port];
+    if (!receiver)
+      {
+      receiver.reset(new PacketReceiver);
+      if (!receiver->Open(port, options))
+        {
+        GetRegistry().erase(port);
+        return boost::shared_ptr<PacketReceiver>();
+        }
+      GetRegistry()[port] = receiver;
+      }
+    else if (!(receiver->Options == options))
+      {
+      vtkGenericWarningMacro("Port " << port << " is already open with other receive threads, spinning or"
+        " busy poll time");
+      return boost::shared_ptr<PacketReceiver>();
+      }
+
+    bool added = false;
+    if (!receiver->AddLane(lane))
+      {
+      vtkGenericWarningMacro("Port " << port << " already receives the packets of "
+        << (lane.Address ? boost::asio::ip::address_v4(lane.Address).to_string() : std::string("any sensor")));
+      }
+    else if (!receiver->JoinGroup(lane.Group, lane.Interface))
+      {
+      uint32_t group = 0;
+      receiver->RemoveLane(lane.Source, group);
+      }
+    else
+      {
+      added = true;
+      }
+
+    if (!added)
+      {
+      if (receiver->Lanes.empty())
+        {
+        receiver->Close();
+        GetRegistry().erase(port);
+        }
+      return boost::shared_ptr<PacketReceiver>();
+      }
+    return receiver;
+  }
+
+  // Description:
+  // Unregisters source, closing the port after the last one.  Once this
+  // returns no packet is handed to source any more, except for the one
+  // being handed over if source is released from its own callback.
+  static void Release(boost::shared_ptr<PacketReceiver>& receiver, PacketNetworkSource* source)
+  {
+      {
+      boost::lock_guard<boost::mutex> lock(GetRegistryMutex());
+      uint32_t group = 0;
+      if (!receiver->RemoveLane(source, group))
+        {
+        receiver->Close();
+        GetRegistry().erase(receiver->Port);
+        }
+      else
+        {
+        receiver->LeaveGroup(group);
+        }
+      }
+
+    // outside the registry mutex, so that a callback of source on another
+    // thread may release a source itself
+    receiver->WaitForDispatch(source);
+    receiver.reset();
+  }
+
+  // Description:
+  // Packets dropped because no source listens for their sender.
+  vtkIdType GetNumberOfUnroutedPackets()
+  {
+    vtkIdType count = 0;
+    for (size_t i = 0; i < this->Channels.size(); ++i)
+      {
+      boost::lock_guard<boost::mutex> lock(this->Channels[i]->Mutex);
+      count += this->Channels[i]->UnroutedPackets;
+      }
+    return count;
+  }
+
+private:
+
+  // One socket of the port and its receive thread.  The thread holds the
+  // mutex while it looks up the lane of a packet, so it is only contended
+  // while the lanes change, and hands the packet over without it.
+  // Dispatching is the source being handed a packet, Idle is signaled
+  // once it is done.
+  struct Channel
+  {
+    Channel()
+    {
+      this->UnroutedPackets = 0;
+      this->Dispatching = 0;
+    }
+
+    boost::asio::io_service IOService;
+    boost::asio::ip::udp::endpoint SenderEndpoint;
+    boost::shared_ptr<boost::asio::ip::udp::socket> Socket;
+    boost::shared_ptr<boost::thread> Thread;
+    boost::mutex Mutex;
+    boost::condition_variable Idle;
+    PacketNetworkSource* Dispatching;
+    vtkIdType UnroutedPackets;
+    char RXBuffer[1500];
+  };
+
+  typedef std::map<int, boost::shared_ptr<PacketReceiver> > Registry;
+
+  static Registry& GetRegistry()
+  {
+    static Registry registry;
+    return registry;
+  }
+
+  static boost::mutex& GetRegistryMutex()
+  {
+    static boost::mutex mutex;
+    return mutex;
+  }
+
+  PacketReceiver()
+  {
+    this->Port = 0;
+    this->ShouldStop = false;
+  }
+
+  bool Open(int port, const PortOptions& options)
+  {
+    this->Port = port;
+    this->Options = options;
+    int numberOfSockets = options.NumberOfSockets;
+#ifndef VTK_HDL_REUSEPORT_STEERING
+    if (numberOfSockets > 1)
+      {
+      vtkGenericWarningMacro("Receiving on several sockets needs SO_REUSEPORT steering, using one socket");
+      numberOfSockets = 1;
+      }
+#endif
+
+    // the endpoint on this machine where the packets are received
+    boost::asio::ip::udp::endpoint destinationEndpoint(boost::asio::ip::address_v4::any(), port);
+    try
+      {
+      for (int i = 0; i < numberOfSockets; ++i)
+        {
+        boost::shared_ptr<Channel> channel(new Channel);
+        channel->Socket.reset(new boost::asio::ip::udp::socket(channel->IOService));
+        channel->Socket->open(destinationEndpoint.protocol());
+        if (numberOfSockets > 1)
+          {
+          SetReusePort(*channel->Socket);
+          }
+        DisableMulticastAll(*channel->Socket);
+        if (options.BusyPollTime > 0 && !SetBusyPoll(*channel->Socket, options.BusyPollTime))
+          {
+          // raising it past net.core.busy_read takes CAP_NET_ADMIN, the
+          // threads then only spin in user space
+          vtkGenericWarningMacro("Failed to set SO_BUSY_POLL on port " << port);
+          }
+        channel->Socket->bind(destinationEndpoint);
+        this->Channels.push_back(channel);
+        }
+      }
+    catch( std::exception & e )
+      {
+      vtkGenericWarningMacro("Caught exception while binding to port " << port << ": " << e.what());
+      this->Channels.clear();
+      return false;
+      }
+
+    if (numberOfSockets > 1 && !AttachSteeringProgram(*this->Channels[0]->Socket, numberOfSockets))
+      {
+      // the kernel then picks the socket by a hash of the addresses and
+      // ports, which still keeps each sensor on one socket
+      vtkGenericWarningMacro("Failed to attach the steering program to port " << port);
+      }
+
+    // the threads hold the receiver and their channel, which outlive a
+    // Close() from a packet callback until the thread is done
+    this->ShouldStop = false;
+    for (size_t i = 0; i < this->Channels.size(); ++i)
+      {
+      this->Channels[i]->Thread = boost::shared_ptr<boost::thread>(
+        new boost::thread(boost::bind(&PacketReceiver::ThreadLoop, this->shared_from_this(), this->Channels[i])));
+      }
+    return true;
+  }
+
+  // The sockets are closed once their threads are done, since a spinning
+  // thread uses its socket until it sees ShouldStop.  A thread closing its
+  // own port from a packet callback cannot be joined, it is detached and
+  // stops once the callback returns.
+  void Close()
+  {
+    this->ShouldStop = true;
+    for (size_t i = 0; i < this->Channels.size(); ++i)
+      {
+      Channel* channel = this->Channels[i].get();
+      channel->IOService.stop();
+      if (channel->Thread)
+        {
+        if (channel->Thread->get_id() == boost::this_thread::get_id())
+          {
+          channel->Thread->detach();
+          }
+        else
+          {
+          channel->Thread->join();
+          }
+        channel->Thread.reset();
+        }
+      channel->Socket->close();
+      }
+    this->Channels.clear();
+    this->Groups.clear();
+  }
+
+  // The groups are spread over the sockets in the order they are joined.
+  // Lanes only change under the registry mutex, so the groups need no
+  // lock of their own.
+  bool JoinGroup(uint32_t group, uint32_t networkInterface)
+  {
+    if (!group || this->Groups.count(group))
+      {
+      return true;
+      }
+
+    const size_t index = this->Groups.size() % this->Channels.size();
+    boost::system::error_code error;
+    this->Channels[index]->Socket->set_option(boost::asio::ip::multicast::join_group(
+      boost::asio::ip::address_v4(group), boost::asio::ip::address_v4(networkInterface)), error);
+    if (error)
+      {
+      vtkGenericWarningMacro("Failed to join multicast group " << boost::asio::ip::address_v4(group).to_string()
+        << " on port " << this->Port << ": " << error.message());
+      return false;
+      }
+
+    this->Groups[group] = std::make_pair(index, networkInterface);
+    return true;
+  }
+
+  // Leaves group once no lane uses it any more.
+  void LeaveGroup(uint32_t group)
+  {
+    std::map<uint32_t, std::pair<size_t, uint32_t> >::iterator it = this->Groups.find(group);
+    if (it == this->Groups.end())
+      {
+      return;
+      }
+    for (size_t i = 0; i < this->Lanes.size(); ++i)
+      {
+      if (this->Lanes[i].Group == group)
+        {
+        return;
+        }
+      }
+
+    boost::system::error_code error;
+    this->Channels[it->second.first]->Socket->set_option(boost::asio::ip::multicast::leave_group(
+      boost::asio::ip::address_v4(group), boost::asio::ip::address_v4(it->second.second)), error);
+    this->Groups.erase(it);
+  }
+
+  static bool SetBusyPoll(boost::asio::ip::udp::socket& socket, int microseconds)
+  {
+#ifdef SO_BUSY_POLL
+    return setsockopt(socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &microseconds, sizeof(microseconds)) == 0;
+#else
+    (void)socket;
+    (void)microseconds;
+    return false;
+#endif
+  }
+
+  // By default a socket bound to the wildcard address receives the groups
+  // joined by any socket on the host for its port.
+  static void DisableMulticastAll(boost::asio::ip::udp::socket& socket)
+  {
+#ifdef IP_MULTICAST_ALL
+    int off = 0;
+    setsockopt(socket.native_handle(), IPPROTO_IP, IP_MULTICAST_ALL, &off, sizeof(off));
+#else
+    (void)socket;
+#endif
+  }
+
+#ifdef VTK_HDL_REUSEPORT_STEERING
+  static void SetReusePort(boost::asio::ip::udp::socket& socket)
+  {
+    int on = 1;
+    if (setsockopt(socket.native_handle(), SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0)
+      {
+      throw boost::system::system_error(errno, boost::system::system_category(), "SO_REUSEPORT");
+      }
+  }
+
+  // Returns the index of the socket for a packet: its IPv4 source address
+  // modulo the number of sockets.  Attached to one socket, the program
+  // steers the whole group.
+  static bool AttachSteeringProgram(boost::asio::ip::udp::socket& socket, unsigned int numberOfSockets)
+  {
+    struct sock_filter code[] =
+      {
+      { BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<unsigned int>(SKF_NET_OFF + 12) },
+      { BPF_ALU | BPF_MOD | BPF_K, 0, 0, numberOfSockets },
+      { BPF_RET | BPF_A, 0, 0, 0 }
+      };
+    struct sock_fprog program;
+    program.len = sizeof(code) / sizeof(code[0]);
+    program.filter = code;
+    return setsockopt(socket.native_handle(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == 0;
+  }
+#else
+  static void SetReusePort(boost::asio::ip::udp::socket&)
+  {
+  }
+
+  static bool AttachSteeringProgram(boost::asio::ip::udp::socket&, unsigned int)
+  {
+    return false;
+  }
+#endif
+
+  // The lanes change with the mutexes of all channels held, in order, so
+  // each receive thread only needs its own to read them.
+  void LockChannels()
+  {
+    for (size_t i = 0; i < this->Channels.size(); ++i)
+      {
+      this->Channels[i]->Mutex.lock();
+      }
+  }
+
+  void UnlockChannels()
+  {
+    for (size_t i = this->Channels.size(); i > 0; --i)
+      {
+      this->Channels[i - 1]->Mutex.unlock();
+      }
+  }
+
+  bool AddLane(const Lane& lane)
+  {
+    this->LockChannels();
+    std::vector<Lane>::iterator it = std::lower_bound(this->Lanes.begin(), this->Lanes.end(), lane);
+    const bool added = (it == this->Lanes.end() || it->Address != lane.Address);
+    if (added)
+      {
+      this->Lanes.insert(it, lane);
+      }
+    this->UnlockChannels();
+    return added;
+  }
+
+  // Returns the number of lanes left and the group of the removed one.
+  size_t RemoveLane(PacketNetworkSource* source, uint32_t& group)
+  {
+    this->LockChannels();
+    for (size_t i = 0; i < this->Lanes.size(); ++i)
+      {
+      if (this->Lanes[i].Source == source)
+        {
+        group = this->Lanes[i].Group;
+        this->Lanes.erase(this->Lanes.begin() + i);
+        break;
+        }
+      }
+    const size_t nLanes = this->Lanes.size();
+    this->UnlockChannels();
+    return nLanes;
+  }
+
+  // Waits until no receive thread but the calling one hands a packet to
+  // source.  Its lane must be removed already so that no new packet is.
+  void WaitForDispatch(PacketNetworkSource* source)
+  {
+    for (size_t i = 0; i < this->Channels.size(); ++i)
+      {
+      Channel* channel = this->Channels[i].get();
+      if (channel->Thread && channel->Thread->get_id() == boost::this_thread::get_id())
+        {
+        continue;
+        }
+      boost::unique_lock<boost::mutex> lock(channel->Mutex);
+      while (channel->Dispatching == source)
+        {
+        channel->Idle.wait(lock);
+        }
+      }
+  }
+
+  const Lane* FindLane(uint32_t address) const
+  {
+    Lane key;
+    key.Address = address;
+    std::vector<Lane>::const_iterator it = std::lower_bound(this->Lanes.begin(), this->Lanes.end(), key);
+    if (it != this->Lanes.end() && it->Address == address)
+      {
+      return &*it;
+      }
+
+    // the lane for any sender sorts first
+    if (!this->Lanes.empty() && this->Lanes.front().Address == 0)
+      {
+      return &this->Lanes.front();
+      }
+    return 0;
+  }
+
+  void StartReceive(Channel* channel)
+  {
+    // expecting exactly 1206 bytes, using a larger buffer so that if a
+    // larger packet arrives unexpectedly we'll notice it.
+    channel->Socket->async_receive_from(boost::asio::buffer(channel->RXBuffer, 1500), channel->SenderEndpoint,
+      boost::bind(&PacketReceiver::SocketCallback, this, channel,
+      boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+  }
+
+  void SocketCallback(Channel* channel, const boost::system::error_code& error, std::size_t numberOfBytes)
+  {
+    if (this->ShouldStop)
+      {
+      return;
+      }
+
+    if (!error)
+      {
+      this->Dispatch(channel, numberOfBytes, vtkTimerLog::GetUniversalTime());
+      }
+
+    // the callback may have closed the port
+    if (!this->ShouldStop)
+      {
+      this->StartReceive(channel);
+      }
+  }
+
+  // Defined after PacketNetworkSource.  The packet is handed over without
+  // the lanes locked, so that its callbacks may release sources, and
+  // Release() waits for it instead.
+  void Dispatch(Channel* channel, std::size_t numberOfBytes, double receiveTime);
+
+  // Holds the receiver and the channel until the thread is done.
+  static void ThreadLoop(boost::shared_ptr<PacketReceiver> receiver, boost::shared_ptr<Channel> channel)
+  {
+    if (receiver->Options.Spin)
+      {
+      receiver->SpinLoop(channel.get());
+      return;
+      }
+
+    receiver->StartReceive(channel.get());
+    channel->IOService.reset();
+    channel->IOService.run();
+  }
+
+  // Polls the non blocking socket without ever sleeping, so that a packet
+  // is picked up as soon as it arrives, at the cost of a busy core.
+  void SpinLoop(Channel* channel)
+  {
+    boost::system::error_code error;
+    channel->Socket->non_blocking(true, error);
+    while (!this->ShouldStop)
+      {
+      const std::size_t numberOfBytes = channel->Socket->receive_from(
+        boost::asio::buffer(channel->RXBuffer, 1500), channel->SenderEndpoint, 0, error);
+      if (!error)
+        {
+        this->Dispatch(channel, numberOfBytes, vtkTimerLog::GetUniversalTime());
+        }
+      }
+  }
+
+  int Port;
+  PortOptions Options;
+  boost::atomic<bool> ShouldStop;
+  std::vector<boost::shared_ptr<Channel> > Channels;
+  std::vector<Lane> Lanes;
+  std::map<uint32_t, std::pair<size_t, uint32_t> > Groups;
+};
+
+
+//----------------------------------------------------------------------------
+// The decode lane of one sensor: hands the packets routed to it by the
+// shared receivers to its consumer and recorders.
+class PacketNetworkSource
+{
+public:
+
+  PacketNetworkSource()
+  {
+    this->Inline = false;
+    this->SensorAddress = 0;
+    this->MulticastGroup = 0;
+    this->MulticastInterface = 0;
+  }
+
+  void HandlePacket(const char* data, std::size_t numberOfBytes, double receiveTime)
+  {
+    if (this->Inline)
+      {
+      // run to completion on the receive thread; the consumer lock is only
+      // contended when several receive threads feed the lane of a sensor
+      this->Consumer->HandleSensorData(reinterpret_cast<const unsigned char*>(data), numberOfBytes, receiveTime);
+      }
+    else
+      {
+      this->Consumer->Enqueue(new std::string(data, numberOfBytes), receiveTime);
+      }
+
+    if (this->Writer)
+      {
+      std::string* packet = new std::string(data, numberOfBytes);
+      this->Writer->Enqueue(packet);
+      }
+
+    if (this->Recorder)
+      {
+      this->Recorder->Enqueue(new std::string(data, numberOfBytes));
+      }
+  }
+
+  // Position packets only update the sensor clock, on the receive thread,
+  // and are recorded with the data packets.
+  void HandlePositionPacket(const char* data, std::size_t numberOfBytes, double receiveTime)
+  {
+    this->Consumer->HandlePositionPacket(reinterpret_cast<const unsigned char*>(data), numberOfBytes, receiveTime);
+
+    if (this->Writer)
+      {
+      this->Writer->Enqueue(new std::string(data, numberOfBytes));
+      }
+  }
+
+  // Description:
+  // Starts receiving the packets sent from SensorAddress, in host byte
+  // order, or from any sensor without a lane of its own if it is 0, joining
+  // MulticastGroup if it is set.  If the sensor port is open already,
+  // options must be the ones it was opened with.
+  void Start(int sensorPort, int positionPort, const PacketReceiver::PortOptions& options)
+  {
+    if (this->Receiver)
+      {
+      return;
+      }
+
+    PacketReceiver::Lane lane;
+    lane.Address = this->SensorAddress;
+    lane.Group = this->MulticastGroup;
+    lane.Interface = this->MulticastInterface;
+    lane.Source = this;
+
+    if (positionPort > 0)
+      {
+      // without it frames are still decoded, only without absolute time
+      lane.Position = true;
+      this->PositionReceiver = PacketReceiver::Acquire(positionPort, PacketReceiver::PortOptions(), lane);
+      }
+
+    lane.Position = false;
+    this->Receiver = PacketReceiver::Acquire(sensorPort, options, lane);
+    if (!this->Receiver && this->PositionReceiver)
+      {
+      PacketReceiver::Release(this->PositionReceiver, this);
+      }
   }
 
   void Stop()
   {
-    this->ShouldStop = true;
-    if (this->Thread)
+    if (this->Receiver)
       {
-      this->Socket->close();
-      this->IOService.stop();
-      this->Thread->join();
-      this->Thread.reset();
+      PacketReceiver::Release(this->Receiver, this);
+      }
+    if (this->PositionReceiver)
+      {
+      PacketReceiver::Release(this->PositionReceiver, this);
       }
   }
 
-  bool ShouldStop;
-  char RXBuffer[1500];
+  vtkIdType GetNumberOfUnroutedPackets()
+  {
+    return this->Receiver ? this->Receiver->GetNumberOfUnroutedPackets() : 0;
+  }
 
-  boost::asio::io_service IOService;
-  boost::shared_ptr<boost::asio::ip::udp::socket> Socket;
-  boost::shared_ptr<boost::thread> Thread;
+  bool Inline;
+  uint32_t SensorAddress;
+  uint32_t MulticastGroup;
+  uint32_t MulticastInterface;
+  boost::shared_ptr<PacketReceiver> Receiver;
+  boost::shared_ptr<PacketReceiver> PositionReceiver;
   boost::shared_ptr<PacketConsumer> Consumer;
   boost::shared_ptr<PacketFileWriter> Writer;
+  boost::shared_ptr<TriggeredPacketRecorder> Recorder;
 };
 
+//----------------------------------------------------------------------------
+void PacketReceiver::Dispatch(Channel* channel, std::size_t numberOfBytes, double receiveTime)
+{
+  const boost::asio::ip::address& sender = channel->SenderEndpoint.address();
+  const uint32_t address = sender.is_v4() ? static_cast<uint32_t>(sender.to_v4().to_ulong()) : 0;
+
+  PacketNetworkSource* source = 0;
+  bool position = false;
+    {
+    boost::lock_guard<boost::mutex> lock(channel->Mutex);
+    const Lane* lane = this->FindLane(address);
+    if (!lane)
+      {
+      ++channel->UnroutedPackets;
+      return;
+      }
+    source = lane->Source;
+    position = lane->Position;
+    channel->Dispatching = source;
+    }
+
+  if (position)
+    {
+    source->HandlePositionPacket(channel->RXBuffer, numberOfBytes, receiveTime);
+    }
+  else
+    {
+    source->HandlePacket(channel->RXBuffer, numberOfBytes, receiveTime);
+    }
+
+    {
+    boost::lock_guard<boost::mutex> lock(channel->Mutex);
+    channel->Dispatching = 0;
+    }
+  channel->Idle.notify_all();
+}
+
 
 //----------------------------------------------------------------------------
 class PacketFileSource
@@ -539,7 +2611,9 @@ public:
       return false;
       }
 
-    this->Consumer->HandleSensorData(data, dataLength);
+    // the reader's start time is zero, so this is the capture time in
+    // seconds since the epoch
+    this->Consumer->HandleSensorData(data, dataLength, 0, timeSinceStart);
     return true;
   }
 
@@ -590,6 +2664,26 @@ public:
   boost::shared_ptr<PacketConsumer> Consumer;
 };
 
+//----------------------------------------------------------------------------
+// Parses a dotted IPv4 address to host byte order, an empty string to 0.
+bool ParseAddress(const std::string& text, uint32_t& address)
+{
+  address = 0;
+  if (text.empty())
+    {
+    return true;
+    }
+
+  boost::system::error_code error;
+  boost::asio::ip::address_v4 parsed = boost::asio::ip::address_v4::from_string(text, error);
+  if (error)
+    {
+    return false;
+    }
+  address = static_cast<uint32_t>(parsed.to_ulong());
+  return true;
+}
+
 } // end namespace
 
 //----------------------------------------------------------------------------
@@ -601,6 +2695,13 @@ public:
   {
     this->Consumer = boost::shared_ptr<PacketConsumer>(new PacketConsumer);
     this->Writer = boost::shared_ptr<PacketFileWriter>(new PacketFileWriter);
+    this->ArrowWriter = boost::shared_ptr<FrameArrowWriter>(new FrameArrowWriter);
+#ifndef _WIN32
+    this->FrameServer = boost::shared_ptr<vtkFrameSocketServer>(new vtkFrameSocketServer);
+#endif
+    this->HistoryFile = boost::shared_ptr<vtkPacketRingFile>(new vtkPacketRingFile);
+    this->Consumer->SetHistoryFile(this->HistoryFile);
+    this->Recorder = boost::shared_ptr<TriggeredPacketRecorder>(new TriggeredPacketRecorder);
     this->NetworkSource.Consumer = this->Consumer;
     this->FileSource.Consumer = this->Consumer;
   }
@@ -611,87 +2712,329 @@ public:
 
   boost::shared_ptr<PacketConsumer> Consumer;
   boost::shared_ptr<PacketFileWriter> Writer;
+  boost::shared_ptr<FrameArrowWriter> ArrowWriter;
+#ifndef _WIN32
+  boost::shared_ptr<vtkFrameSocketServer> FrameServer;
+#endif
+  boost::shared_ptr<vtkPacketRingFile> HistoryFile;
+  boost::shared_ptr<TriggeredPacketRecorder> Recorder;
   PacketNetworkSource NetworkSource;
+  std::vector<double> Timesteps;
   PacketFileSource FileSource;
 };
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkVelodyneHDLSource);
+vtkInformationKeyMacro(vtkVelodyneHDLSource, LATEST_TIME_STEP, Double);
 
 //----------------------------------------------------------------------------
 vtkVelodyneHDLSource::vtkVelodyneHDLSource()
 {
   this->Internal = new vtkInternal;
   this->SensorPort = 2368;
+  this->PositionPort = 8308;
+  this->NumberOfReceiveThreads = 1;
+  this->ReceiveMode = RECEIVE_QUEUED;
+  this->BusyPollTime = 50;
+  this->FramePublishMode = PUBLISH_ON_WRAP;
+  this->MinimumFrameCoverage = 0;
+  this->FrameTimeout = 0;
+  this->FrameServerSectors = 8;
+  this->HistoryFileSize = 1024;
+  this->PreTriggerTime = 10.0;
+  this->PostTriggerTime = 10.0;
+  this->PublishTimeSteps = 1;
   this->SetNumberOfInputPorts(0);
   this->SetNumberOfOutputPorts(1);
 }
 
-//----------------------------------------------------------------------------
-vtkVelodyneHDLSource::~vtkVelodyneHDLSource()
+//----------------------------------------------------------------------------
+vtkVelodyneHDLSource::~vtkVelodyneHDLSource()
+{
+  this->Stop();
+  delete this->Internal;
+}
+
+//-----------------------------------------------------------------------------
+const std::string& vtkVelodyneHDLSource::GetPacketFile()
+{
+  return this->PacketFile;
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetPacketFile(const std::string& filename)
+{
+  if (filename == this->GetPacketFile())
+    {
+    return;
+    }
+
+  this->PacketFile = filename;
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+const std::string& vtkVelodyneHDLSource::GetOutputFile()
+{
+  return this->OutputFile;
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetOutputFile(const std::string& filename)
+{
+  if (filename == this->GetOutputFile())
+    {
+    return;
+    }
+
+  this->Internal->Writer->Close();
+  this->OutputFile = filename;
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+const std::string& vtkVelodyneHDLSource::GetArrowOutputFile()
+{
+  return this->ArrowOutputFile;
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetArrowOutputFile(const std::string& filename)
+{
+  if (filename == this->GetArrowOutputFile())
+    {
+    return;
+    }
+
+  this->Internal->Consumer->SetArrowWriter(boost::shared_ptr<FrameArrowWriter>());
+  this->Internal->ArrowWriter->Stop();
+  this->Internal->ArrowWriter->Close();
+  this->ArrowOutputFile = filename;
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+const std::string& vtkVelodyneHDLSource::GetFrameServerPath()
+{
+  return this->FrameServerPath;
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetFrameServerPath(const std::string& path)
+{
+  if (path == this->GetFrameServerPath())
+    {
+    return;
+    }
+
+#ifndef _WIN32
+  this->Internal->Consumer->SetFrameServer(boost::shared_ptr<vtkFrameSocketServer>());
+  this->Internal->FrameServer->Stop();
+#endif
+  this->FrameServerPath = path;
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+const std::string& vtkVelodyneHDLSource::GetHistoryFile()
+{
+  return this->HistoryFile;
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetHistoryFile(const std::string& filename)
+{
+  if (filename == this->GetHistoryFile())
+    {
+    return;
+    }
+
+  this->Internal->HistoryFile->Close();
+  this->Internal->Consumer->ClearHistory();
+  this->HistoryFile = filename;
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+const std::string& vtkVelodyneHDLSource::GetTriggerFilePrefix()
+{
+  return this->TriggerFilePrefix;
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetTriggerFilePrefix(const std::string& prefix)
+{
+  if (prefix == this->GetTriggerFilePrefix())
+    {
+    return;
+    }
+
+  this->TriggerFilePrefix = prefix;
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::Trigger()
+{
+  if (!this->Internal->Recorder->IsRunning())
+    {
+    vtkWarningMacro("Trigger() called but event recording is not running.");
+    return;
+    }
+
+  this->Internal->Recorder->Trigger();
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetTriggerPredicate(TriggerPredicate predicate, void* clientData)
+{
+  this->Internal->Consumer->SetTriggerPredicate(predicate, clientData);
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::NotifyNextFrame(FrameCallback callback, void* clientData)
+{
+  this->Internal->Consumer->NotifyNextFrame(callback, clientData);
+}
+
+//-----------------------------------------------------------------------------
+const std::string& vtkVelodyneHDLSource::GetCorrectionsFile()
+{
+  return this->Internal->Consumer->GetReader()->GetCorrectionsFile();
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetCorrectionsFile(const std::string& filename)
 {
-  this->Stop();
-  delete this->Internal;
+  if (filename == this->GetCorrectionsFile())
+    {
+    return;
+    }
+
+  this->Internal->Consumer->GetReader()->SetCorrectionsFile(filename);
+  this->Internal->Consumer->GetHistoryReader()->SetCorrectionsFile(filename);
+  this->Modified();
 }
 
 //-----------------------------------------------------------------------------
-const std::string& vtkVelodyneHDLSource::GetPacketFile()
+const std::string& vtkVelodyneHDLSource::GetSensorAddress()
 {
-  return this->PacketFile;
+  return this->SensorAddress;
 }
 
 //-----------------------------------------------------------------------------
-void vtkVelodyneHDLSource::SetPacketFile(const std::string& filename)
+void vtkVelodyneHDLSource::SetSensorAddress(const std::string& address)
 {
-  if (filename == this->GetPacketFile())
+  if (address == this->SensorAddress)
     {
     return;
     }
 
-  this->PacketFile = filename;
+  this->SensorAddress = address;
   this->Modified();
 }
 
 //-----------------------------------------------------------------------------
-const std::string& vtkVelodyneHDLSource::GetOutputFile()
+const std::string& vtkVelodyneHDLSource::GetMulticastGroup()
 {
-  return this->OutputFile;
+  return this->MulticastGroup;
 }
 
 //-----------------------------------------------------------------------------
-void vtkVelodyneHDLSource::SetOutputFile(const std::string& filename)
+void vtkVelodyneHDLSource::SetMulticastGroup(const std::string& group)
 {
-  if (filename == this->GetOutputFile())
+  if (group == this->MulticastGroup)
     {
     return;
     }
 
-  this->Internal->Writer->Close();
-  this->OutputFile = filename;
+  this->MulticastGroup = group;
   this->Modified();
 }
 
 //-----------------------------------------------------------------------------
-const std::string& vtkVelodyneHDLSource::GetCorrectionsFile()
+const std::string& vtkVelodyneHDLSource::GetMulticastInterface()
 {
-  return this->Internal->Consumer->GetReader()->GetCorrectionsFile();
+  return this->MulticastInterface;
 }
 
 //-----------------------------------------------------------------------------
-void vtkVelodyneHDLSource::SetCorrectionsFile(const std::string& filename)
+void vtkVelodyneHDLSource::SetMulticastInterface(const std::string& networkInterface)
 {
-  if (filename == this->GetCorrectionsFile())
+  if (networkInterface == this->MulticastInterface)
     {
     return;
     }
 
-  this->Internal->Consumer->GetReader()->SetCorrectionsFile(filename);
+  this->MulticastInterface = networkInterface;
   this->Modified();
 }
 
+//-----------------------------------------------------------------------------
+double vtkVelodyneHDLSource::GetMeanReceiveLatency()
+{
+  return this->Internal->Consumer->GetLatency().GetMean();
+}
+
+//-----------------------------------------------------------------------------
+double vtkVelodyneHDLSource::GetMaxReceiveLatency()
+{
+  return this->Internal->Consumer->GetLatency().GetMax();
+}
+
+//-----------------------------------------------------------------------------
+double vtkVelodyneHDLSource::GetReceiveLatencyPercentile(double percentile)
+{
+  return this->Internal->Consumer->GetLatency().GetPercentile(percentile);
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLSource::GetNumberOfLatencySamples()
+{
+  return this->Internal->Consumer->GetLatency().GetCount();
+}
+
+//-----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::ResetReceiveLatency()
+{
+  this->Internal->Consumer->GetLatency().Reset();
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLSource::GetNumberOfUnroutedPackets()
+{
+  return this->Internal->NetworkSource.GetNumberOfUnroutedPackets();
+}
+
 //----------------------------------------------------------------------------
 void vtkVelodyneHDLSource::Start()
 {
+  PacketNetworkSource& networkSource = this->Internal->NetworkSource;
+  if (!ParseAddress(this->SensorAddress, networkSource.SensorAddress))
+    {
+    vtkErrorMacro("Invalid sensor address: " << this->SensorAddress);
+    return;
+    }
+  if (!ParseAddress(this->MulticastGroup, networkSource.MulticastGroup) ||
+      (networkSource.MulticastGroup && !boost::asio::ip::address_v4(networkSource.MulticastGroup).is_multicast()))
+    {
+    vtkErrorMacro("Invalid multicast group: " << this->MulticastGroup);
+    return;
+    }
+  if (!ParseAddress(this->MulticastInterface, networkSource.MulticastInterface))
+    {
+    vtkErrorMacro("Invalid multicast interface: " << this->MulticastInterface);
+    return;
+    }
+
+  this->Internal->Consumer->GetClock()->Reset();
+  this->Internal->Consumer->SetFramePolicy(this->MinimumFrameCoverage,
+    this->FramePublishMode == PUBLISH_ON_COVERAGE, this->FrameTimeout);
+  this->Internal->Consumer->StartFrameTimeout();
+  this->StartArrowWriter();
+  this->StartFrameServer();
+  this->StartHistoryFile();
+
   if (this->PacketFile.length())
     {
     this->Internal->FileSource.Start(this->PacketFile);
@@ -709,8 +3052,28 @@ void vtkVelodyneHDLSource::Start()
       this->Internal->NetworkSource.Writer = this->Internal->Writer;
       }
 
-    this->Internal->Consumer->Start();
-    this->Internal->NetworkSource.Start(this->SensorPort);
+    this->Internal->NetworkSource.Recorder.reset();
+    this->Internal->Consumer->SetRecorder(boost::shared_ptr<TriggeredPacketRecorder>());
+    if (this->TriggerFilePrefix.length())
+      {
+      this->Internal->Recorder->Start(this->TriggerFilePrefix, this->PreTriggerTime, this->PostTriggerTime);
+      this->Internal->NetworkSource.Recorder = this->Internal->Recorder;
+      this->Internal->Consumer->SetRecorder(this->Internal->Recorder);
+      }
+
+    // the inline modes decode on the receive threads, the consumer thread
+    // only decodes queued packets
+    networkSource.Inline = (this->ReceiveMode != RECEIVE_QUEUED);
+    if (!networkSource.Inline)
+      {
+      this->Internal->Consumer->Start();
+      }
+
+    PacketReceiver::PortOptions options;
+    options.NumberOfSockets = this->NumberOfReceiveThreads;
+    options.Spin = (this->ReceiveMode == RECEIVE_BUSY_POLL);
+    options.BusyPollTime = options.Spin ? this->BusyPollTime : 0;
+    networkSource.Start(this->SensorPort, this->PositionPort, options);
     }
 }
 
@@ -720,7 +3083,72 @@ void vtkVelodyneHDLSource::Stop()
   this->Internal->FileSource.Stop();
   this->Internal->NetworkSource.Stop();
   this->Internal->Consumer->Stop();
+  this->Internal->Consumer->StopFrameTimeout();
   this->Internal->Writer->Stop();
+  this->Internal->Consumer->SetRecorder(boost::shared_ptr<TriggeredPacketRecorder>());
+  this->Internal->Recorder->Stop();
+  this->Internal->Consumer->SetArrowWriter(boost::shared_ptr<FrameArrowWriter>());
+  this->Internal->ArrowWriter->Stop();
+#ifndef _WIN32
+  this->Internal->Consumer->SetFrameServer(boost::shared_ptr<vtkFrameSocketServer>());
+  this->Internal->FrameServer->Stop();
+#endif
+  this->Internal->Consumer->CancelFrameCallbacks();
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::StartArrowWriter()
+{
+  this->Internal->Consumer->SetArrowWriter(boost::shared_ptr<FrameArrowWriter>());
+  if (this->ArrowOutputFile.length())
+    {
+    this->Internal->ArrowWriter->Start(this->ArrowOutputFile);
+    if (this->Internal->ArrowWriter->IsOpen())
+      {
+      this->Internal->Consumer->SetArrowWriter(this->Internal->ArrowWriter);
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::StartFrameServer()
+{
+#ifndef _WIN32
+  if (!this->FrameServerPath.length())
+    {
+    return;
+    }
+
+  vtkFrameSocketServer* server = this->Internal->FrameServer.get();
+  server->SetNumberOfSectors(this->FrameServerSectors);
+  if (!server->IsRunning() && !server->Start(this->FrameServerPath))
+    {
+    vtkErrorMacro("Failed to start frame server on " << this->FrameServerPath << ": " << server->GetLastError());
+    return;
+    }
+  this->Internal->Consumer->SetFrameServer(this->Internal->FrameServer);
+#else
+  if (this->FrameServerPath.length())
+    {
+    vtkErrorMacro("The frame server is not available on this platform.");
+    }
+#endif
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::StartHistoryFile()
+{
+  if (!this->HistoryFile.length() || this->Internal->HistoryFile->IsOpen())
+    {
+    return;
+    }
+
+  vtkPacketRingFile* historyFile = this->Internal->HistoryFile.get();
+  this->Internal->Consumer->ClearHistory();
+  if (!historyFile->Open(this->HistoryFile, static_cast<uint64_t>(this->HistoryFileSize) * 1024 * 1024))
+    {
+    vtkErrorMacro("Failed to open history file " << this->HistoryFile << ": " << historyFile->GetLastError());
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -733,6 +3161,10 @@ void vtkVelodyneHDLSource::ReadNextFrame()
       return;
       }
 
+    this->StartArrowWriter();
+    this->StartFrameServer();
+    this->StartHistoryFile();
+
     if (this->Internal->FileSource.ReadNextFrame())
       {
       this->Modified();
@@ -750,6 +3182,110 @@ void vtkVelodyneHDLSource::Poll()
     }
 }
 
+//----------------------------------------------------------------------------
+double vtkVelodyneHDLSource::SensorTimeDifference(double a, double b)
+{
+  const double hour = 3600.0 * 1e6;
+  double difference = std::fmod(a - b, hour);
+  if (difference >= hour / 2)
+    {
+    difference -= hour;
+    }
+  else if (difference < -hour / 2)
+    {
+    difference += hour;
+    }
+  return difference;
+}
+
+//----------------------------------------------------------------------------
+vtkMatrix4x4* vtkVelodyneHDLSource::GetSensorTransform()
+{
+  return this->Internal->Consumer->GetReader()->GetSensorTransform();
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetSensorTransform(vtkMatrix4x4* matrix)
+{
+  this->Internal->Consumer->GetReader()->SetSensorTransform(matrix);
+  this->Internal->Consumer->GetHistoryReader()->SetSensorTransform(matrix);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLSource::GetNumberOfAcceptedPackets()
+{
+  return this->Internal->Consumer->GetReader()->GetNumberOfAcceptedPackets();
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLSource::GetNumberOfRejectedPackets(int reason)
+{
+  return this->Internal->Consumer->GetReader()->GetNumberOfRejectedPackets(reason);
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLSource::GetNumberOfDroppedFrames()
+{
+  return this->Internal->Consumer->GetNumberOfDroppedFrames();
+}
+
+//----------------------------------------------------------------------------
+int vtkVelodyneHDLSource::GetReorderWindow()
+{
+  return this->Internal->Consumer->GetReader()->GetReorderWindow();
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetReorderWindow(int window)
+{
+  this->Internal->Consumer->GetReader()->SetReorderWindow(window);
+  this->Internal->Consumer->GetHistoryReader()->SetReorderWindow(window);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLSource::GetNumberOfReorderedPackets()
+{
+  return this->Internal->Consumer->GetReader()->GetNumberOfReorderedPackets();
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLSource::GetNumberOfDuplicatePackets()
+{
+  return this->Internal->Consumer->GetReader()->GetNumberOfDuplicatePackets();
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkVelodyneHDLSource::GetNumberOfLatePackets()
+{
+  return this->Internal->Consumer->GetReader()->GetNumberOfLatePackets();
+}
+
+//----------------------------------------------------------------------------
+vtkSensorClock* vtkVelodyneHDLSource::GetSensorClock()
+{
+  return this->Internal->Consumer->GetClock();
+}
+
+//----------------------------------------------------------------------------
+vtkFrameBufferPool* vtkVelodyneHDLSource::GetFrameBufferPool()
+{
+  return this->Internal->Consumer->GetReader()->GetFrameBufferPool();
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> vtkVelodyneHDLSource::GetFrameForSensorTime(double sensorTime, double& frameSensorTime)
+{
+  return this->Internal->Consumer->GetDatasetForSensorTime(sensorTime, frameSensorTime);
+}
+
+//----------------------------------------------------------------------------
+bool vtkVelodyneHDLSource::GetLatestSensorTime(double& sensorTime)
+{
+  return this->Internal->Consumer->GetLatestSensorTime(sensorTime);
+}
+
 //----------------------------------------------------------------------------
 int vtkVelodyneHDLSource::GetCacheSize()
 {
@@ -768,6 +3304,122 @@ void vtkVelodyneHDLSource::SetCacheSize(int cacheSize)
   this->Modified();
 }
 
+//----------------------------------------------------------------------------
+int vtkVelodyneHDLSource::GetCacheMemoryBudget()
+{
+  return static_cast<int>(this->Internal->Consumer->GetMemoryBudget() / (1024 * 1024));
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetCacheMemoryBudget(int megabytes)
+{
+  megabytes = std::max(megabytes, 0);
+  if (megabytes == this->GetCacheMemoryBudget())
+    {
+    return;
+    }
+
+  this->Internal->Consumer->SetMemoryBudget(static_cast<vtkTypeUInt64>(megabytes) * 1024 * 1024);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkVelodyneHDLSource::GetCacheTimeWindow()
+{
+  return this->Internal->Consumer->GetTimeWindow();
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetCacheTimeWindow(double seconds)
+{
+  if (seconds == this->GetCacheTimeWindow())
+    {
+    return;
+    }
+
+  this->Internal->Consumer->SetTimeWindow(seconds);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkVelodyneHDLSource::GetCacheCompression()
+{
+  return this->Internal->Consumer->GetCompression();
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetCacheCompression(bool compression)
+{
+  if (compression == this->GetCacheCompression())
+    {
+    return;
+    }
+
+  this->Internal->Consumer->SetCompression(compression);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkVelodyneHDLSource::GetCacheCompressionFormat()
+{
+  return this->Internal->Consumer->GetCompressionFormat();
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetCacheCompressionFormat(int format)
+{
+  format = std::min(std::max(format, static_cast<int>(COMPRESS_LOSSLESS)), static_cast<int>(COMPRESS_PACKETS));
+  if (format == this->GetCacheCompressionFormat())
+    {
+    return;
+    }
+
+  this->Internal->Consumer->SetCompressionFormat(format);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkVelodyneHDLSource::GetCacheCompressionAge()
+{
+  return this->Internal->Consumer->GetCompressionAge();
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetCacheCompressionAge(double seconds)
+{
+  if (seconds == this->GetCacheCompressionAge())
+    {
+    return;
+    }
+
+  this->Internal->Consumer->SetCompressionAge(seconds);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkVelodyneHDLSource::GetCacheQuantizationStep()
+{
+  return this->Internal->Consumer->GetQuantizationStep();
+}
+
+//----------------------------------------------------------------------------
+void vtkVelodyneHDLSource::SetCacheQuantizationStep(double step)
+{
+  if (step == this->GetCacheQuantizationStep() || step <= 0)
+    {
+    return;
+    }
+
+  this->Internal->Consumer->SetQuantizationStep(step);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkVelodyneHDLSource::GetCacheMemoryUsage()
+{
+  return this->Internal->Consumer->GetMemoryUsage() / (1024.0 * 1024.0);
+}
+
 //-----------------------------------------------------------------------------
 int vtkVelodyneHDLSource::RequestInformation(vtkInformation *request,
                                      vtkInformationVector **inputVector,
@@ -775,19 +3427,28 @@ int vtkVelodyneHDLSource::RequestInformation(vtkInformation *request,
 {
   vtkInformation *outInfo = outputVector->GetInformationObject(0);
 
-  std::vector<double> timesteps = this->Internal->Consumer->GetTimesteps();
-  const size_t nTimesteps = timesteps.size();
-  if (nTimesteps > 0)
+  double timeRange[2] = {0, 0};
+  if (!this->Internal->Consumer->GetTimeRange(timeRange))
+    {
+    outInfo->Remove(vtkStreamingDemandDrivenPipeline::TIME_STEPS());
+    outInfo->Remove(LATEST_TIME_STEP());
+    outInfo->Set(vtkStreamingDemandDrivenPipeline::TIME_RANGE(), timeRange, 2);
+    return 1;
+    }
+
+  if (this->PublishTimeSteps)
     {
-    outInfo->Set(vtkStreamingDemandDrivenPipeline::TIME_STEPS(), &timesteps.front(), static_cast<int>(nTimesteps));
+    this->Internal->Consumer->GetTimesteps(this->Internal->Timesteps);
+    const std::vector<double>& timesteps = this->Internal->Timesteps;
+    outInfo->Set(vtkStreamingDemandDrivenPipeline::TIME_STEPS(), &timesteps.front(), static_cast<int>(timesteps.size()));
     }
   else
     {
     outInfo->Remove(vtkStreamingDemandDrivenPipeline::TIME_STEPS());
     }
 
-  double timeRange[2] = {0, nTimesteps ? nTimesteps - 1 : 0};
   outInfo->Set(vtkStreamingDemandDrivenPipeline::TIME_RANGE(), timeRange, 2);
+  outInfo->Set(LATEST_TIME_STEP(), timeRange[1]);
 
   return 1;
 }
@@ -824,4 +3485,33 @@ int vtkVelodyneHDLSource::RequestData(
 void vtkVelodyneHDLSource::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os,indent);
+  os << indent << "SensorPort: " << this->SensorPort << endl;
+  os << indent << "PositionPort: " << this->PositionPort << endl;
+  os << indent << "SensorAddress: " << this->SensorAddress << endl;
+  os << indent << "MulticastGroup: " << this->MulticastGroup << endl;
+  os << indent << "MulticastInterface: " << this->MulticastInterface << endl;
+  os << indent << "NumberOfReceiveThreads: " << this->NumberOfReceiveThreads << endl;
+  os << indent << "ReceiveMode: " << this->ReceiveMode << endl;
+  os << indent << "BusyPollTime: " << this->BusyPollTime << endl;
+  os << indent << "FramePublishMode: " << this->FramePublishMode << endl;
+  os << indent << "MinimumFrameCoverage: " << this->MinimumFrameCoverage << endl;
+  os << indent << "FrameTimeout: " << this->FrameTimeout << endl;
+  os << indent << "PacketFile: " << this->PacketFile << endl;
+  os << indent << "OutputFile: " << this->OutputFile << endl;
+  os << indent << "ArrowOutputFile: " << this->ArrowOutputFile << endl;
+  os << indent << "FrameServerPath: " << this->FrameServerPath << endl;
+  os << indent << "FrameServerSectors: " << this->FrameServerSectors << endl;
+  os << indent << "HistoryFile: " << this->HistoryFile << endl;
+  os << indent << "HistoryFileSize: " << this->HistoryFileSize << endl;
+  os << indent << "TriggerFilePrefix: " << this->TriggerFilePrefix << endl;
+  os << indent << "PreTriggerTime: " << this->PreTriggerTime << endl;
+  os << indent << "PostTriggerTime: " << this->PostTriggerTime << endl;
+  os << indent << "PublishTimeSteps: " << this->PublishTimeSteps << endl;
+  os << indent << "CacheSize: " << this->GetCacheSize() << endl;
+  os << indent << "CacheMemoryBudget: " << this->GetCacheMemoryBudget() << endl;
+  os << indent << "CacheTimeWindow: " << this->GetCacheTimeWindow() << endl;
+  os << indent << "CacheCompression: " << this->GetCacheCompression() << endl;
+  os << indent << "CacheCompressionFormat: " << this->GetCacheCompressionFormat() << endl;
+  os << indent << "CacheCompressionAge: " << this->GetCacheCompressionAge() << endl;
+  os << indent << "CacheQuantizationStep: " << this->GetCacheQuantizationStep() << endl;
 }
@@ -33,6 +33,12 @@
 #define __vtkVelodyneHDLSource_h
 
 #include <vtkPolyDataAlgorithm.h>
+#include <vtkSmartPointer.h>
+
+class vtkFrameBufferPool;
+class vtkInformationDoubleKey;
+class vtkMatrix4x4;
+class vtkSensorClock;
 
 class vtkVelodyneHDLSource : public vtkPolyDataAlgorithm
 {
@@ -45,12 +51,115 @@ public:
 
   void Poll();
 
+  // Description:
+  // Key set on the output information to the timestep of the newest frame.
+  static vtkInformationDoubleKey* LATEST_TIME_STEP();
+
+  // Description:
+  // When off, RequestInformation() only publishes TIME_RANGE and
+  // LATEST_TIME_STEP, which takes constant time whatever the cache size.
+  // Downstream then requests any time in the range, usually the latest.
+  // When on (the default) the TIME_STEPS of all frames are published too.
+  vtkSetMacro(PublishTimeSteps, int);
+  vtkGetMacro(PublishTimeSteps, int);
+  vtkBooleanMacro(PublishTimeSteps, int);
+
   void Start();
   void Stop();
 
+  // Description:
+  // Maximum number of frames in the live cache, 0 for no limit.
   int GetCacheSize();
   void SetCacheSize(int cacheSize);
 
+  // Description:
+  // Memory budget of the live cache in megabytes, 0 for no limit.  Past
+  // the budget the oldest frames are evicted, except for those received
+  // within the last CacheTimeWindow seconds, which are always kept.
+  int GetCacheMemoryBudget();
+  void SetCacheMemoryBudget(int megabytes);
+
+  double GetCacheTimeWindow();
+  void SetCacheTimeWindow(double seconds);
+
+  // Description:
+  // When on, frames are compressed from the oldest one once half of the
+  // memory budget is used, so the budget holds a longer history.
+  // Compressed frames are expanded again when requested.
+  bool GetCacheCompression();
+  void SetCacheCompression(bool compression);
+
+  enum CompressionFormat
+  {
+    COMPRESS_LOSSLESS = 0,
+    COMPRESS_QUANTIZED = 1,
+    COMPRESS_PACKETS = 2
+  };
+
+  // Description:
+  // Compact form of compressed frames: zlib compressed arrays, arrays with
+  // the coordinates quantized to CacheQuantizationStep meters, or the raw
+  // packets of the frame, which are decoded again when the frame is
+  // requested.  Packets are only kept for frames received after
+  // COMPRESS_PACKETS is selected.
+  int GetCacheCompressionFormat();
+  void SetCacheCompressionFormat(int format);
+
+  // Description:
+  // Frames older than this many seconds are compressed regardless of the
+  // memory budget, 0 to compress only under memory pressure.
+  double GetCacheCompressionAge();
+  void SetCacheCompressionAge(double seconds);
+
+  double GetCacheQuantizationStep();
+  void SetCacheQuantizationStep(double step);
+
+  // Description:
+  // Memory currently held by the live cache, in megabytes.
+  double GetCacheMemoryUsage();
+
+  // Description:
+  // Sensor to world transform applied while decoding, see
+  // vtkVelodyneHDLReader::SetSensorTransform.  Set it before Start().
+  vtkMatrix4x4* GetSensorTransform();
+  void SetSensorTransform(vtkMatrix4x4* matrix);
+
+  // Description:
+  // Packet validation counters of the decoding reader, see
+  // vtkVelodyneHDLReader::ProcessHDLPacket.
+  vtkIdType GetNumberOfAcceptedPackets();
+  vtkIdType GetNumberOfRejectedPackets(int reason);
+
+  // Description:
+  // Reorder window of the decoding readers and its counters, see
+  // vtkVelodyneHDLReader::SetReorderWindow.  Set it before Start().
+  int GetReorderWindow();
+  void SetReorderWindow(int window);
+  vtkIdType GetNumberOfReorderedPackets();
+  vtkIdType GetNumberOfDuplicatePackets();
+  vtkIdType GetNumberOfLatePackets();
+
+//BTX
+  // Description:
+  // Buffer pool of the decoding reader, see
+  // vtkVelodyneHDLReader::GetFrameBufferPool.
+  vtkFrameBufferPool* GetFrameBufferPool();
+//ETX
+
+//BTX
+  // Description:
+  // Cached frame whose sensor time (microseconds past the hour, field data
+  // array "sensor_time_us") is nearest to sensorTime.  Used to align the
+  // frames of several sensors, see vtkVelodyneHDLFusionSource.
+  vtkSmartPointer<vtkPolyData> GetFrameForSensorTime(double sensorTime, double& frameSensorTime);
+  bool GetLatestSensorTime(double& sensorTime);
+//ETX
+
+  // Description:
+  // Difference a - b of two sensor times in microseconds past the hour,
+  // taking the hourly rollover into account.
+  static double SensorTimeDifference(double a, double b);
+
   void ReadNextFrame();
 
   const std::string& GetPacketFile();
@@ -62,9 +171,192 @@ public:
   const std::string& GetOutputFile();
   void SetOutputFile(const std::string& filename);
 
+  // Description:
+  // When set, every completed frame is also written as an Arrow record
+  // batch.  Filenames ending in .arrows use the IPC stream format, other
+  // names the IPC file format.
+  const std::string& GetArrowOutputFile();
+  void SetArrowOutputFile(const std::string& filename);
+
   vtkSetMacro(SensorPort, int);
   vtkGetMacro(SensorPort, int);
 
+  // Description:
+  // IPv4 address of the sensor to decode, empty for any sensor.  All the
+  // sources listening on a port share one socket, which routes every packet
+  // by its sender to the source set for that address, or else to the one
+  // without an address.  This way one receive thread serves several
+  // sensors sending to the same port.  Set it before Start().
+  const std::string& GetSensorAddress();
+  void SetSensorAddress(const std::string& address);
+
+  // Description:
+  // IPv4 multicast group the sensor sends to, empty for unicast or
+  // broadcast.  Start() joins it on the interface with the address
+  // MulticastInterface, or on the default interface if that is empty.
+  // The group is joined on both SensorPort and PositionPort, and only
+  // the groups joined by a source reach it.
+  const std::string& GetMulticastGroup();
+  void SetMulticastGroup(const std::string& group);
+
+  const std::string& GetMulticastInterface();
+  void SetMulticastInterface(const std::string& networkInterface);
+
+  // Description:
+  // Packets received on SensorPort from senders no source listens for.
+  vtkIdType GetNumberOfUnroutedPackets();
+
+  // Description:
+  // Number of sockets, each with its own receive thread, opened on
+  // SensorPort by the first source listening on it.  Above 1 the sockets
+  // share the port through SO_REUSEPORT and the kernel spreads the packets
+  // over them by sender address, so the receive rate scales with the
+  // number of sensors.  Linux only; elsewhere one socket is used.
+  // Sources sharing SensorPort must use the same NumberOfReceiveThreads,
+  // whether they spin and BusyPollTime, or Start() warns and does not
+  // receive.
+  vtkSetClampMacro(NumberOfReceiveThreads, int, 1, 64);
+  vtkGetMacro(NumberOfReceiveThreads, int);
+
+  enum ReceiveModeType
+  {
+    RECEIVE_QUEUED = 0,
+    RECEIVE_INLINE = 1,
+    RECEIVE_BUSY_POLL = 2
+  };
+
+  // Description:
+  // How received packets reach the decoder.  RECEIVE_QUEUED, the default,
+  // hands every packet to a decoding thread through a queue.
+  // RECEIVE_INLINE decodes it on the receive thread instead, which saves a
+  // thread wake up per packet.  RECEIVE_BUSY_POLL decodes inline too and
+  // the receive threads spin on non blocking sockets with SO_BUSY_POLL set
+  // to BusyPollTime microseconds, keeping a core busy per socket for the
+  // lowest latency.  Spinning is set by the first source opening the
+  // port and the others must match it, see NumberOfReceiveThreads.  Set
+  // them before Start().
+  vtkSetClampMacro(ReceiveMode, int, RECEIVE_QUEUED, RECEIVE_BUSY_POLL);
+  vtkGetMacro(ReceiveMode, int);
+
+  vtkSetClampMacro(BusyPollTime, int, 0, 1000000);
+  vtkGetMacro(BusyPollTime, int);
+
+  // Description:
+  // Time in microseconds from the receipt of a packet to the end of its
+  // decoding, measured the same way in every receive mode.  Percentiles
+  // (0 to 100) are exact to the microsecond up to 1 ms.
+  double GetMeanReceiveLatency();
+  double GetMaxReceiveLatency();
+  double GetReceiveLatencyPercentile(double percentile);
+  vtkIdType GetNumberOfLatencySamples();
+  void ResetReceiveLatency();
+
+  enum FramePublishModeType
+  {
+    PUBLISH_ON_WRAP = 0,
+    PUBLISH_ON_COVERAGE = 1
+  };
+
+  // Description:
+  // Frames carry their azimuth coverage, see
+  // vtkVelodyneHDLReader::PublishPartialFrame.  With PUBLISH_ON_WRAP, the
+  // default, they are published when the azimuth wraps.  With
+  // PUBLISH_ON_COVERAGE they are published as soon as they cover
+  // MinimumFrameCoverage of the revolution, and the rest of the revolution
+  // is skipped, see vtkVelodyneHDLReader::SetPublishCoverage.  In both
+  // modes frames that wrap with less than MinimumFrameCoverage (0 to 1),
+  // such as the first one or one torn by packet loss, are dropped and
+  // counted.  With a FrameTimeout in seconds, a frame that got no packet
+  // for that long is published as it is, flagged incomplete, which bounds
+  // the latency of the last frame when the sensor stops.  Off (0) by
+  // default.  Set them before Start().
+  vtkSetClampMacro(FramePublishMode, int, PUBLISH_ON_WRAP, PUBLISH_ON_COVERAGE);
+  vtkGetMacro(FramePublishMode, int);
+  vtkSetClampMacro(MinimumFrameCoverage, double, 0.0, 1.0);
+  vtkGetMacro(MinimumFrameCoverage, double);
+  vtkSetClampMacro(FrameTimeout, double, 0.0, VTK_DOUBLE_MAX);
+  vtkGetMacro(FrameTimeout, double);
+  vtkIdType GetNumberOfDroppedFrames();
+
+  // Description:
+  // Port of the position packets, 0 to ignore them.  They update the
+  // sensor clock, and every frame then gets its absolute UTC time in
+  // seconds since the epoch in the field data array "absolute_time_s".
+  vtkSetMacro(PositionPort, int);
+  vtkGetMacro(PositionPort, int);
+
+//BTX
+  // Description:
+  // Model relating sensor time to UTC and to the host clock, see
+  // vtkSensorClock.h.
+  vtkSensorClock* GetSensorClock();
+//ETX
+
+  // Description:
+  // When set, Start() publishes completed frames to local processes on a
+  // Unix domain socket at this path (see vtkFrameSocketServer.h).
+  const std::string& GetFrameServerPath();
+  void SetFrameServerPath(const std::string& path);
+
+  // Description:
+  // Number of azimuth sectors published per frame on the sectors topic.
+  vtkSetClampMacro(FrameServerSectors, int, 1, 360);
+  vtkGetMacro(FrameServerSectors, int);
+
+  // Description:
+  // When set, Start() keeps the raw packets in a ring file of
+  // HistoryFileSize megabytes at this path, allocated up front.  Frames
+  // evicted from the live cache stay in the time steps until their packets
+  // are overwritten and are decoded again when requested.
+  const std::string& GetHistoryFile();
+  void SetHistoryFile(const std::string& filename);
+
+  vtkSetClampMacro(HistoryFileSize, int, 1, VTK_INT_MAX);
+  vtkGetMacro(HistoryFileSize, int);
+
+  // Description:
+  // When set, Start() keeps the last PreTriggerTime seconds of packets in
+  // memory and every trigger writes them, followed by the packets of the
+  // next PostTriggerTime seconds, to a new packet file named after this
+  // prefix and the time of the recording.  A trigger during a recording
+  // extends it.  Only packets received from the network are recorded.
+  const std::string& GetTriggerFilePrefix();
+  void SetTriggerFilePrefix(const std::string& prefix);
+
+  vtkSetClampMacro(PreTriggerTime, double, 0, VTK_DOUBLE_MAX);
+  vtkGetMacro(PreTriggerTime, double);
+
+  vtkSetClampMacro(PostTriggerTime, double, 0, VTK_DOUBLE_MAX);
+  vtkGetMacro(PostTriggerTime, double);
+
+  // Description:
+  // Starts or extends an event recording.  Safe to call from any thread.
+  void Trigger();
+
+//BTX
+  struct FrameStatistics
+  {
+    vtkIdType NumberOfPoints;
+    double MinDistance;
+    double MaxDistance;
+    double MeanIntensity;
+  };
+
+  // Description:
+  // Called with the statistics of every new frame while event recording
+  // runs, on the decoding thread; returning true triggers a recording.
+  typedef bool (*TriggerPredicate)(const FrameStatistics& statistics, void* clientData);
+  void SetTriggerPredicate(TriggerPredicate predicate, void* clientData);
+
+  // Description:
+  // Calls callback once with the next frame, on the decoding thread right
+  // after the frame is published, or with a NULL frame when the source is
+  // stopped.  Applications built on an event loop use it instead of
+  // polling; see vtkVelodyneHDLAsyncFrame.h for the asio version.
+  typedef void (*FrameCallback)(vtkPolyData* frame, double timestep, void* clientData);
+  void NotifyNextFrame(FrameCallback callback, void* clientData);
+//ETX
+
 protected:
 
 
@@ -79,11 +371,34 @@ protected:
   vtkVelodyneHDLSource();
   virtual ~vtkVelodyneHDLSource();
 
+  void StartArrowWriter();
+  void StartFrameServer();
+  void StartHistoryFile();
+
 
   int SensorPort;
+  int PositionPort;
+  int NumberOfReceiveThreads;
+  int ReceiveMode;
+  int BusyPollTime;
+  int FramePublishMode;
+  double MinimumFrameCoverage;
+  double FrameTimeout;
+  int FrameServerSectors;
+  int HistoryFileSize;
+  int PublishTimeSteps;
+  double PreTriggerTime;
+  double PostTriggerTime;
   std::string PacketFile;
   std::string OutputFile;
+  std::string ArrowOutputFile;
+  std::string FrameServerPath;
+  std::string HistoryFile;
+  std::string TriggerFilePrefix;
   std::string CorrectionsFile;
+  std::string SensorAddress;
+  std::string MulticastGroup;
+  std::string MulticastInterface;
 
 private:
   vtkVelodyneHDLSource(const vtkVelodyneHDLSource&);  // Not implemented.